@@ -0,0 +1,145 @@
+﻿#include "pch.h"
+#include "AnalysisGraph.h"
+
+AnalysisGraph::AnalysisGraph(std::uint32_t channels, std::uint32_t sample_rate)
+{
+    if (channels == 0 || sample_rate == 0) {
+        throw std::invalid_argument("invalid source format");
+    }
+    add_node(Kind::Source, 0, 0, channels, sample_rate);
+}
+
+AnalysisGraph::Stream AnalysisGraph::add_node(Kind kind, Stream parent, std::uint32_t param, std::uint32_t channels, std::uint32_t sample_rate)
+{
+    // 同じ変換が既にあればそれを共有する
+    for (Stream i = 1; i < nodes.size(); ++i) {
+        if (nodes[i].kind == kind && nodes[i].parent == parent && nodes[i].param == param) return i;
+    }
+    Node node;
+    node.kind = kind;
+    node.parent = parent;
+    node.param = param;
+    node.channels = channels;
+    node.sample_rate = sample_rate;
+    if (kind == Kind::Resample) {
+        node.resampler = std::make_unique<PolyphaseResampler>(channels, nodes[parent].sample_rate, sample_rate);
+    }
+    nodes.push_back(std::move(node));
+    return nodes.size() - 1;
+}
+
+AnalysisGraph::Stream AnalysisGraph::channel(Stream stream, std::uint32_t c)
+{
+    if (c >= nodes.at(stream).channels) {
+        throw std::out_of_range("channel index out of range");
+    }
+    if (nodes[stream].channels == 1) return stream;
+    return add_node(Kind::Channel, stream, c, 1, nodes[stream].sample_rate);
+}
+
+AnalysisGraph::Stream AnalysisGraph::remix(Stream stream, std::uint32_t channels)
+{
+    if (channels == 0) {
+        throw std::invalid_argument("channel count must be positive");
+    }
+    if (nodes.at(stream).channels == channels) return stream;
+    return add_node(Kind::Remix, stream, channels, channels, nodes[stream].sample_rate);
+}
+
+AnalysisGraph::Stream AnalysisGraph::resample(Stream stream, std::uint32_t sample_rate)
+{
+    if (sample_rate == 0) {
+        throw std::invalid_argument("sample rate must be positive");
+    }
+    if (nodes.at(stream).sample_rate == sample_rate) return stream;
+    return add_node(Kind::Resample, stream, sample_rate, nodes[stream].channels, sample_rate);
+}
+
+void AnalysisGraph::connect(Stream stream, Consumer consumer)
+{
+    nodes.at(stream).consumers.push_back(std::move(consumer));
+}
+
+void AnalysisGraph::push(const float* pcm, std::uint32_t frames, TimeSpan ts)
+{
+    Node& src = nodes[0];
+    src.view = { pcm, src.channels, frames, src.channels, src.sample_rate, ts };
+    run(false);
+}
+
+void AnalysisGraph::end_of_stream()
+{
+    // 元のPCMはもうないので、リサンプリングの残りだけが下流へ流れる
+    Node& src = nodes[0];
+    src.view = { nullptr, src.channels, 0, src.channels, src.sample_rate, src.view.ts };
+    run(true);
+}
+
+void AnalysisGraph::run(bool last)
+{
+    // 親は必ず前にあるので、先頭から順に求めればよい
+    for (Node& node : nodes) {
+        if (node.kind != Kind::Source) {
+            compute(node, last);
+        }
+        if (node.view.frames == 0) continue;
+        for (const Consumer& consumer : node.consumers) {
+            consumer(node.view);
+        }
+    }
+}
+
+void AnalysisGraph::compute(Node& node, bool last)
+{
+    const AudioView& in = nodes[node.parent].view;
+    AudioView& out = node.view;
+    out = { nullptr, node.channels, 0, node.channels, node.sample_rate, in.ts };
+
+    switch (node.kind)
+    {
+    case Kind::Channel:
+        // 親のデータをそのまま参照する
+        out.data = in.data + node.param;
+        out.stride = in.stride;
+        out.frames = in.frames;
+        break;
+
+    case Kind::Remix:
+        node.buffer.resize(size_t(in.frames) * node.channels);
+        if (node.channels == 1) {
+            const float scale = 1.0f / in.channels;
+            for (uint32_t f = 0; f < in.frames; ++f) {
+                const float* frame = in.data + f * in.stride;
+                float sum = 0;
+                for (uint32_t c = 0; c < in.channels; ++c) sum += frame[c];
+                node.buffer[f] = sum * scale;
+            }
+        }
+        else {
+            for (uint32_t f = 0; f < in.frames; ++f) {
+                const float* frame = in.data + f * in.stride;
+                for (uint32_t c = 0; c < node.channels; ++c) {
+                    node.buffer[size_t(f) * node.channels + c] = frame[c < in.channels ? c : in.channels - 1];
+                }
+            }
+        }
+        out.data = node.buffer.data();
+        out.frames = in.frames;
+        break;
+
+    case Kind::Resample:
+        out.frames = node.resampler->process(in.data, in.stride, in.frames, node.buffer);
+        if (last) {
+            std::vector<float> rest;
+            const std::uint32_t frames = node.resampler->flush(rest);
+            node.buffer.resize(size_t(out.frames) * node.channels);
+            node.buffer.insert(node.buffer.end(), rest.begin(), rest.end());
+            out.frames += frames;
+        }
+        out.data = node.buffer.data();
+        break;
+
+    case Kind::Source:
+        break;
+    }
+}
@@ -0,0 +1,128 @@
+﻿#pragma once
+
+#include "Resampler.h"
+
+/**
+ * @brief AnalysisGraphのストリームの1ブロック分への参照。データはAnalysisGraphが所有し、コールバックの中でのみ有効。
+ */
+struct AudioView
+{
+	/// winrt::Windows::Foundation::TimeSpanと同じ型 (100ns単位)
+	using TimeSpan = std::chrono::duration<int64_t, std::ratio<1, 10'000'000>>;
+
+	const float* data = nullptr;	/// 先頭フレームの先頭チャンネル
+	std::size_t stride = 0;			/// フレームの間隔 (要素数)。channelsと等しければインターリーブされた連続領域
+	std::uint32_t frames = 0;		/// フレーム数
+	std::uint32_t channels = 0;		/// チャンネル数
+	std::uint32_t sample_rate = 0;	/// サンプリングレート
+	TimeSpan ts{};					/// ブロック先頭の時刻
+
+	/**
+	 * @brief インターリーブされた連続領域か
+	 */
+	bool contiguous() const { return stride == channels; }
+};
+
+/**
+ * @class AnalysisGraph
+ * @brief 1回だけデコードしたPCMから派生ストリーム (チャンネルの取り出し、チャンネル数の変換、リサンプリング) を作り、
+ * 複数の解析ステージに配るグラフ。
+ * 同じ変換を2回要求すると同じストリームが返るため、変換はブロックごとに1回だけ行われる。
+ * チャンネルの取り出しや、チャンネル数・サンプリングレートが変わらない変換はコピーせず元のデータを参照する。
+ */
+class AnalysisGraph
+{
+public:
+	using TimeSpan = AudioView::TimeSpan;
+	using Stream = std::size_t;								/// ストリームの番号
+	using Consumer = std::function<void(const AudioView&)>;	/// ブロックごとに呼ばれる処理
+
+private:
+	enum class Kind { Source, Channel, Remix, Resample };
+
+	struct Node {
+		Kind kind;
+		Stream parent;
+		std::uint32_t param;						/// Channel: チャンネル番号、Remix: チャンネル数、Resample: サンプリングレート
+		std::uint32_t channels;
+		std::uint32_t sample_rate;
+		std::vector<Consumer> consumers;
+		std::vector<float> buffer;					/// 変換結果 (Remix, Resample)
+		std::unique_ptr<PolyphaseResampler> resampler;	/// Resampleのみ
+		AudioView view;								/// 現在のブロック
+	};
+
+	std::vector<Node> nodes;	/// 親より後ろに並ぶ
+
+	Stream add_node(Kind kind, Stream parent, std::uint32_t param, std::uint32_t channels, std::uint32_t sample_rate);
+	void compute(Node& node, bool last);
+	void run(bool last);
+
+public:
+	/**
+	 * @param channels デコードしたPCMのチャンネル数
+	 * @param sample_rate デコードしたPCMのサンプリングレート
+	 */
+	AnalysisGraph(std::uint32_t channels, std::uint32_t sample_rate);
+
+	/**
+	 * @brief デコードしたPCMそのもののストリーム
+	 */
+	Stream source() const { return 0; }
+
+	/**
+	 * @brief streamのc番目のチャンネルだけを取り出したストリーム。コピーしない。
+	 */
+	Stream channel(Stream stream, std::uint32_t c);
+
+	/**
+	 * @brief streamをchannelsチャンネルに変換したストリーム。
+	 * 1チャンネルへは平均でダウンミックスし、それ以外は先頭から対応付ける (足りないチャンネルは最後のチャンネルを複製する)。
+	 * チャンネル数が同じならstreamそのものを返す。
+	 */
+	Stream remix(Stream stream, std::uint32_t channels);
+
+	/**
+	 * @brief streamのサンプリングレートを変換したストリーム。同じレートならstreamそのものを返す。
+	 */
+	Stream resample(Stream stream, std::uint32_t sample_rate);
+
+	/**
+	 * @brief ストリームに処理を登録する。登録順に呼ばれる。
+	 */
+	void connect(Stream stream, Consumer consumer);
+
+	std::uint32_t channels(Stream stream) const { return nodes[stream].channels; }
+	std::uint32_t sample_rate(Stream stream) const { return nodes[stream].sample_rate; }
+
+	/**
+	 * @brief デコードした1ブロックを流し、全ての派生ストリームを求めて登録された処理を呼ぶ。
+	 *
+	 * @param pcm インターリーブされたPCM
+	 * @param frames フレーム数
+	 * @param ts ブロック先頭の時刻
+	 */
+	void push(const float* pcm, std::uint32_t frames, TimeSpan ts);
+
+	/**
+	 * @brief デコードの終端で呼ぶ。リサンプリングのフィルターに残った分を出力し、登録された処理を呼ぶ。
+	 * 呼び出した後は次の音源のPCMを流せる。
+	 */
+	void end_of_stream();
+
+	/**
+	 * @brief MusicAnalysisまたはOfflineAnalysisに、元の形式のままの出力ノードを1つだけ追加してグラフにつなぐ。
+	 * グラフはma.get_graph_properties()と同じ形式で構築しておくこと。
+	 */
+	template<class Analysis>
+	void attach(Analysis& ma) {
+		auto properties = ma.get_graph_properties();
+		if (properties.ChannelCount() != nodes[0].channels || properties.SampleRate() != nodes[0].sample_rate) {
+			throw std::invalid_argument("AnalysisGraph format does not match the analysis source");
+		}
+		const std::uint32_t source_channels = nodes[0].channels;
+		ma.add_outnode([this, source_channels](float* pcm, uint32_t capacity, TimeSpan ts) {
+			push(pcm, capacity / source_channels, ts);
+			}, properties);
+	}
+};
@@ -0,0 +1,159 @@
+﻿#include "pch.h"
+#include "AudioFileSource.h"
+
+namespace {
+    // リトルエンディアンの整数を読む
+    template<std::integral I>
+    I read_le(const std::byte* p) {
+        I value;
+        std::memcpy(&value, p, sizeof(I));
+        return value;
+    }
+
+    constexpr uint16_t WAVE_FORMAT_PCM = 0x0001;
+    constexpr uint16_t WAVE_FORMAT_IEEE_FLOAT = 0x0003;
+    constexpr uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+}
+
+PcmFileSource::PcmFileSource(const std::filesystem::path& path) : stream(path, std::ios::binary) {
+    if (!stream) {
+        throw std::runtime_error("cannot open " + path.string());
+    }
+}
+
+void PcmFileSource::set_data_region(PcmSampleType sample_type, uint32_t channel_count, uint32_t sample_rate, uint64_t offset, uint64_t size)
+{
+    if (channel_count == 0 || sample_rate == 0) {
+        throw std::runtime_error("invalid pcm format");
+    }
+    type = sample_type;
+    channels = channel_count;
+    rate = sample_rate;
+    frames = size / (uint64_t(bytes_per_sample(type)) * channels);
+    position = 0;
+    stream.clear();
+    stream.seekg(offset);
+}
+
+uint32_t PcmFileSource::bytes_per_sample(PcmSampleType sample_type)
+{
+    switch (sample_type)
+    {
+        using enum PcmSampleType;
+    case UInt8:   return 1;
+    case Int16:   return 2;
+    case Int24:   return 3;
+    case Int32:   return 4;
+    case Float32: return 4;
+    case Float64: return 8;
+    }
+    return 0;
+}
+
+uint32_t PcmFileSource::read(float* dst, uint32_t count)
+{
+    const uint64_t left = frames - position;
+    if (left < count) count = static_cast<uint32_t>(left);
+    if (count == 0) return 0;
+
+    const uint32_t bps = bytes_per_sample(type);
+    const size_t samples = size_t(count) * channels;
+    raw.resize(samples * bps);
+    stream.read(reinterpret_cast<char*>(raw.data()), raw.size());
+    const size_t got = static_cast<size_t>(stream.gcount()) / (size_t(bps) * channels) * channels;
+    count = static_cast<uint32_t>(got / channels);
+    position += count;
+
+    const std::byte* p = raw.data();
+    switch (type)
+    {
+        using enum PcmSampleType;
+    case UInt8:
+        for (size_t i = 0; i < got; ++i) dst[i] = (float(std::to_integer<uint8_t>(p[i])) - 128.0f) * (1.0f / 128);
+        break;
+    case Int16:
+        for (size_t i = 0; i < got; ++i) dst[i] = float(read_le<int16_t>(p + i * 2)) * (1.0f / 32768);
+        break;
+    case Int24:
+        for (size_t i = 0; i < got; ++i) {
+            // 上位3byteに詰めて算術シフトで符号拡張
+            uint32_t u = std::to_integer<uint32_t>(p[i * 3]) << 8 | std::to_integer<uint32_t>(p[i * 3 + 1]) << 16 | std::to_integer<uint32_t>(p[i * 3 + 2]) << 24;
+            dst[i] = float(static_cast<int32_t>(u) >> 8) * (1.0f / 8388608);
+        }
+        break;
+    case Int32:
+        for (size_t i = 0; i < got; ++i) dst[i] = float(double(read_le<int32_t>(p + i * 4)) * (1.0 / 2147483648.0));
+        break;
+    case Float32:
+        std::memcpy(dst, p, got * sizeof(float));
+        break;
+    case Float64:
+        for (size_t i = 0; i < got; ++i) {
+            double d;
+            std::memcpy(&d, p + i * 8, sizeof(double));
+            dst[i] = float(d);
+        }
+        break;
+    }
+    return count;
+}
+
+WaveFileSource::WaveFileSource(const std::filesystem::path& path) : PcmFileSource(path)
+{
+    std::ifstream& s = file();
+    std::byte header[12];
+    if (!s.read(reinterpret_cast<char*>(header), sizeof(header))
+        || std::memcmp(header, "RIFF", 4) != 0 || std::memcmp(header + 8, "WAVE", 4) != 0) {
+        throw std::runtime_error("not a RIFF WAVE file: " + path.string());
+    }
+
+    bool has_fmt = false;
+    PcmSampleType sample_type = PcmSampleType::Int16;
+    uint32_t channel_count = 0;
+    uint32_t sample_rate = 0;
+
+    // チャンクを順に読み、fmt の後に現れる data を探す
+    std::byte chunk[8];
+    while (s.read(reinterpret_cast<char*>(chunk), sizeof(chunk))) {
+        const uint32_t size = read_le<uint32_t>(chunk + 4);
+        const uint64_t body = static_cast<uint64_t>(s.tellg());
+
+        if (std::memcmp(chunk, "fmt ", 4) == 0) {
+            if (size < 16) break;
+            std::vector<std::byte> fmt(size);
+            s.read(reinterpret_cast<char*>(fmt.data()), size);
+
+            uint16_t tag = read_le<uint16_t>(fmt.data());
+            channel_count = read_le<uint16_t>(fmt.data() + 2);
+            sample_rate = read_le<uint32_t>(fmt.data() + 4);
+            const uint16_t bits = read_le<uint16_t>(fmt.data() + 14);
+            if (tag == WAVE_FORMAT_EXTENSIBLE && size >= 40) {
+                tag = read_le<uint16_t>(fmt.data() + 24);  // SubFormat GUIDの先頭2byte
+            }
+
+            if (tag == WAVE_FORMAT_PCM && bits == 8) sample_type = PcmSampleType::UInt8;
+            else if (tag == WAVE_FORMAT_PCM && bits == 16) sample_type = PcmSampleType::Int16;
+            else if (tag == WAVE_FORMAT_PCM && bits == 24) sample_type = PcmSampleType::Int24;
+            else if (tag == WAVE_FORMAT_PCM && bits == 32) sample_type = PcmSampleType::Int32;
+            else if (tag == WAVE_FORMAT_IEEE_FLOAT && bits == 32) sample_type = PcmSampleType::Float32;
+            else if (tag == WAVE_FORMAT_IEEE_FLOAT && bits == 64) sample_type = PcmSampleType::Float64;
+            else throw std::runtime_error("unsupported wave format: " + path.string());
+            has_fmt = true;
+        }
+        else if (std::memcmp(chunk, "data", 4) == 0 && has_fmt) {
+            // ストリーミング書き出しされたファイルはsizeが0や過大になっていることがある
+            s.seekg(0, std::ios::end);
+            const uint64_t end = static_cast<uint64_t>(s.tellg());
+            const uint64_t data_size = (size == 0 || body + size > end) ? end - body : size;
+            set_data_region(sample_type, channel_count, sample_rate, body, data_size);
+            return;
+        }
+        s.seekg(body + size + (size & 1));  // チャンクは2byte境界に揃えられる
+    }
+    throw std::runtime_error("no data chunk: " + path.string());
+}
+
+RawPcmSource::RawPcmSource(const std::filesystem::path& path, PcmSampleType sample_type, uint32_t channel_count, uint32_t sample_rate) : PcmFileSource(path)
+{
+    set_data_region(sample_type, channel_count, sample_rate, 0, std::filesystem::file_size(path));
+}
@@ -0,0 +1,123 @@
+﻿#pragma once
+
+/**
+ * @brief PCMファイル中の1サンプルのデータ形式
+ */
+enum class PcmSampleType {
+    UInt8,      /// 8bit 符号なし整数
+    Int16,      /// 16bit 符号付き整数
+    Int24,      /// 24bit 符号付き整数 (3byte詰め)
+    Int32,      /// 32bit 符号付き整数
+    Float32,    /// IEEE 単精度浮動小数点
+    Float64,    /// IEEE 倍精度浮動小数点
+};
+
+/**
+ * @class OfflineSource
+ * @brief AudioGraphを介さずにPCMを読み出す音源の基底クラス。
+ * 再生時間に縛られず、呼び出し側の要求した速度で読み出せる。
+ */
+class OfflineSource
+{
+public:
+    virtual ~OfflineSource() = default;
+
+    /**
+     * @brief チャンネル数を取得する
+     */
+    virtual uint32_t channel_count() const = 0;
+
+    /**
+     * @brief サンプリングレートを取得する
+     */
+    virtual uint32_t sample_rate() const = 0;
+
+    /**
+     * @brief 総フレーム数(1フレーム = 全チャンネル分の1サンプル)を取得する
+     */
+    virtual uint64_t frame_count() const = 0;
+
+    /**
+     * @brief インターリーブされたfloat [-1, 1] としてPCMを読み出す
+     *
+     * @param dst 出力先。frames * channel_count() 個以上の領域が必要。
+     * @param frames 読み出す最大フレーム数
+     * @return 読み出したフレーム数。終端に達していれば0
+     */
+    virtual uint32_t read(float* dst, uint32_t frames) = 0;
+};
+
+/**
+ * @class PcmFileSource
+ * @brief ファイル中の連続したPCMデータ領域を読み出すOfflineSourceの共通実装。
+ */
+class PcmFileSource : public OfflineSource
+{
+    std::ifstream stream;               /// 入力ファイル
+    std::vector<std::byte> raw;         /// 変換前データの読み出しバッファ
+    PcmSampleType type = PcmSampleType::Int16;
+    uint32_t channels = 0;
+    uint32_t rate = 0;
+    uint64_t frames = 0;                /// データ領域の総フレーム数
+    uint64_t position = 0;              /// 次に読み出すフレーム
+
+protected:
+    /**
+     * @param path PCMファイルのパス
+     */
+    PcmFileSource(const std::filesystem::path& path);
+
+    /**
+     * @brief データ領域を設定する。派生クラスのコンストラクタで必ず呼び出す。
+     *
+     * @param sample_type サンプル形式
+     * @param channel_count チャンネル数
+     * @param sample_rate サンプリングレート
+     * @param offset データ領域のファイル先頭からのバイト位置
+     * @param size データ領域のバイト数
+     */
+    void set_data_region(PcmSampleType sample_type, uint32_t channel_count, uint32_t sample_rate, uint64_t offset, uint64_t size);
+
+    std::ifstream& file() { return stream; }
+
+public:
+    /**
+     * @brief サンプル形式のバイト数を取得する
+     */
+    static uint32_t bytes_per_sample(PcmSampleType sample_type);
+
+    uint32_t channel_count() const override { return channels; }
+    uint32_t sample_rate() const override { return rate; }
+    uint64_t frame_count() const override { return frames; }
+    uint32_t read(float* dst, uint32_t count) override;
+};
+
+/**
+ * @class WaveFileSource
+ * @brief RIFF WAVEファイル(PCM / IEEE float / WAVE_FORMAT_EXTENSIBLE)を読み出す。
+ */
+class WaveFileSource : public PcmFileSource
+{
+public:
+    /**
+     * @param path WAVファイルのパス
+     * @throw std::runtime_error 対応していない形式の場合
+     */
+    WaveFileSource(const std::filesystem::path& path);
+};
+
+/**
+ * @class RawPcmSource
+ * @brief ヘッダーのない生PCMファイルを、指定した形式として読み出す。
+ */
+class RawPcmSource : public PcmFileSource
+{
+public:
+    /**
+     * @param path PCMファイルのパス
+     * @param sample_type サンプル形式
+     * @param channel_count チャンネル数
+     * @param sample_rate サンプリングレート
+     */
+    RawPcmSource(const std::filesystem::path& path, PcmSampleType sample_type, uint32_t channel_count, uint32_t sample_rate);
+};
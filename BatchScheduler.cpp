@@ -0,0 +1,221 @@
+﻿#include "pch.h"
+#include "BatchScheduler.h"
+
+namespace {
+    std::wstring to_lower(std::wstring s) {
+        std::transform(s.begin(), s.end(), s.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+        return s;
+    }
+
+    bool has_extension(const std::filesystem::path& p, const std::vector<std::wstring>& extensions) {
+        const std::wstring ext = to_lower(p.extension().wstring());
+        return std::any_of(extensions.begin(), extensions.end(), [&ext](const std::wstring& e) { return to_lower(e) == ext; });
+    }
+
+    bool has_wildcard(const std::wstring& s) {
+        return s.find_first_of(L"*?") != std::wstring::npos;
+    }
+
+    // *は0文字以上、?は1文字に一致する。大文字小文字は区別しない
+    bool wildcard_match(const std::wstring& pattern, const std::wstring& name) {
+        std::size_t p = 0, n = 0;
+        std::size_t star = std::wstring::npos, resume = 0;
+        while (n < name.size()) {
+            if (p < pattern.size() && (pattern[p] == L'?' || std::towlower(pattern[p]) == std::towlower(name[n]))) {
+                ++p;
+                ++n;
+            }
+            else if (p < pattern.size() && pattern[p] == L'*') {
+                star = p++;
+                resume = n;
+            }
+            else if (star != std::wstring::npos) {
+                p = star + 1;
+                n = ++resume;
+            }
+            else {
+                return false;
+            }
+        }
+        while (p < pattern.size() && pattern[p] == L'*') ++p;
+        return p == pattern.size();
+    }
+
+    bool is_manifest(const std::filesystem::path& p) {
+        return has_extension(p, { L".txt", L".lst", L".m3u", L".m3u8" });
+    }
+
+    std::vector<std::filesystem::path> read_manifest(const std::filesystem::path& manifest) {
+        std::ifstream stream(manifest, std::ios::binary);
+        if (!stream) {
+            throw std::runtime_error("cannot open " + to_utf8(manifest));
+        }
+        std::vector<std::filesystem::path> inputs;
+        std::string line;
+        bool first = true;
+        while (std::getline(stream, line)) {
+            if (first && line.starts_with("\xEF\xBB\xBF")) line.erase(0, 3);   // BOM
+            first = false;
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t')) line.pop_back();
+            const std::size_t begin = line.find_first_not_of(" \t");
+            if (begin == std::string::npos || line[begin] == '#') continue;
+
+            std::filesystem::path p(std::u8string(line.begin() + begin, line.end()));
+            if (p.is_relative()) p = manifest.parent_path() / p;
+            inputs.push_back(p.lexically_normal());
+        }
+        return inputs;
+    }
+}
+
+std::vector<std::filesystem::path> collect_batch_inputs(const std::filesystem::path& spec, const std::vector<std::wstring>& extensions)
+{
+    std::vector<std::filesystem::path> inputs;
+    const std::wstring name = spec.filename().wstring();
+
+    if (has_wildcard(name)) {
+        const std::filesystem::path dir = spec.has_parent_path() ? spec.parent_path() : std::filesystem::current_path();
+        for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+            if (entry.is_regular_file() && wildcard_match(name, entry.path().filename().wstring())) {
+                inputs.push_back(entry.path());
+            }
+        }
+        std::sort(inputs.begin(), inputs.end());
+    }
+    else if (std::filesystem::is_directory(spec)) {
+        for (const auto& entry : std::filesystem::directory_iterator(spec)) {
+            if (entry.is_regular_file() && has_extension(entry.path(), extensions)) {
+                inputs.push_back(entry.path());
+            }
+        }
+        std::sort(inputs.begin(), inputs.end());
+    }
+    else if (std::filesystem::is_regular_file(spec)) {
+        if (is_manifest(spec)) {
+            inputs = read_manifest(spec);
+        }
+        else {
+            inputs.push_back(spec);
+        }
+    }
+    else {
+        throw std::runtime_error("not found: " + to_utf8(spec));
+    }
+    return inputs;
+}
+
+BatchScheduler::BatchScheduler(BatchOptions opt) : options{ opt.jobs != 0 ? opt.jobs : std::max<std::size_t>(1, default_executor().concurrency()), opt.memory_limit }
+{
+}
+
+std::vector<std::filesystem::path> BatchScheduler::output_folders(const std::vector<std::filesystem::path>& inputs, const std::filesystem::path& output_root)
+{
+    std::vector<std::filesystem::path> outputs;
+    std::map<std::wstring, int> used;   // 小文字にしたフォルダー名ごとの使用回数
+    for (const auto& input : inputs) {
+        const std::wstring stem = input.stem().wstring();
+        std::wstring folder = stem;
+        for (int n = ++used[to_lower(folder)]; n > 1; n = ++used[to_lower(folder)]) {
+            folder = stem + L"_" + std::to_wstring(n);
+        }
+        outputs.push_back(output_root / folder);
+    }
+    return outputs;
+}
+
+void BatchScheduler::acquire(std::uint64_t cost)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    released.wait(lock, [this, cost]() {
+        return running == 0 || options.memory_limit == 0 || memory_in_use + cost <= options.memory_limit;
+        });
+    memory_in_use += cost;
+    ++running;
+}
+
+void BatchScheduler::release(std::uint64_t cost)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        memory_in_use -= cost;
+        --running;
+    }
+    released.notify_all();
+}
+
+std::vector<TrackSummary> BatchScheduler::run(const std::vector<std::filesystem::path>& inputs, const std::filesystem::path& output_root, Job job, Estimate estimate, Completed completed)
+{
+    const std::vector<std::filesystem::path> outputs = output_folders(inputs, output_root);
+    std::vector<TrackSummary> results(inputs.size());
+
+    std::atomic<std::size_t> next{ 0 };
+    std::size_t done = 0;
+    std::mutex completed_mtx;
+
+    // 入力の順にジョブを取り出し、メモリの空きを待ってから実行する
+    auto worker = [&]() {
+#ifdef MEDIAANALYSIS_WINRT
+        // WAV以外のジョブはMusicAnalysis (AudioGraph) で解析するため、ワーカーごとにMTAを初期化し、終了時に解除する
+        winrt::init_apartment(winrt::apartment_type::multi_threaded);
+        struct ApartmentGuard {
+            ~ApartmentGuard() { winrt::uninit_apartment(); }
+        } apartment;
+#endif
+        for (std::size_t i = next++; i < inputs.size(); i = next++) {
+            const std::uint64_t cost = options.memory_limit != 0 && estimate ? estimate(inputs[i]) : 0;
+            acquire(cost);
+            TrackSummary summary;
+            try {
+                summary = job(inputs[i], outputs[i]);
+            }
+            catch (const std::exception& e) {
+                summary = TrackSummary{};
+                summary.error = e.what();
+            }
+            catch (...) {
+                summary = TrackSummary{};
+                summary.error = "unknown error";
+            }
+            release(cost);
+
+            summary.source = inputs[i];
+            summary.output = outputs[i];
+            results[i] = std::move(summary);
+
+            std::lock_guard<std::mutex> lock(completed_mtx);
+            ++done;
+            if (completed) completed(results[i], done, inputs.size());
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < std::min(options.jobs, inputs.size()); ++t) {
+        threads.emplace_back(worker);
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    return results;
+}
+
+JsonValue BatchScheduler::make_summary(const std::vector<TrackSummary>& results, double elapsed) const
+{
+    JsonValue j = JsonValue::object();
+    const auto succeeded = std::count_if(results.begin(), results.end(), [](const TrackSummary& s) { return s.succeeded(); });
+    j.insert("count", results.size());
+    j.insert("succeeded", succeeded);
+    j.insert("failed", results.size() - succeeded);
+    j.insert("jobs", options.jobs);
+    j.insert("memoryLimit", options.memory_limit);
+    j.insert("elapsed", elapsed);
+
+    double duration = 0;
+    for (const TrackSummary& s : results) duration += s.duration;
+    j.insert("totalDuration", duration);
+
+    JsonValue& tracks = j.insert("tracks", JsonValue::array());
+    for (const TrackSummary& s : results) {
+        tracks.append(s.to_json());
+    }
+    return j;
+}
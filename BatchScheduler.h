@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include "TrackPipeline.h"
+
+/**
+ * @brief バッチ処理の入力を列挙する。
+ * - ディレクトリ: 直下にある、extensionsのいずれかの拡張子のファイル
+ * - ファイル名にワイルドカード (*, ?) を含むパス: 同じディレクトリにある、名前が一致するファイル
+ * - 拡張子が .txt, .lst, .m3u, .m3u8 のファイル: 1行に1つ書かれたパス。空行と#で始まる行は無視し、相対パスはリストのディレクトリから解決する
+ * - それ以外のファイル: そのファイルだけ
+ * ディレクトリとワイルドカードの結果はパスの順に並べる。拡張子は大文字小文字を区別しない。
+ *
+ * @param spec ディレクトリ、ワイルドカード、またはリストのパス
+ * @param extensions 対象にする拡張子 (".wav"のようにドットを含む)
+ * @throw std::runtime_error specが存在しない場合
+ */
+std::vector<std::filesystem::path> collect_batch_inputs(const std::filesystem::path& spec, const std::vector<std::wstring>& extensions);
+
+/**
+ * @brief BatchSchedulerの設定
+ */
+struct BatchOptions
+{
+	std::size_t jobs = 0;				/// 同時に解析するファイル数。0ならdefault_executor()の並列数
+	std::uint64_t memory_limit = 0;		/// 同時に解析するジョブの見積もりメモリの合計の上限 (バイト)。0なら無制限
+};
+
+/**
+ * @class BatchScheduler
+ * @brief 複数のファイルを、同時に実行するジョブの数と見積もりメモリの合計を制限しながら解析する。
+ * ジョブはそれぞれ専用のスレッドで実行し、FFTなどの細かいタスクは全てのジョブで共有するExecutorに投げる。
+ * 見積もりが上限を超えるジョブも、他に実行中のジョブがなければ単独で実行する。
+ * 出力先は出力先ルートの下の、入力ファイル名から拡張子を除いたフォルダー (重複する場合は _2, _3, ... を付ける)。
+ */
+class BatchScheduler
+{
+public:
+	using Job = std::function<TrackSummary(const std::filesystem::path& input, const std::filesystem::path& output)>;	/// 1ファイルの解析
+	using Estimate = std::function<std::uint64_t(const std::filesystem::path& input)>;									/// 1ファイルの解析が使うメモリの見積もり
+	using Completed = std::function<void(const TrackSummary& summary, std::size_t done, std::size_t total)>;				/// ジョブの終了の通知
+
+private:
+	const BatchOptions options;
+
+	std::mutex mtx;
+	std::condition_variable released;
+	std::uint64_t memory_in_use = 0;	/// 実行中のジョブの見積もりの合計。mtxで保護する
+	std::size_t running = 0;			/// 実行中のジョブの数。mtxで保護する
+
+	void acquire(std::uint64_t cost);
+	void release(std::uint64_t cost);
+
+public:
+	/**
+	 * @param options 設定。jobsが0ならdefault_executor()の並列数にする
+	 */
+	explicit BatchScheduler(BatchOptions options);
+
+	/**
+	 * @brief 入力ごとに出力先フォルダーを決める
+	 */
+	static std::vector<std::filesystem::path> output_folders(const std::vector<std::filesystem::path>& inputs, const std::filesystem::path& output_root);
+
+	/**
+	 * @brief 全ての入力を解析し、終わるまで待つ。ジョブの例外はそのファイルの失敗として記録し、残りの解析は続ける。
+	 *
+	 * @param inputs 入力ファイル
+	 * @param output_root 出力先ルート
+	 * @param job 1ファイルの解析。複数のスレッドから同時に呼ばれる
+	 * @param estimate メモリの見積もり。memory_limitが0なら呼ばれない
+	 * @param completed ジョブの終了ごとに1つずつ呼ばれる。省略可
+	 * @return 入力と同じ順の結果
+	 */
+	std::vector<TrackSummary> run(const std::vector<std::filesystem::path>& inputs, const std::filesystem::path& output_root, Job job, Estimate estimate, Completed completed = nullptr);
+
+	/**
+	 * @brief 全体の集計 (Summary.json の内容) を作る
+	 *
+	 * @param results runの結果
+	 * @param elapsed 全体にかかった時間 (秒)
+	 */
+	JsonValue make_summary(const std::vector<TrackSummary>& results, double elapsed) const;
+};
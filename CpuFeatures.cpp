@@ -0,0 +1,112 @@
+﻿#include "pch.h"
+#include "CpuFeatures.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace {
+    struct CpuidResult {
+        uint32_t eax, ebx, ecx, edx;
+    };
+
+    CpuidResult cpuid(uint32_t leaf, uint32_t subleaf) {
+        CpuidResult r{};
+#if defined(_MSC_VER)
+        int regs[4];
+        __cpuidex(regs, static_cast<int>(leaf), static_cast<int>(subleaf));
+        r = { uint32_t(regs[0]), uint32_t(regs[1]), uint32_t(regs[2]), uint32_t(regs[3]) };
+#else
+        __get_cpuid_count(leaf, subleaf, &r.eax, &r.ebx, &r.ecx, &r.edx);
+#endif
+        return r;
+    }
+
+    // OSがレジスタ状態の退避に対応しているかをXCR0で確認する
+    uint64_t xgetbv0() {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32_t eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (uint64_t(edx) << 32) | eax;
+#endif
+    }
+
+    bool bit(uint32_t value, int n) {
+        return (value >> n) & 1;
+    }
+
+    std::string read_override() {
+        std::string value;
+#if defined(_MSC_VER)
+        char* buffer = nullptr;
+        size_t length = 0;
+        if (_dupenv_s(&buffer, &length, "MEDIAANALYSIS_SIMD") == 0 && buffer != nullptr) {
+            value = buffer;
+            free(buffer);
+        }
+#else
+        if (const char* env = std::getenv("MEDIAANALYSIS_SIMD")) {
+            value = env;
+        }
+#endif
+        std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+        return value;
+    }
+}
+
+SimdLevel detect_simd_level()
+{
+    const uint32_t max_leaf = cpuid(0, 0).eax;
+    if (max_leaf < 1) return SimdLevel::Scalar;
+
+    const CpuidResult l1 = cpuid(1, 0);
+    const CpuidResult l7 = max_leaf >= 7 ? cpuid(7, 0) : CpuidResult{};
+
+    const bool sse41 = bit(l1.ecx, 19);
+    if (!sse41) return SimdLevel::Scalar;
+
+    const bool osxsave = bit(l1.ecx, 27);
+    const uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+    const bool os_avx = (xcr0 & 0x6) == 0x6;            // XMM, YMM
+    const bool os_avx512 = (xcr0 & 0xE6) == 0xE6;       // XMM, YMM, opmask, ZMM
+
+    const bool avx2 = os_avx && bit(l1.ecx, 28) && bit(l1.ecx, 12) && bit(l1.ecx, 29) && bit(l7.ebx, 5);  // AVX, FMA, F16C, AVX2
+    if (!avx2) return SimdLevel::SSE4;
+
+    const bool avx512 = os_avx512 && bit(l7.ebx, 16);   // AVX-512F
+    return avx512 ? SimdLevel::AVX512 : SimdLevel::AVX2;
+}
+
+SimdLevel simd_level()
+{
+    static const SimdLevel level = []() {
+        const SimdLevel detected = detect_simd_level();
+        const std::string request = read_override();
+        if (request.empty()) return detected;
+
+        SimdLevel requested = detected;
+        if (request == "scalar") requested = SimdLevel::Scalar;
+        else if (request == "sse4") requested = SimdLevel::SSE4;
+        else if (request == "avx2") requested = SimdLevel::AVX2;
+        else if (request == "avx512") requested = SimdLevel::AVX512;
+        return requested < detected ? requested : detected;
+    }();
+    return level;
+}
+
+const char* to_string(SimdLevel level)
+{
+    switch (level)
+    {
+        using enum SimdLevel;
+    case Scalar: return "scalar";
+    case SSE4:   return "sse4";
+    case AVX2:   return "avx2";
+    case AVX512: return "avx512";
+    }
+    return "unknown";
+}
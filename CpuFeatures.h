@@ -0,0 +1,35 @@
+﻿#pragma once
+
+/* 命令セット拡張を関数単位で有効にする (MSVCは指定不要) */
+#if defined(__GNUC__) || defined(__clang__)
+#define MA_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MA_TARGET(isa)
+#endif
+
+/**
+ * @brief 演算カーネルが使用するSIMD命令セットの段階
+ */
+enum class SimdLevel {
+    Scalar,     /// SIMDを使わない
+    SSE4,       /// SSE4.1
+    AVX2,       /// AVX2 + FMA + F16C
+    AVX512,     /// AVX-512F (+ AVX2 + FMA)
+};
+
+/**
+ * @brief CPUIDとOSの対応状況から、実行中のCPUで使用できる最上位のSIMD段階を求める。
+ */
+SimdLevel detect_simd_level();
+
+/**
+ * @brief カーネル選択に使うSIMD段階を取得する。
+ * 環境変数 MEDIAANALYSIS_SIMD (scalar / sse4 / avx2 / avx512) が設定されていればそれを優先するが、
+ * CPUが対応していない段階は選ばない。結果はプロセス内で一度だけ求める。
+ */
+SimdLevel simd_level();
+
+/**
+ * @brief SIMD段階の名前を取得する
+ */
+const char* to_string(SimdLevel level);
@@ -0,0 +1,47 @@
+﻿#include "pch.h"
+#include "DotKernels.h"
+
+namespace {
+    float dot_scalar(const float* a, const float* b, std::uint32_t n) {
+        float sum = 0;
+        for (std::uint32_t i = 0; i < n; ++i) sum += a[i] * b[i];
+        return sum;
+    }
+
+    MA_TARGET("sse4.1")
+    float dot_sse4(const float* a, const float* b, std::uint32_t n) {
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        for (std::uint32_t i = 0; i < n; i += 8) {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+        const __m128 acc = _mm_add_ps(acc0, acc1);
+        return _mm_cvtss_f32(_mm_dp_ps(acc, _mm_set1_ps(1.0f), 0xF1));
+    }
+
+    MA_TARGET("avx2,fma")
+    float dot_avx2(const float* a, const float* b, std::uint32_t n) {
+        __m256 acc = _mm256_setzero_ps();
+        for (std::uint32_t i = 0; i < n; i += 8) {
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc);
+        }
+        const __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        const __m128 h = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        return _mm_cvtss_f32(_mm_add_ss(h, _mm_shuffle_ps(h, h, 1)));
+    }
+}
+
+DotKernel select_dot_kernel(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::AVX512:
+    case SimdLevel::AVX2:
+        return &dot_avx2;
+    case SimdLevel::SSE4:
+        return &dot_sse4;
+    default:
+        return &dot_scalar;
+    }
+}
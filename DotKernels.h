@@ -0,0 +1,13 @@
+﻿#pragma once
+
+#include "CpuFeatures.h"
+
+/**
+ * @brief 2つのfloat配列の内積を求める関数。nは8の倍数に限る (カーネルは8要素ずつ読む)
+ */
+using DotKernel = float (*)(const float* a, const float* b, std::uint32_t n);
+
+/**
+ * @brief SIMD段階に応じた内積の関数を選ぶ。AVX-512ではAVX2版を使う
+ */
+DotKernel select_dot_kernel(SimdLevel level);
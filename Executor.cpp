@@ -0,0 +1,100 @@
+﻿#include "pch.h"
+#include "Executor.h"
+
+namespace {
+    // 実行中のワーカーが属するプールと、そのキューの番号
+    thread_local const ThreadPool* current_pool = nullptr;
+    thread_local std::size_t current_index = 0;
+}
+
+ThreadPool::ThreadPool(std::size_t thread_count)
+{
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (std::size_t i = 0; i < thread_count; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (std::size_t i = 0; i < thread_count; ++i) {
+        threads.emplace_back([this, i]() { run(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mtx);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
+
+void ThreadPool::submit(Task task)
+{
+    // ワーカーから投げたタスクは自分のキューに積む
+    const std::size_t index = current_pool == this ? current_index : next.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    // 取り出す側が先に減らして桁あふれしないよう、積む前に数える
+    {
+        std::lock_guard<std::mutex> lock(sleep_mtx);
+        pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mtx);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::try_pop(std::size_t index, Task& task)
+{
+    // 自分のキューは後ろから
+    {
+        Queue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mtx);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    // 他のキューは前から盗む
+    for (std::size_t k = 1; k < queues.size(); ++k) {
+        Queue& victim = *queues[(index + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mtx);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(std::size_t index)
+{
+    current_pool = this;
+    current_index = index;
+
+    while (true) {
+        Task task;
+        if (try_pop(index, task)) {
+            pending.fetch_sub(1, std::memory_order_relaxed);
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mtx);
+        if (stopping && pending.load(std::memory_order_relaxed) == 0) break;
+        wake.wait(lock, [this]() { return stopping || pending.load(std::memory_order_relaxed) > 0; });
+        if (stopping && pending.load(std::memory_order_relaxed) == 0) break;
+    }
+}
+
+Executor& default_executor()
+{
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,70 @@
+﻿#pragma once
+
+/**
+ * @class Executor
+ * @brief タスクを実行するスレッドの割り当て方を切り替えるためのインターフェース。
+ * MemoryUtilなどの処理ステージはこれを通してタスクを投げる。
+ */
+class Executor
+{
+public:
+	using Task = std::function<void()>;
+
+	virtual ~Executor() = default;
+
+	/**
+	 * @brief タスクを実行待ちに追加する。どのスレッドでいつ実行されるかは実装による。
+	 */
+	virtual void submit(Task task) = 0;
+
+	/**
+	 * @brief 同時に実行できるタスクの数
+	 */
+	virtual std::size_t concurrency() const = 0;
+};
+
+/**
+ * @class ThreadPool
+ * @brief ワークスティーリング方式のスレッドプール。
+ * スレッドごとに両端キューを持ち、自分のキューは後ろから (直前に積んだタスクから) 取り出し、
+ * 空になったら他のスレッドのキューの前から盗む。プール外からのタスクはスレッドに順番に割り振る。
+ */
+class ThreadPool : public Executor
+{
+	struct Queue {
+		std::mutex mtx;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;		/// スレッドごとのキュー
+	std::vector<std::thread> threads;				/// ワーカースレッド
+	std::atomic<std::size_t> next{ 0 };				/// プール外からのタスクを割り振る先
+	std::atomic<std::size_t> pending{ 0 };			/// まだ取り出されていないタスクの数
+	std::mutex sleep_mtx;							/// 待機用のミューテックス
+	std::condition_variable wake;					/// タスクの追加、終了を知らせる
+	bool stopping = false;							/// 終了要求。sleep_mtxで保護する
+
+	bool try_pop(std::size_t index, Task& task);
+	void run(std::size_t index);
+public:
+	/**
+	 * @param thread_count スレッド数。0ならハードウェアのスレッド数
+	 */
+	explicit ThreadPool(std::size_t thread_count = 0);
+
+	/**
+	 * @brief 実行待ちのタスクを全て実行してからスレッドを終了する。
+	 */
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void submit(Task task) override;
+	std::size_t concurrency() const override { return threads.size(); }
+};
+
+/**
+ * @brief 既定のExecutor。プロセス内で共有するThreadPoolを初回呼び出し時に作成する。
+ */
+Executor& default_executor();
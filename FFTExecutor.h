@@ -1,10 +1,13 @@
 #pragma once
 
+#include "FFTKernels.h"
+#include "FFTTables.h"
+#include "SpectrumQuantizer.h"
+
 /// <summary>
 /// GFFT
 /// size2̏搔Ɍ
-/// size * sizeof(int) + size / 2 * sizeof(complex&lt;T&gt;) + size * sizeof(T)
-/// = 12 * sizẽm
+/// d݂Ƒ֐̕\FFTTableCacheœ傫̂̂ƋL
 /// </summary>
 /**
  * @brief t[Gϊ (FFT) sNXB
@@ -14,176 +17,364 @@
 template<std::floating_point T>
 class FFTExecutor
 {
-	const std::vector<std::complex<T>> weight;
-	const std::vector<std::uint_fast32_t> rindexes;
-	const std::vector<T> han_windows;				/// nvector
-
-	// d݂̏
-	static std::vector<std::complex<T>> init_weight(std::uint_fast32_t n) {
-		std::vector<std::complex<T>> w(n >> 1);
-		for (std::uint_fast32_t i = 0; i < w.size(); ++i)
-		{
-			w[i] = std::polar(T(1.0), i * std::numbers::pi_v<T> *-2 / n);
-		}
-		return w;
-	}
+	const std::shared_ptr<const std::complex<T>[]> weight;	/// iƂ̏d݁Bn_̒ȉd݂weight[n / 2 - 1 + p]BFFTTableCacheŋL
+	const std::shared_ptr<const T[]> windows;				/// ֐BFFTTableCacheŋL
+	const FFTKernel<T> kernel;						/// Stockham FFT̃J[l
+	const BatchFFTKernel<T> batch_kernel;			/// t[FFT̃J[l
+	static constexpr std::uint_fast32_t EncodeBlock = 64;	/// FFT_encodedŐU܂Ƃ߂ĕϊ
 
-	// rbg]̏
-	static std::vector<std::uint_fast32_t> init_rindexes(std::uint_fast32_t n) {
-		std::vector<std::uint_fast32_t> ri(n);
-		for (std::uint_fast32_t j = 0; auto & x : ri)
-		{
-			x = j;
-			std::uint_fast32_t k = n;
-			while (k > (j ^= (k >>= 1)));
+	// SIMDiKɉJ[lIԁBfloatȊO̓XJ[ł̂
+	static FFTKernel<T> select_kernel(SimdLevel level) {
+		if constexpr (std::is_same_v<T, float>) {
+			return select_fft_kernel(level);
+		}
+		else {
+			return &stockham_scalar<T>;
 		}
-		return ri;
 	}
 
-	// n̏A㔼Oőp
-	static std::vector<T> init_windows(std::uint_fast32_t n) {
-		std::vector<T> hw((n >> 1) + 1);
-		for (std::uint_fast32_t i = 0; i < hw.size(); ++i) {
-			hw[i] = 0.5f - 0.5f * std::cos(2.0f * std::numbers::pi_v<T> *i / n);
+	static BatchFFTKernel<T> select_batch_kernel(SimdLevel level) {
+		if constexpr (std::is_same_v<T, float>) {
+			return select_batch_fft_kernel(level);
+		}
+		else {
+			return { 4, &stockham_batch_scalar<T, 4> };
 		}
-		return hw;
 	}
+
 public:
+	/**
+	 * @brief FFT̍Ɨ̈B
+	 * FFTExecutorԂXbhԂŋLAĂяo܂̓XbhƂɕێĎg񂷁B
+	 */
+	class Workspace
+	{
+		std::unique_ptr<std::complex<T>[]> buffer;
+		std::uint_fast32_t length = 0;
+	public:
+		Workspace() = default;
+		/**
+		 * @param size Ɨ̗̈vfBgpFFTExecutor2Nȏɂ
+		 */
+		Workspace(std::uint_fast32_t size) : buffer{ std::make_unique_for_overwrite<std::complex<T>[]>(size) }, length(size) {}
+
+		std::complex<T>* data() { return buffer.get(); }
+		std::uint_fast32_t size() const { return length; }
+	};
+
 	const std::uint_fast32_t N;
+	const SimdLevel simd;	/// gpJ[lSIMDiK
+	const WindowType window;	/// ͂ɂ鑋֐
 	/**
 	 * @param size FFT̃TCYB2̏搔Ɍ
+	 * @param window ͂ɂ鑋֐Bȗ̓n
+	 * @param level J[lSIMDiKBȗCPUIDƊϐ MEDIAANALYSIS_SIMD 猈߂
 	 */
-	FFTExecutor(std::uint_fast32_t size) : N(size), weight{ init_weight(size) }, rindexes{ init_rindexes(size) }, han_windows{ init_windows(size) } {}
+	FFTExecutor(std::uint_fast32_t size, WindowType window = WindowType::Hann, SimdLevel level = simd_level()) : weight{ FFTTableCache<T>::weight(size) }, windows{ FFTTableCache<T>::window(size, window) }, kernel{ select_kernel(level) }, batch_kernel{ select_batch_kernel(level) }, N(size), simd(level), window(window) {}
+
+	/**
+	 * @brief FFTExecutorŎgpłƗ̈쐬B
+	 */
+	Workspace make_workspace() const { return Workspace(N << 1); }
+
+	/**
+	 * @brief FFT_batchŎgpłƗ̈쐬B
+	 */
+	Workspace make_batch_workspace() const { return Workspace(N * batch_lanes()); }
+
+	/**
+	 * @brief FFT_batch1̃J[lĂяoł܂Ƃ߂ĕϊt[ (SIMD̃[)
+	 */
+	std::uint_fast32_t batch_lanes() const { return batch_kernel.lanes; }
 
 	/**
 	 * @brief w肳ꂽf[^ɑ΂FFTsB
+	 * ͂ł邱Ƃ𗘗pAN/2_̕fFFŤʂ𕪗ĐU߂B
+	 * ԂύXȂ߁AƗ̈悪ʂłΕXbh瓯ɌĂяoB
 	 *
 	 * @param pcm ͂f[^ւ̃|C^B
-	 * @param result FFŤʂ̏o͐ւ̃|C^B
+	 * @param result FFŤʂ̏o͐ւ̃|C^BN/2̐UށB
+	 * @param ws Ɨ̈BNȏ̗vfKvB
 	 */
-	void FFT(T* pcm, T* result)
+	void FFT(const T* pcm, T* result, Workspace& ws) const
 	{
-		using namespace std;
+		const std::complex<T>* ans = transform_real(pcm, ws);
 
-		unique_ptr<complex<T>[]> ans = make_unique_for_overwrite<complex<T>[]>(N);
-		for (std::uint_fast32_t i = 0; i < N; ++i) {
-			auto ri = rindexes[i];
-			auto hw = han_windows[ri <= N >> 1 ? ri : N - ri];
-			ans[i] = complex<T>(pcm[ri] * hw, 0);
+		for (std::uint_fast32_t i = 0; i < (N >> 1); ++i) {
+			result[i] = std::sqrt(std::norm(split_real(ans, i)));
 		}
+	}
 
-		std::uint_fast32_t harf = N >> 1;
-		for (std::uint_fast32_t stage = 1; stage < N; stage <<= 1) {
-			std::uint_fast32_t temp = (stage - 1);
-			for (std::uint_fast32_t x = 0; x < harf; ++x)
-			{
-				std::uint_fast32_t i = (~temp & x) << 1;
-				std::uint_fast32_t j = x & temp;
-
-				complex<T> w = weight[j * rindexes[stage]];
-				complex<T> t_ans = w * ans[j + i + stage];
-				ans[j + i + stage] = ans[j + i] - t_ans;
-				ans[j + i] += t_ans;
-			}
-		}
+	/**
+	 * @brief ͂ɑ΂FFTsAfXyNg߂B
+	 *
+	 * @param pcm ͂f[^ւ̃|C^B
+	 * @param spectrum o͐ւ̃|C^B0N/2܂łN/2+1̃rށB
+	 * @param ws Ɨ̈BNȏ̗vfKvB
+	 */
+	void RFFT(const T* pcm, std::complex<T>* spectrum, Workspace& ws) const
+	{
+		const std::complex<T>* ans = transform_real(pcm, ws);
 
 		for (std::uint_fast32_t i = 0; i < (N >> 1); ++i) {
-			result[i] = abs(ans[i]);
+			spectrum[i] = split_real(ans, i);
 		}
+		spectrum[N >> 1] = std::complex<T>(ans[0].real() - ans[0].imag(), 0);
 	}
-};
 
+	/**
+	 * @brief 2̎͂Ƌɋl߂1̕fFFTŕϊAΏ̐ŕB
+	 * XeIL,R̂悤ɓ2n𓯎ɕϊB
+	 *
+	 * @param left 1ڂ̓͂ւ̃|C^B
+	 * @param right 2ڂ̓͂ւ̃|C^B
+	 * @param stride ̗͂vfԊuBC^[[uꂽL,RȂ2B
+	 * @param l_result lefťʂ̏o͐ւ̃|C^BN/2̐UށB
+	 * @param r_result righťʂ̏o͐ւ̃|C^BN/2̐UށB
+	 * @param ws Ɨ̈B2Nȏ̗vfKvB
+	 */
+	void FFT(const T* left, const T* right, std::size_t stride, T* l_result, T* r_result, Workspace& ws) const
+	{
+		std::complex<T>* in = ws.data();
+		for (std::uint_fast32_t i = 0; i < N; ++i) {
+			in[i] = std::complex<T>(left[i * stride] * windows[i], right[i * stride] * windows[i]);
+		}
+		const std::complex<T>* ans = kernel(in, in + N, N, weight.get());
 
+		// X[k] = (Z[k] + conj(Z[N-k])) / 2, Y[k] = (Z[k] - conj(Z[N-k])) / 2i
+		for (std::uint_fast32_t i = 0; i < (N >> 1); ++i) {
+			const std::complex<T> a = ans[i];
+			const std::complex<T> b = std::conj(ans[i == 0 ? 0 : N - i]);
+			l_result[i] = std::sqrt(std::norm(a + b)) * T(0.5);
+			r_result[i] = std::sqrt(std::norm(a - b)) * T(0.5);
+		}
+	}
 
-template <>
-inline void FFTExecutor<float>::FFT(float* pcm, float* result) {
-	using namespace std;
+	/**
+	 * @brief C^[[uꂽXeIPCML,R1̕fFFTŕϊB
+	 *
+	 * @param pcm L,R݂2N񂾓͂ւ̃|C^B
+	 * @param l_result Ľʂ̏o͐ւ̃|C^B
+	 * @param r_result Řʂ̏o͐ւ̃|C^B
+	 * @param ws Ɨ̈B2Nȏ̗vfKvB
+	 */
+	void FFT_stereo(const T* pcm, T* l_result, T* r_result, Workspace& ws) const
+	{
+		FFT(pcm, pcm + 1, 2, l_result, r_result, ws);
+	}
 
-	unique_ptr<complex<float>[]> ans = make_unique_for_overwrite<complex<float>[]>(N);
-	for (std::uint_fast32_t i = 0; i < N; ++i) {
-		auto ri = rindexes[i];
-		auto hw = han_windows[ri <= N >> 1 ? ri : N - ri];
-		ans[i] = complex<float>(pcm[ri] * hw, 0);
+	/**
+	 * @brief ĂяoXbh̍Ɨ̈găXeIPCMFFTsB
+	 */
+	void FFT_stereo(const T* pcm, T* l_result, T* r_result) const
+	{
+		FFT_stereo(pcm, l_result, r_result, thread_workspace());
 	}
 
-#if true 
-	const std::uint_fast32_t eighth = N >> 3;
-	alignas(32) std::complex<float> temp_w[4];
-	alignas(32) std::complex<float> temp_s[4];
-	std::uint_fast32_t temp_ij[4];
-	for (std::uint_fast32_t stage = 1; stage < N; stage <<= 1) {
-		const std::uint_fast32_t temp = (stage - 1);
-		for (std::uint_fast32_t x = 0; x < eighth; ++x)
-		{
+	/**
+	 * @brief FFTƓϊsAUquantizeř`ɕϊďށB
+	 * UEncodeBlockX^bN̗̈ŋ߂Ăɕϊ邽߁Afloat ̃t[oēǂݒvȂB
+	 * T = float ̂݁B
+	 *
+	 * @param pcm ͂f[^ւ̃|C^B
+	 * @param out o͐ւ̃|C^BN/2 * quantizer.bytes_per_value() oCgށB
+	 * @param quantizer U̕ϊ
+	 * @param ws Ɨ̈BNȏ̗vfKvB
+	 */
+	void FFT_encoded(const T* pcm, std::byte* out, const SpectrumQuantizer& quantizer, Workspace& ws) const requires std::same_as<T, float>
+	{
+		const std::complex<T>* ans = transform_real(pcm, ws);
+		const std::uint_fast32_t half = N >> 1;
+		const std::size_t value_bytes = quantizer.bytes_per_value();
+		alignas(32) T magnitude[EncodeBlock];
 
-			auto y = x << 2;
-			//#pragma unroll 4
-			for (std::uint_fast32_t n = 0; n < 4; ++n)
-			{
-				const std::uint_fast32_t i = _andn_u32(temp, y) << 1; // (~temp & y) << 1;
-				const std::uint_fast32_t j = y & temp;
+		for (std::uint_fast32_t k = 0; k < half; k += EncodeBlock) {
+			const std::uint_fast32_t n = std::min<std::uint_fast32_t>(EncodeBlock, half - k);
+			for (std::uint_fast32_t j = 0; j < n; ++j) {
+				magnitude[j] = std::sqrt(std::norm(split_real(ans, k + j)));
+			}
+			quantizer.quantize(magnitude, n, out + k * value_bytes);
+		}
+	}
 
-				temp_w[n] = weight[j * rindexes[stage]];
-				temp_s[n] = ans[i + j + stage];
-				temp_ij[n] = i + j;
-				++y;
+	/**
+	 * @brief 2nFFT (FFT(left, right, stride, ...)) sAUquantizeř`ɕϊďށBT = float ̂݁B
+	 *
+	 * @param l_out lefťʂ̏o͐ւ̃|C^BN/2 * quantizer.bytes_per_value() oCgށB
+	 * @param r_out righťʂ̏o͐ւ̃|C^B
+	 * @param ws Ɨ̈B2Nȏ̗vfKvB
+	 */
+	void FFT_encoded(const T* left, const T* right, std::size_t stride, std::byte* l_out, std::byte* r_out, const SpectrumQuantizer& quantizer, Workspace& ws) const requires std::same_as<T, float>
+	{
+		std::complex<T>* in = ws.data();
+		for (std::uint_fast32_t i = 0; i < N; ++i) {
+			in[i] = std::complex<T>(left[i * stride] * windows[i], right[i * stride] * windows[i]);
+		}
+		const std::complex<T>* ans = kernel(in, in + N, N, weight.get());
+		const std::uint_fast32_t half = N >> 1;
+		const std::size_t value_bytes = quantizer.bytes_per_value();
+		alignas(32) T l_magnitude[EncodeBlock];
+		alignas(32) T r_magnitude[EncodeBlock];
+
+		for (std::uint_fast32_t k = 0; k < half; k += EncodeBlock) {
+			const std::uint_fast32_t n = std::min<std::uint_fast32_t>(EncodeBlock, half - k);
+			for (std::uint_fast32_t j = 0; j < n; ++j) {
+				const std::uint_fast32_t i = k + j;
+				const std::complex<T> a = ans[i];
+				const std::complex<T> b = std::conj(ans[i == 0 ? 0 : N - i]);
+				l_magnitude[j] = std::sqrt(std::norm(a + b)) * T(0.5);
+				r_magnitude[j] = std::sqrt(std::norm(a - b)) * T(0.5);
 			}
+			quantizer.quantize(l_magnitude, n, l_out + k * value_bytes);
+			quantizer.quantize(r_magnitude, n, r_out + k * value_bytes);
+		}
+	}
 
-			__m256 temp256 = _mm256_load_ps(reinterpret_cast<float*>(temp_w));
+	/**
+	 * @brief ĂяoXbh̍Ɨ̈gFFT_encodedsB
+	 */
+	void FFT_encoded(const T* pcm, std::byte* out, const SpectrumQuantizer& quantizer) const requires std::same_as<T, float>
+	{
+		FFT_encoded(pcm, out, quantizer, thread_workspace());
+	}
 
-			__m256 f1 = _mm256_moveldup_ps(temp256);
-			__m256 f2 = _mm256_loadu_ps(reinterpret_cast<float*>(temp_s));
-			__m256 f3 = _mm256_movehdup_ps(temp256);
-			__m256 f4 = _mm256_permute_ps(f2, _MM_SHUFFLE(2, 3, 0, 1));
-			__m256 res256 = _mm256_fmaddsub_ps(f1, f2, _mm256_mul_ps(f3, f4));
+	/**
+	 * @brief ĂяoXbh̍Ɨ̈găC^[[uꂽXeIPCMFFT_encodedsB
+	 */
+	void FFT_encoded_stereo(const T* pcm, std::byte* l_out, std::byte* r_out, const SpectrumQuantizer& quantizer) const requires std::same_as<T, float>
+	{
+		FFT_encoded(pcm, pcm + 1, 2, l_out, r_out, quantizer, thread_workspace());
+	}
+
+	/**
+	 * @brief Acount̃t[܂Ƃ߂FFTB
+	 * batch_lanes()t[SIMD̃[Ɋ蓖Ăĕϊ邽߁A
+	 * d݂̓ǂݍ݂⃋[v̌Œt[ԂŋLBʂFFT1t[Ă񂾏ꍇƓB
+	 *
+	 * @param frames Ncount̃t[ւ̃|C^B
+	 * @param count t[B
+	 * @param out o͐ւ̃|C^Bt[ƂN/2̐UށB
+	 * @param ws Ɨ̈Bmake_batch_workspace()ō쐬́B
+	 */
+	void FFT_batch(const T* frames, std::size_t count, T* out, Workspace& ws) const
+	{
+		const std::uint_fast32_t half = N >> 1;
+		const std::uint_fast32_t lanes = batch_kernel.lanes;
+		const std::size_t block = std::size_t(lanes) * 2;
+		T* x = reinterpret_cast<T*>(ws.data());
+		T* y = x + half * block;
+		const std::complex<T>* w = weight.get() + half - 1;
+
+		for (std::size_t g = 0; g < count; g += lanes) {
+			const std::size_t used = std::min<std::size_t>(lanes, count - g);
 
-			_mm256_store_ps(reinterpret_cast<float*>(temp_s), res256);
+			// ȂAf1ƂɊet[̎Aׂ
+			for (std::uint_fast32_t k = 0; k < half; ++k) {
+				T* dst = x + k * block;
+				const T w0 = windows[k << 1];
+				const T w1 = windows[(k << 1) + 1];
+				for (std::uint_fast32_t f = 0; f < lanes; ++f) {
+					const T* src = frames + (g + f) * N;
+					dst[f] = f < used ? src[k << 1] * w0 : T(0);
+					dst[lanes + f] = f < used ? src[(k << 1) + 1] * w1 : T(0);
+				}
+			}
+
+			const T* z = batch_kernel.run(x, y, half, weight.get());
 
-			//#pragma unroll 4
-			for (std::uint_fast32_t n = 0; n < 4; ++n) {
-				ans[temp_ij[n] + stage] = ans[temp_ij[n]] - temp_s[n];
-				ans[temp_ij[n]] += temp_s[n];
+			// split_realƓ[Ƃɍs
+			for (std::uint_fast32_t k = 0; k < half; ++k) {
+				const T* a = z + k * block;
+				const T* b = z + (k == 0 ? 0 : half - k) * block;
+				const T wr = w[k].real();
+				const T wi = w[k].imag();
+				for (std::size_t f = 0; f < used; ++f) {
+					const T er = (a[f] + b[f]) * T(0.5);
+					const T ei = (a[lanes + f] - b[lanes + f]) * T(0.5);
+					const T or_ = (a[lanes + f] + b[lanes + f]) * T(0.5);
+					const T oi = (b[f] - a[f]) * T(0.5);
+					const T xr = er + wr * or_ - wi * oi;
+					const T xi = ei + wr * oi + wi * or_;
+					out[(g + f) * half + k] = std::sqrt(xr * xr + xi * xi);
+				}
 			}
 		}
 	}
-#else 
-	const std::uint_fast32_t quarter = N >> 2;
-	for (std::uint_fast32_t stage = 1; stage < N; stage <<= 1) {
-		const std::uint_fast32_t temp = (stage - 1);
-		for (std::uint_fast32_t x = 0; x < quarter; ++x)
-		{
-			std::uint_fast32_t y = x << 1;
-			const std::uint_fast32_t i1 = _andn_u32(temp, y) << 1; // (~temp & y) << 1;
-			const std::uint_fast32_t j1 = y & temp;
-			++y;
-			const std::uint_fast32_t i2 = _andn_u32(temp, y) << 1;
-			const std::uint_fast32_t j2 = y & temp;
-
-			complex<float> w1 = weight[j1 * rindexes[stage]];
-			complex<float> w2 = weight[j2 * rindexes[stage]];
-			alignas(32) std::complex<float> temp[2] = { w1, w2 }; // zɒ { weight[], weight[] }Ƃ悤Ƃ瑬x2{ɂȂBv(g++-13 -std=c++20 -mavx2 -mfma -mbmi -mbmi2 -O2)
-			complex<float> s1 = ans[j1 + i1 + stage];
-			complex<float> s2 = ans[j2 + i2 + stage];
-
-			__m128 temp128 = _mm_load_ps(reinterpret_cast<float*>(temp));
-
-			alignas(32) complex<float> tc[2] = { s1, s2 };
-			__m128 f1 = _mm_moveldup_ps(temp128);
-			__m128 f2 = _mm_load_ps(reinterpret_cast<float*>(tc));
-			__m128 f3 = _mm_movehdup_ps(temp128);
-			__m128 f4 = _mm_permute_ps(f2, _MM_SHUFFLE(2, 3, 0, 1));
-			__m128 result = _mm_fmaddsub_ps(f1, f2, _mm_mul_ps(f3, f4));
-
-			_mm_store_ps(reinterpret_cast<float*>(tc), result);
-
-			ans[j1 + i1 + stage] = ans[j1 + i1] - tc[0];
-			ans[j1 + i1] += tc[0];
-			ans[j2 + i2 + stage] = ans[j2 + i2] - tc[1];
-			ans[j2 + i2] += tc[1];
+
+	/**
+	 * @brief ĂяoXbh̍Ɨ̈gĕt[܂Ƃ߂FFTB
+	 */
+	void FFT_batch(const T* frames, std::size_t count, T* out) const
+	{
+		FFT_batch(frames, count, out, thread_batch_workspace());
+	}
+
+	/**
+	 * @brief N_̕fFFTsBݍ݂ȂǁA͈ȊO̗prŎgB
+	 *
+	 * @param data N̓͂ւ̃|C^Bʂŏ㏑B
+	 * @param ws Ɨ̈B2Nȏ̗vfKvB
+	 */
+	void FFT_complex(std::complex<T>* data, Workspace& ws) const
+	{
+		std::complex<T>* in = ws.data();
+		std::copy(data, data + N, in);
+		const std::complex<T>* ans = kernel(in, in + N, N, weight.get());
+		std::copy(ans, ans + N, data);
+	}
+
+	/**
+	 * @brief ĂяoXbh̍Ɨ̈gFFTsB
+	 * Ɨ̈̓XbhƂɈxmۂ邽߁AԂł̓mۂȂB
+	 *
+	 * @param pcm ͂f[^ւ̃|C^B
+	 * @param result FFŤʂ̏o͐ւ̃|C^B
+	 */
+	void FFT(const T* pcm, T* result) const
+	{
+		FFT(pcm, result, thread_workspace());
+	}
+
+private:
+	// XbhƂ̍Ɨ̈BTFFTExecutorŋLAőNɍ킹Ċg
+	Workspace& thread_workspace() const
+	{
+		thread_local Workspace ws;
+		if (ws.size() < (N << 1)) {
+			ws = Workspace(N << 1);
+		}
+		return ws;
+	}
+
+	// FFT_batchp̃XbhƂ̍Ɨ̈
+	Workspace& thread_batch_workspace() const
+	{
+		thread_local Workspace ws;
+		if (ws.size() < N * batch_lanes()) {
+			ws = Workspace(N * batch_lanes());
+		}
+		return ws;
+	}
+
+	// ͂̋ԖڂAԖڂƂN/2_FFTs
+	const std::complex<T>* transform_real(const T* pcm, Workspace& ws) const
+	{
+		const std::uint_fast32_t half = N >> 1;
+		std::complex<T>* in = ws.data();
+		T* packed = reinterpret_cast<T*>(in);
+		for (std::uint_fast32_t i = 0; i < N; ++i) {
+			packed[i] = pcm[i] * windows[i];
 		}
+		return kernel(in, in + half, half, weight.get());
 	}
-#endif
-	for (std::uint_fast32_t i = 0; i < (N >> 1); ++i) {
-		result[i] = abs(ans[i]);
+
+	// N/2_FFŤʂAN_FFTkԖڂ̃r߂
+	std::complex<T> split_real(const std::complex<T>* z, std::uint_fast32_t k) const
+	{
+		const std::complex<T> a = z[k];
+		const std::complex<T> b = std::conj(z[k == 0 ? 0 : (N >> 1) - k]);
+		const std::complex<T> even = (a + b) * T(0.5);
+		const std::complex<T> odd((a.imag() - b.imag()) * T(0.5), (b.real() - a.real()) * T(0.5));	// (a - b) / 2i
+		return even + complex_mul(weight[(N >> 1) - 1 + k], odd);
 	}
-}
+};
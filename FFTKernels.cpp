@@ -0,0 +1,318 @@
+﻿#include "pch.h"
+#include "FFTKernels.h"
+
+/*
+ * Stockham FFTの各段は、入力の前半 x[k] と後半 x[k + length / 2] (k = q + s * p) から
+ *   y[q + 2sp]     = a + b
+ *   y[q + 2sp + s] = (a - b) * W_n^p
+ * を求める。a, b, W_n^p はいずれも連続して読めるため、SIMDレジスタへ直接ロードできる。
+ * 出力はsがベクタの複素数個以上なら連続して書け、それ未満の段ではレジスタ内で並べ替えてから書く。
+ */
+
+namespace {
+	// (re, im) が交互に並んだベクタ同士の複素数の積
+	MA_TARGET("sse4.1")
+	inline __m128 cmul_sse4(__m128 a, __m128 w) {
+		__m128 wr = _mm_moveldup_ps(w);
+		__m128 wi = _mm_movehdup_ps(w);
+		__m128 as = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+		return _mm_addsub_ps(_mm_mul_ps(wr, a), _mm_mul_ps(wi, as));
+	}
+
+	MA_TARGET("avx2,fma")
+	inline __m256 cmul_avx2(__m256 a, __m256 w) {
+		__m256 wr = _mm256_moveldup_ps(w);
+		__m256 wi = _mm256_movehdup_ps(w);
+		__m256 as = _mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1));
+		return _mm256_fmaddsub_ps(wr, a, _mm256_mul_ps(wi, as));
+	}
+
+	MA_TARGET("avx512f,avx2,fma")
+	inline __m512 cmul_avx512(__m512 a, __m512 w) {
+		// 全要素を選ぶマスク付きの形を使う (GCCでは非マスク版の未定義値の引数が-Wmaybe-uninitializedになる)
+		constexpr __mmask16 all = 0xFFFF;
+		__m512 wr = _mm512_maskz_moveldup_ps(all, w);
+		__m512 wi = _mm512_maskz_movehdup_ps(all, w);
+		__m512 as = _mm512_maskz_permute_ps(all, a, _MM_SHUFFLE(2, 3, 0, 1));
+		return _mm512_fmaddsub_ps(wr, a, _mm512_mul_ps(wi, as));
+	}
+
+	inline float* fp(std::complex<float>* p) { return reinterpret_cast<float*>(p); }
+	inline const float* fp(const std::complex<float>* p) { return reinterpret_cast<const float*>(p); }
+	inline const double* dp(const std::complex<float>* p) { return reinterpret_cast<const double*>(p); }
+}
+
+MA_TARGET("sse4.1")
+std::complex<float>* stockham_sse4(std::complex<float>* x, std::complex<float>* y, std::uint_fast32_t length, const std::complex<float>* weight)
+{
+	if (length < 4) {
+		return stockham_scalar(x, y, length, weight);
+	}
+
+	const std::uint_fast32_t half = length >> 1;
+	for (std::uint_fast32_t n = length, s = 1; n > 1; n >>= 1, s <<= 1) {
+		const std::uint_fast32_t m = n >> 1;
+		const std::complex<float>* w = weight + (m - 1);
+		if (s == 1) {
+			// 隣り合うpの2組を処理し、和と差を交互に並べる
+			for (std::uint_fast32_t p = 0; p < m; p += 2) {
+				__m128 a = _mm_loadu_ps(fp(x + p));
+				__m128 b = _mm_loadu_ps(fp(x + p + half));
+				__m128 sum = _mm_add_ps(a, b);
+				__m128 dif = cmul_sse4(_mm_sub_ps(a, b), _mm_loadu_ps(fp(w + p)));
+				_mm_storeu_ps(fp(y + (p << 1)), _mm_movelh_ps(sum, dif));
+				_mm_storeu_ps(fp(y + (p << 1) + 2), _mm_movehl_ps(dif, sum));
+			}
+		}
+		else {
+			for (std::uint_fast32_t p = 0; p < m; ++p) {
+				__m128 wp = _mm_castpd_ps(_mm_loaddup_pd(dp(w + p)));
+				const std::complex<float>* xa = x + s * p;
+				std::complex<float>* ys = y + s * (p << 1);
+				for (std::uint_fast32_t q = 0; q < s; q += 2) {
+					__m128 a = _mm_loadu_ps(fp(xa + q));
+					__m128 b = _mm_loadu_ps(fp(xa + q + half));
+					_mm_storeu_ps(fp(ys + q), _mm_add_ps(a, b));
+					_mm_storeu_ps(fp(ys + q + s), cmul_sse4(_mm_sub_ps(a, b), wp));
+				}
+			}
+		}
+		std::swap(x, y);
+	}
+	return x;
+}
+
+MA_TARGET("avx2,fma")
+std::complex<float>* stockham_avx2(std::complex<float>* x, std::complex<float>* y, std::uint_fast32_t length, const std::complex<float>* weight)
+{
+	if (length < 8) {
+		return stockham_scalar(x, y, length, weight);
+	}
+
+	const std::uint_fast32_t half = length >> 1;
+	for (std::uint_fast32_t n = length, s = 1; n > 1; n >>= 1, s <<= 1) {
+		const std::uint_fast32_t m = n >> 1;
+		const std::complex<float>* w = weight + (m - 1);
+		if (s == 1) {
+			// p..p+3 の和と差を [s0 d0 s1 d1], [s2 d2 s3 d3] に並べる
+			for (std::uint_fast32_t p = 0; p < m; p += 4) {
+				__m256 a = _mm256_loadu_ps(fp(x + p));
+				__m256 b = _mm256_loadu_ps(fp(x + p + half));
+				__m256d sum = _mm256_castps_pd(_mm256_add_ps(a, b));
+				__m256d dif = _mm256_castps_pd(cmul_avx2(_mm256_sub_ps(a, b), _mm256_loadu_ps(fp(w + p))));
+				__m256d lo = _mm256_unpacklo_pd(sum, dif);
+				__m256d hi = _mm256_unpackhi_pd(sum, dif);
+				_mm256_storeu_ps(fp(y + (p << 1)), _mm256_castpd_ps(_mm256_permute2f128_pd(lo, hi, 0x20)));
+				_mm256_storeu_ps(fp(y + (p << 1) + 4), _mm256_castpd_ps(_mm256_permute2f128_pd(lo, hi, 0x31)));
+			}
+		}
+		else if (s == 2) {
+			// p, p+1 の2組 (q = 0, 1) を処理し、重みは [Wp Wp Wp+1 Wp+1] に広げる
+			for (std::uint_fast32_t p = 0; p < m; p += 2) {
+				__m256 a = _mm256_loadu_ps(fp(x + (p << 1)));
+				__m256 b = _mm256_loadu_ps(fp(x + (p << 1) + half));
+				__m256d w2 = _mm256_castpd128_pd256(_mm_loadu_pd(dp(w + p)));
+				__m256 wp = _mm256_castpd_ps(_mm256_permute4x64_pd(w2, _MM_SHUFFLE(1, 1, 0, 0)));
+				__m256 sum = _mm256_add_ps(a, b);
+				__m256 dif = cmul_avx2(_mm256_sub_ps(a, b), wp);
+				_mm256_storeu_ps(fp(y + (p << 2)), _mm256_permute2f128_ps(sum, dif, 0x20));
+				_mm256_storeu_ps(fp(y + (p << 2) + 4), _mm256_permute2f128_ps(sum, dif, 0x31));
+			}
+		}
+		else {
+			for (std::uint_fast32_t p = 0; p < m; ++p) {
+				__m256 wp = _mm256_castpd_ps(_mm256_broadcast_sd(dp(w + p)));
+				const std::complex<float>* xa = x + s * p;
+				std::complex<float>* ys = y + s * (p << 1);
+				for (std::uint_fast32_t q = 0; q < s; q += 4) {
+					__m256 a = _mm256_loadu_ps(fp(xa + q));
+					__m256 b = _mm256_loadu_ps(fp(xa + q + half));
+					_mm256_storeu_ps(fp(ys + q), _mm256_add_ps(a, b));
+					_mm256_storeu_ps(fp(ys + q + s), cmul_avx2(_mm256_sub_ps(a, b), wp));
+				}
+			}
+		}
+		std::swap(x, y);
+	}
+	return x;
+}
+
+MA_TARGET("avx512f,avx2,fma")
+std::complex<float>* stockham_avx512(std::complex<float>* x, std::complex<float>* y, std::uint_fast32_t length, const std::complex<float>* weight)
+{
+	if (length < 16) {
+		return stockham_avx2(x, y, length, weight);
+	}
+
+	const std::uint_fast32_t half = length >> 1;
+	for (std::uint_fast32_t n = length, s = 1; n > 1; n >>= 1, s <<= 1) {
+		const std::uint_fast32_t m = n >> 1;
+		const std::complex<float>* w = weight + (m - 1);
+		if (s < 8) {
+			// 8個の複素数をs個ずつ和と差に振り分ける並べ替え (64bit単位)
+			__m512i lo_index, hi_index, w_index;
+			if (s == 1) {
+				lo_index = _mm512_set_epi64(11, 3, 10, 2, 9, 1, 8, 0);
+				hi_index = _mm512_set_epi64(15, 7, 14, 6, 13, 5, 12, 4);
+				w_index = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+			}
+			else if (s == 2) {
+				lo_index = _mm512_set_epi64(11, 10, 3, 2, 9, 8, 1, 0);
+				hi_index = _mm512_set_epi64(15, 14, 7, 6, 13, 12, 5, 4);
+				w_index = _mm512_set_epi64(3, 3, 2, 2, 1, 1, 0, 0);
+			}
+			else {
+				lo_index = _mm512_set_epi64(11, 10, 9, 8, 3, 2, 1, 0);
+				hi_index = _mm512_set_epi64(15, 14, 13, 12, 7, 6, 5, 4);
+				w_index = _mm512_set_epi64(1, 1, 1, 1, 0, 0, 0, 0);
+			}
+			const std::uint_fast32_t step = 8 / s;
+			for (std::uint_fast32_t p = 0; p < m; p += step) {
+				__m512 a = _mm512_loadu_ps(fp(x + s * p));
+				__m512 b = _mm512_loadu_ps(fp(x + s * p + half));
+				__m512d wv = _mm512_maskz_loadu_pd(__mmask8((1u << step) - 1), dp(w + p));
+				__m512 wp = _mm512_castpd_ps(_mm512_maskz_permutexvar_pd(0xFF, w_index, wv));
+				__m512d sum = _mm512_castps_pd(_mm512_add_ps(a, b));
+				__m512d dif = _mm512_castps_pd(cmul_avx512(_mm512_sub_ps(a, b), wp));
+				_mm512_storeu_ps(fp(y + s * (p << 1)), _mm512_castpd_ps(_mm512_permutex2var_pd(sum, lo_index, dif)));
+				_mm512_storeu_ps(fp(y + s * (p << 1) + 8), _mm512_castpd_ps(_mm512_permutex2var_pd(sum, hi_index, dif)));
+			}
+		}
+		else {
+			for (std::uint_fast32_t p = 0; p < m; ++p) {
+				__m512 wp = _mm512_castpd_ps(_mm512_set1_pd(*dp(w + p)));
+				const std::complex<float>* xa = x + s * p;
+				std::complex<float>* ys = y + s * (p << 1);
+				for (std::uint_fast32_t q = 0; q < s; q += 8) {
+					__m512 a = _mm512_loadu_ps(fp(xa + q));
+					__m512 b = _mm512_loadu_ps(fp(xa + q + half));
+					_mm512_storeu_ps(fp(ys + q), _mm512_add_ps(a, b));
+					_mm512_storeu_ps(fp(ys + q + s), cmul_avx512(_mm512_sub_ps(a, b), wp));
+				}
+			}
+		}
+		std::swap(x, y);
+	}
+	return x;
+}
+
+/*
+ * 複数フレームのSoA版。レーン方向に並んだ実部と虚部をそのままベクタとして読み書きするため、
+ * sによらず並べ替えは不要で、重みは1回のブロードキャストで全フレームに使える。
+ */
+
+MA_TARGET("sse4.1")
+float* stockham_batch_sse4(float* x, float* y, std::uint_fast32_t length, const std::complex<float>* weight)
+{
+	constexpr std::uint_fast32_t lanes = 4, block = lanes * 2;
+	const std::uint_fast32_t half = length >> 1;
+	for (std::uint_fast32_t n = length, s = 1; n > 1; n >>= 1, s <<= 1) {
+		const std::uint_fast32_t m = n >> 1;
+		const std::complex<float>* w = weight + (m - 1);
+		for (std::uint_fast32_t p = 0; p < m; ++p) {
+			const __m128 wr = _mm_set1_ps(w[p].real());
+			const __m128 wi = _mm_set1_ps(w[p].imag());
+			for (std::uint_fast32_t q = 0; q < s; ++q) {
+				const float* a = x + (q + s * p) * block;
+				const float* b = a + half * block;
+				float* ys = y + (q + s * (p << 1)) * block;
+				float* yd = ys + s * block;
+				__m128 ar = _mm_loadu_ps(a), ai = _mm_loadu_ps(a + lanes);
+				__m128 br = _mm_loadu_ps(b), bi = _mm_loadu_ps(b + lanes);
+				__m128 dr = _mm_sub_ps(ar, br), di = _mm_sub_ps(ai, bi);
+				_mm_storeu_ps(ys, _mm_add_ps(ar, br));
+				_mm_storeu_ps(ys + lanes, _mm_add_ps(ai, bi));
+				_mm_storeu_ps(yd, _mm_sub_ps(_mm_mul_ps(dr, wr), _mm_mul_ps(di, wi)));
+				_mm_storeu_ps(yd + lanes, _mm_add_ps(_mm_mul_ps(dr, wi), _mm_mul_ps(di, wr)));
+			}
+		}
+		std::swap(x, y);
+	}
+	return x;
+}
+
+MA_TARGET("avx2,fma")
+float* stockham_batch_avx2(float* x, float* y, std::uint_fast32_t length, const std::complex<float>* weight)
+{
+	constexpr std::uint_fast32_t lanes = 8, block = lanes * 2;
+	const std::uint_fast32_t half = length >> 1;
+	for (std::uint_fast32_t n = length, s = 1; n > 1; n >>= 1, s <<= 1) {
+		const std::uint_fast32_t m = n >> 1;
+		const std::complex<float>* w = weight + (m - 1);
+		for (std::uint_fast32_t p = 0; p < m; ++p) {
+			const __m256 wr = _mm256_set1_ps(w[p].real());
+			const __m256 wi = _mm256_set1_ps(w[p].imag());
+			for (std::uint_fast32_t q = 0; q < s; ++q) {
+				const float* a = x + (q + s * p) * block;
+				const float* b = a + half * block;
+				float* ys = y + (q + s * (p << 1)) * block;
+				float* yd = ys + s * block;
+				__m256 ar = _mm256_loadu_ps(a), ai = _mm256_loadu_ps(a + lanes);
+				__m256 br = _mm256_loadu_ps(b), bi = _mm256_loadu_ps(b + lanes);
+				__m256 dr = _mm256_sub_ps(ar, br), di = _mm256_sub_ps(ai, bi);
+				_mm256_storeu_ps(ys, _mm256_add_ps(ar, br));
+				_mm256_storeu_ps(ys + lanes, _mm256_add_ps(ai, bi));
+				_mm256_storeu_ps(yd, _mm256_fmsub_ps(dr, wr, _mm256_mul_ps(di, wi)));
+				_mm256_storeu_ps(yd + lanes, _mm256_fmadd_ps(dr, wi, _mm256_mul_ps(di, wr)));
+			}
+		}
+		std::swap(x, y);
+	}
+	return x;
+}
+
+MA_TARGET("avx512f,avx2,fma")
+float* stockham_batch_avx512(float* x, float* y, std::uint_fast32_t length, const std::complex<float>* weight)
+{
+	constexpr std::uint_fast32_t lanes = 16, block = lanes * 2;
+	const std::uint_fast32_t half = length >> 1;
+	for (std::uint_fast32_t n = length, s = 1; n > 1; n >>= 1, s <<= 1) {
+		const std::uint_fast32_t m = n >> 1;
+		const std::complex<float>* w = weight + (m - 1);
+		for (std::uint_fast32_t p = 0; p < m; ++p) {
+			const __m512 wr = _mm512_set1_ps(w[p].real());
+			const __m512 wi = _mm512_set1_ps(w[p].imag());
+			for (std::uint_fast32_t q = 0; q < s; ++q) {
+				const float* a = x + (q + s * p) * block;
+				const float* b = a + half * block;
+				float* ys = y + (q + s * (p << 1)) * block;
+				float* yd = ys + s * block;
+				__m512 ar = _mm512_loadu_ps(a), ai = _mm512_loadu_ps(a + lanes);
+				__m512 br = _mm512_loadu_ps(b), bi = _mm512_loadu_ps(b + lanes);
+				__m512 dr = _mm512_sub_ps(ar, br), di = _mm512_sub_ps(ai, bi);
+				_mm512_storeu_ps(ys, _mm512_add_ps(ar, br));
+				_mm512_storeu_ps(ys + lanes, _mm512_add_ps(ai, bi));
+				_mm512_storeu_ps(yd, _mm512_fmsub_ps(dr, wr, _mm512_mul_ps(di, wi)));
+				_mm512_storeu_ps(yd + lanes, _mm512_fmadd_ps(dr, wi, _mm512_mul_ps(di, wr)));
+			}
+		}
+		std::swap(x, y);
+	}
+	return x;
+}
+
+FFTKernel<float> select_fft_kernel(SimdLevel level)
+{
+	switch (level)
+	{
+		using enum SimdLevel;
+	case AVX512: return &stockham_avx512;
+	case AVX2:   return &stockham_avx2;
+	case SSE4:   return &stockham_sse4;
+	case Scalar: break;
+	}
+	return &stockham_scalar<float>;
+}
+
+BatchFFTKernel<float> select_batch_fft_kernel(SimdLevel level)
+{
+	switch (level)
+	{
+		using enum SimdLevel;
+	case AVX512: return { 16, &stockham_batch_avx512 };
+	case AVX2:   return { 8, &stockham_batch_avx2 };
+	case SSE4:   return { 4, &stockham_batch_sse4 };
+	case Scalar: break;
+	}
+	return { 4, &stockham_batch_scalar<float, 4> };
+}
@@ -0,0 +1,114 @@
+﻿#pragma once
+
+#include "CpuFeatures.h"
+
+/**
+ * @brief 自然順に並んだlength点の複素数列をStockham法でFFTするカーネル。
+ * 各段でxからyへ書き込み、xとyを入れ替えながら進むため、ビット反転の並べ替えが不要になる。
+ *
+ * @param x 入力。作業領域としても使われ、内容は破壊される
+ * @param y 作業領域。length個以上の要素数が必要
+ * @param length 点数。2の乗数に限る
+ * @param weight 段ごとの重み。n点の段の W_n^p (p < n / 2) がweight[n / 2 - 1 + p]に連続して並ぶ
+ * @return 変換結果の先頭。段数の偶奇によってxかyのどちらかになる
+ */
+template<std::floating_point T>
+using FFTKernel = std::complex<T>* (*)(std::complex<T>* x, std::complex<T>* y, std::uint_fast32_t length, const std::complex<T>* weight);
+
+/**
+ * @brief 複素数の積。std::complexの演算子はNaN/Infの規格上の扱いのためライブラリ呼び出しになることがあるので、
+ * FFTの内側のループではこちらを使う。
+ */
+template<std::floating_point T>
+inline std::complex<T> complex_mul(std::complex<T> a, std::complex<T> b)
+{
+	return std::complex<T>(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+/**
+ * @brief SIMDを使わないStockham FFT。全ての浮動小数点型で使用できる。
+ */
+template<std::floating_point T>
+std::complex<T>* stockham_scalar(std::complex<T>* x, std::complex<T>* y, std::uint_fast32_t length, const std::complex<T>* weight)
+{
+	const std::uint_fast32_t half = length >> 1;
+	for (std::uint_fast32_t n = length, s = 1; n > 1; n >>= 1, s <<= 1) {
+		const std::uint_fast32_t m = n >> 1;
+		const std::complex<T>* w = weight + (m - 1);
+		for (std::uint_fast32_t p = 0; p < m; ++p) {
+			const std::complex<T> wp = w[p];
+			for (std::uint_fast32_t q = 0; q < s; ++q) {
+				const std::complex<T> a = x[q + s * p];
+				const std::complex<T> b = x[q + s * p + half];
+				y[q + s * (p << 1)] = a + b;
+				y[q + s * ((p << 1) + 1)] = complex_mul(a - b, wp);
+			}
+		}
+		std::swap(x, y);
+	}
+	return x;
+}
+
+/**
+ * @brief 複数フレームをSIMDのレーンに割り当て(SoA)、同時にStockham FFTするカーネル。
+ * x, yは複素数1個ごとにlanes個の実部とlanes個の虚部を並べた配列で、それぞれlength * 2 * lanes要素が必要。
+ * 重みは全レーンで共通なので、各段で1回読めば全フレームに使える。
+ */
+template<std::floating_point T>
+struct BatchFFTKernel
+{
+	std::uint_fast32_t lanes;	/// 同時に変換するフレーム数
+	T* (*run)(T* x, T* y, std::uint_fast32_t length, const std::complex<T>* weight);	/// 戻り値は結果の先頭 (xかy)
+};
+
+/**
+ * @brief SIMD命令を直接使わないSoA Stockham FFT。レーンのループはコンパイラの自動ベクトル化に任せる。
+ */
+template<std::floating_point T, std::uint_fast32_t Lanes>
+T* stockham_batch_scalar(T* x, T* y, std::uint_fast32_t length, const std::complex<T>* weight)
+{
+	constexpr std::uint_fast32_t block = Lanes * 2;
+	const std::uint_fast32_t half = length >> 1;
+	for (std::uint_fast32_t n = length, s = 1; n > 1; n >>= 1, s <<= 1) {
+		const std::uint_fast32_t m = n >> 1;
+		const std::complex<T>* w = weight + (m - 1);
+		for (std::uint_fast32_t p = 0; p < m; ++p) {
+			const T wr = w[p].real();
+			const T wi = w[p].imag();
+			for (std::uint_fast32_t q = 0; q < s; ++q) {
+				const T* a = x + (q + s * p) * block;
+				const T* b = a + half * block;
+				T* ys = y + (q + s * (p << 1)) * block;
+				T* yd = ys + s * block;
+				for (std::uint_fast32_t f = 0; f < Lanes; ++f) {
+					const T dr = a[f] - b[f];
+					const T di = a[Lanes + f] - b[Lanes + f];
+					ys[f] = a[f] + b[f];
+					ys[Lanes + f] = a[Lanes + f] + b[Lanes + f];
+					yd[f] = dr * wr - di * wi;
+					yd[Lanes + f] = dr * wi + di * wr;
+				}
+			}
+		}
+		std::swap(x, y);
+	}
+	return x;
+}
+
+/* float用のSIMDカーネル。対応する命令セットが使えるCPUでのみ呼び出すこと */
+std::complex<float>* stockham_sse4(std::complex<float>* x, std::complex<float>* y, std::uint_fast32_t length, const std::complex<float>* weight);
+std::complex<float>* stockham_avx2(std::complex<float>* x, std::complex<float>* y, std::uint_fast32_t length, const std::complex<float>* weight);
+std::complex<float>* stockham_avx512(std::complex<float>* x, std::complex<float>* y, std::uint_fast32_t length, const std::complex<float>* weight);
+float* stockham_batch_sse4(float* x, float* y, std::uint_fast32_t length, const std::complex<float>* weight);
+float* stockham_batch_avx2(float* x, float* y, std::uint_fast32_t length, const std::complex<float>* weight);
+float* stockham_batch_avx512(float* x, float* y, std::uint_fast32_t length, const std::complex<float>* weight);
+
+/**
+ * @brief SIMD段階に応じたfloat用のFFTカーネルを選ぶ。
+ */
+FFTKernel<float> select_fft_kernel(SimdLevel level);
+
+/**
+ * @brief SIMD段階に応じたfloat用の複数フレームFFTカーネルを選ぶ。レーン数は4 (SSE4) / 8 (AVX2) / 16 (AVX-512)。
+ */
+BatchFFTKernel<float> select_batch_fft_kernel(SimdLevel level);
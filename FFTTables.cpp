@@ -0,0 +1,46 @@
+﻿#include "pch.h"
+#include "FFTTables.h"
+
+namespace {
+    constexpr std::uint32_t StaticWeightSize = 1024;   // この点数以下の重みはコンパイル時に作る
+
+    template<std::uint32_t Size>
+    constexpr auto make_weight() {
+        std::array<std::complex<float>, Size - 1> w{};
+        fft_tables::fill_weight(w.data(), Size);
+        return w;
+    }
+
+    template<std::uint32_t N, WindowType Type>
+    constexpr auto make_window() {
+        std::array<float, N> w{};
+        fft_tables::fill_window(w.data(), N, Type);
+        return w;
+    }
+
+    // FFT_N, BPMFFT_N, チャープZ変換の1024点と、TempoCheckのBPMDataSize点
+    constexpr auto Weight = make_weight<StaticWeightSize>();
+    constexpr auto Hann512 = make_window<512, WindowType::Hann>();
+    constexpr auto Hann1024 = make_window<1024, WindowType::Hann>();
+    constexpr auto Hann480 = make_window<480, WindowType::Hann>();
+
+    static_assert(Weight[0] == std::complex<float>(1, 0));
+    static_assert(Hann1024[0] == 0.0f && Hann1024[512] == 1.0f);
+}
+
+const std::complex<float>* fft_tables::static_weight(std::uint32_t size)
+{
+    return size <= StaticWeightSize ? Weight.data() : nullptr;
+}
+
+const float* fft_tables::static_window(std::uint32_t size, WindowType type)
+{
+    if (type != WindowType::Hann) return nullptr;
+    switch (size)
+    {
+    case 480: return Hann480.data();
+    case 512: return Hann512.data();
+    case 1024: return Hann1024.data();
+    default: return nullptr;
+    }
+}
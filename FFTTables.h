@@ -0,0 +1,163 @@
+﻿#pragma once
+
+/**
+ * @brief FFTの前にかける窓関数の種類。いずれもフレーム長Nを周期とする (periodic) 形で作る。
+ */
+enum class WindowType {
+	Hann,				/// ハン窓
+	Hamming,			/// ハミング窓
+	BlackmanHarris,		/// 4項ブラックマン-ハリス窓。サイドローブが小さい
+};
+
+namespace fft_tables {
+	/**
+	 * @brief cos(2πk/n), sin(2πk/n) を倍精度で求める。constexprで評価できる。
+	 * 象限を整数のまま落としてから、[0, π/4] のテイラー展開で計算するため、
+	 * 同じ角度であれば (k, n) の取り方によらず同じ値になる。
+	 */
+	constexpr std::pair<double, double> cos_sin_turn(std::uint64_t k, std::uint64_t n)
+	{
+		constexpr double half_pi = std::numbers::pi / 2;
+		k %= n;
+		const std::uint64_t quadrant = (k * 4) / n;
+		const std::uint64_t rest = k * 4 - quadrant * n;	// 象限内の位置 (rest / n * π/2)
+
+		// x > π/4 なら余角で計算する
+		const bool complement = rest * 2 > n;
+		const double x = complement ? half_pi * double(n - rest) / double(n) : half_pi * double(rest) / double(n);
+		const double x2 = x * x;
+		double s = 0, c = 0;
+		double ts = x, tc = 1;
+		for (int j = 0; j < 12; ++j) {
+			s += ts;
+			c += tc;
+			ts *= -x2 / double((2 * j + 2) * (2 * j + 3));
+			tc *= -x2 / double((2 * j + 1) * (2 * j + 2));
+		}
+		if (complement) std::swap(s, c);
+
+		switch (quadrant)
+		{
+		case 0: return { c, s };
+		case 1: return { -s, c };
+		case 2: return { -c, -s };
+		default: return { s, -c };
+		}
+	}
+
+	/**
+	 * @brief FFTの重みを作る。n = 2, 4, ..., size の各段の W_n^p (p < n / 2) を連続して並べる。
+	 * 小さい段はsize点の W_size^(p * size / n) と同じ値なので、大きいsizeの表の先頭は小さいsizeの表と一致する。
+	 *
+	 * @param w max(size - 1, 1)個の出力先
+	 */
+	template<std::floating_point T>
+	constexpr void fill_weight(std::complex<T>* w, std::uint32_t size)
+	{
+		w[0] = std::complex<T>(0);
+		for (std::uint32_t n = 2; n <= size; n <<= 1) {
+			std::complex<T>* stage = w + (n >> 1) - 1;
+			for (std::uint32_t p = 0; p < (n >> 1); ++p) {
+				const auto [c, s] = cos_sin_turn(p, n);
+				stage[p] = std::complex<T>(T(c), T(-s));
+			}
+		}
+	}
+
+	/**
+	 * @brief 窓関数を作る。
+	 *
+	 * @param w n個の出力先
+	 */
+	template<std::floating_point T>
+	constexpr void fill_window(T* w, std::uint32_t n, WindowType type)
+	{
+		for (std::uint32_t i = 0; i < n; ++i) {
+			const double c1 = cos_sin_turn(i, n).first;
+			switch (type)
+			{
+			case WindowType::Hann:
+				w[i] = T(0.5 - 0.5 * c1);
+				break;
+			case WindowType::Hamming:
+				w[i] = T(0.54 - 0.46 * c1);
+				break;
+			case WindowType::BlackmanHarris:
+				w[i] = T(0.35875 - 0.48829 * c1 + 0.14128 * cos_sin_turn(std::uint64_t(i) * 2, n).first - 0.01168 * cos_sin_turn(std::uint64_t(i) * 3, n).first);
+				break;
+			}
+		}
+	}
+
+	/**
+	 * @brief コンパイル時に作成したfloatの重みの表。size点以下なら先頭から使える。
+	 * @return 表の先頭。sizeが表より大きければnullptr
+	 */
+	const std::complex<float>* static_weight(std::uint32_t size);
+
+	/**
+	 * @brief コンパイル時に作成したfloatの窓関数の表。
+	 * @return 表の先頭。対応するものがなければnullptr
+	 */
+	const float* static_window(std::uint32_t size, WindowType type);
+}
+
+/**
+ * @class FFTTableCache
+ * @brief FFTの重みと窓関数の表を、プロセス全体で (型, 点数, 窓関数) ごとに1つだけ作って共有するキャッシュ。
+ * 表は作成後に変更しないため、FFTExecutorやTempoCheckが何個あっても同じ表を参照できる。
+ * よく使う大きさのfloatの表はコンパイル時に作成したものを返し、それ以外は初回に作成してプロセス終了まで保持する。
+ * スレッドセーフ。
+ *
+ * @tparam T 表の浮動小数点型。
+ */
+template<std::floating_point T>
+class FFTTableCache
+{
+	static std::mutex& mutex() {
+		static std::mutex mtx;
+		return mtx;
+	}
+
+public:
+	/**
+	 * @brief size点のFFTの重み。n点の段の W_n^p はweight[n / 2 - 1 + p]
+	 */
+	static std::shared_ptr<const std::complex<T>[]> weight(std::uint32_t size) {
+		if constexpr (std::is_same_v<T, float>) {
+			if (const std::complex<float>* w = fft_tables::static_weight(size)) {
+				// 静的な表は解放しないので、所有者のないshared_ptrとして返す
+				return std::shared_ptr<const std::complex<T>[]>(std::shared_ptr<void>(), w);
+			}
+		}
+		static std::map<std::uint32_t, std::shared_ptr<const std::complex<T>[]>> cache;
+		std::lock_guard<std::mutex> lock(mutex());
+		auto& entry = cache[size];
+		if (!entry) {
+			auto w = std::make_shared_for_overwrite<std::complex<T>[]>(std::max<std::uint32_t>(size, 2) - 1);
+			fft_tables::fill_weight(w.get(), size);
+			entry = std::move(w);
+		}
+		return entry;
+	}
+
+	/**
+	 * @brief n点の窓関数
+	 */
+	static std::shared_ptr<const T[]> window(std::uint32_t n, WindowType type) {
+		if constexpr (std::is_same_v<T, float>) {
+			if (const float* w = fft_tables::static_window(n, type)) {
+				return std::shared_ptr<const T[]>(std::shared_ptr<void>(), w);
+			}
+		}
+		static std::map<std::pair<std::uint32_t, WindowType>, std::shared_ptr<const T[]>> cache;
+		std::lock_guard<std::mutex> lock(mutex());
+		auto& entry = cache[{ n, type }];
+		if (!entry) {
+			auto w = std::make_shared_for_overwrite<T[]>(n);
+			fft_tables::fill_window(w.get(), n, type);
+			entry = std::move(w);
+		}
+		return entry;
+	}
+};
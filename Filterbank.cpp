@@ -0,0 +1,115 @@
+﻿#include "pch.h"
+#include "Filterbank.h"
+
+namespace {
+    // 周波数 (Hz) から尺度上の位置
+    double warp(BandScale scale, double f) {
+        switch (scale)
+        {
+        case BandScale::Bark: return 26.81 * f / (1960.0 + f) - 0.53;
+        case BandScale::Octave: return std::log2(f);
+        default: return 2595.0 * std::log10(1.0 + f / 700.0);
+        }
+    }
+
+    // 尺度上の位置から周波数 (Hz)
+    double unwarp(BandScale scale, double z) {
+        switch (scale)
+        {
+        case BandScale::Bark: return 1960.0 * (z + 0.53) / (26.28 - z);
+        case BandScale::Octave: return std::exp2(z);
+        default: return 700.0 * (std::pow(10.0, z / 2595.0) - 1.0);
+        }
+    }
+
+    std::shared_ptr<const FilterbankTable> build_table(BandScale scale, std::uint32_t bands, std::uint32_t transform_size, std::uint32_t sample_rate, float min_freq, float max_freq) {
+        auto t = std::make_shared<FilterbankTable>();
+        t->scale = scale;
+        t->bands = bands;
+        t->transform_size = transform_size;
+        t->sample_rate = sample_rate;
+        t->min_freq = min_freq;
+        t->max_freq = max_freq;
+
+        const std::uint32_t bins = transform_size >> 1;
+        const double bin_hz = double(sample_rate) / transform_size;
+        const double lo = warp(scale, min_freq);
+        const double hi = warp(scale, max_freq);
+        std::vector<double> edges(bands + 2);
+        for (std::uint32_t i = 0; i < bands + 2; ++i) {
+            edges[i] = unwarp(scale, lo + (hi - lo) * i / (bands + 1));
+        }
+
+        std::vector<double> row(bins);
+        for (std::uint32_t b = 0; b < bands; ++b) {
+            const double left = edges[b], center = edges[b + 1], right = edges[b + 2];
+            t->centers.push_back(static_cast<float>(center));
+            double sum = 0;
+            for (std::uint32_t k = 0; k < bins; ++k) {
+                const double f = k * bin_hz;
+                const double w = std::max(0.0, std::min((f - left) / (center - left), (right - f) / (right - center)));
+                row[k] = w;
+                sum += w;
+            }
+            if (sum == 0) {
+                // ビンの幅より狭い帯域は中心に最も近いビン
+                std::fill(row.begin(), row.end(), 0.0);
+                row[std::min<std::uint32_t>(bins - 1, static_cast<std::uint32_t>(std::lround(center / bin_hz)))] = 1.0;
+                sum = 1.0;
+            }
+
+            std::uint32_t k0 = 0, k1 = bins - 1;
+            while (row[k0] == 0) ++k0;
+            while (row[k1] == 0) --k1;
+            // 内積の関数は8個ずつ処理するので、係数の列を8の倍数に広げる (はみ出す場合は前に広げる)
+            const std::uint32_t length = (k1 - k0 + 1 + 7) & ~7u;
+            const std::uint32_t first = std::min(k0, bins - length);
+            t->first.push_back(first);
+            t->length.push_back(length);
+            t->offset.push_back(static_cast<std::uint32_t>(t->weights.size()));
+            for (std::uint32_t j = 0; j < length; ++j) {
+                t->weights.push_back(static_cast<float>(row[first + j] / sum));
+            }
+        }
+        return t;
+    }
+}
+
+const char* to_string(BandScale scale)
+{
+    switch (scale)
+    {
+    case BandScale::Bark: return "bark";
+    case BandScale::Octave: return "octave";
+    default: return "mel";
+    }
+}
+
+std::shared_ptr<const FilterbankTable> FilterbankTable::get(BandScale scale, std::uint32_t bands, std::uint32_t transform_size, std::uint32_t sample_rate, float min_freq, float max_freq)
+{
+    const std::uint32_t bins = transform_size >> 1;
+    if (bands == 0 || sample_rate == 0 || bins < 8 || bins % 8 != 0 || bands > bins) {
+        throw std::invalid_argument("invalid filterbank size");
+    }
+    const float nyquist = sample_rate / 2.0f;
+    if (max_freq <= 0) max_freq = nyquist;
+    if (min_freq < 0) min_freq = scale == BandScale::Octave ? 2.0f * sample_rate / transform_size : 0.0f;
+    if (max_freq > nyquist || !(min_freq < max_freq) || (scale == BandScale::Octave && min_freq <= 0)) {
+        throw std::invalid_argument("invalid filterbank frequency range");
+    }
+
+    using Key = std::tuple<BandScale, std::uint32_t, std::uint32_t, std::uint32_t, float, float>;
+    static std::mutex mtx;
+    static std::map<Key, std::shared_ptr<const FilterbankTable>> cache;
+    std::lock_guard<std::mutex> lock(mtx);
+    auto& entry = cache[{ scale, bands, transform_size, sample_rate, min_freq, max_freq }];
+    if (!entry) {
+        entry = build_table(scale, bands, transform_size, sample_rate, min_freq, max_freq);
+    }
+    return entry;
+}
+
+Filterbank::Filterbank(BandScale scale, std::uint32_t bands, std::uint32_t transform_size, std::uint32_t sample_rate, float min_freq, float max_freq, SimdLevel level)
+    : table(FilterbankTable::get(scale, bands, transform_size, sample_rate, min_freq, max_freq)), dot(select_dot_kernel(level))
+{
+}
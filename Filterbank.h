@@ -0,0 +1,88 @@
+﻿#pragma once
+
+#include "DotKernels.h"
+
+/**
+ * @brief フィルターバンクの帯域の並べ方
+ */
+enum class BandScale {
+	Mel,		/// メル尺度 (2595 log10(1 + f / 700)) で等間隔
+	Bark,		/// バーク尺度 (Traunmüllerの近似) で等間隔
+	Octave,		/// 周波数の対数で等間隔
+};
+
+/**
+ * @brief 帯域の並べ方の名前 (mel / bark / octave)
+ */
+const char* to_string(BandScale scale);
+
+/**
+ * @brief フィルターバンクの係数表。設定ごとに1つだけ作り、全てのFilterbankで共有する。
+ * 帯域ごとに、尺度の上で等間隔に並べた隣の帯域の中心までを裾とする三角形の重みを持つ。重みは帯域ごとに和が1になるよう正規化するため、
+ * 帯域の値は帯域内の振幅の加重平均になり、ビンと同じ大きさの範囲に収まる。
+ * 重みが0でないビンは連続しているので、先頭のビンと連続した係数の列 (8の倍数に0で埋めたもの) だけを持つ疎な表にする。
+ * ビンの幅より狭い低域の帯域は、中心に最も近いビンをそのまま使う。
+ */
+struct FilterbankTable
+{
+	BandScale scale = BandScale::Mel;
+	std::uint32_t bands = 0;			/// 帯域数
+	std::uint32_t transform_size = 0;	/// FFTの点数。ビンは transform_size / 2 個
+	std::uint32_t sample_rate = 0;		/// サンプリングレート
+	float min_freq = 0;					/// 最も低い帯域の下端 (Hz)
+	float max_freq = 0;					/// 最も高い帯域の上端 (Hz)
+	std::vector<std::uint32_t> first;	/// 帯域ごとの先頭のビン
+	std::vector<std::uint32_t> length;	/// 帯域ごとの係数の数 (8の倍数)
+	std::vector<std::uint32_t> offset;	/// 帯域ごとのweights上の位置
+	std::vector<float> weights;			/// 全ての帯域の係数
+	std::vector<float> centers;			/// 帯域ごとの中心周波数 (Hz)
+
+	/**
+	 * @brief 設定に対応する表を取得する。初回は作成し、以降はキャッシュしたものを返す。スレッドセーフ。
+	 *
+	 * @param min_freq 最も低い帯域の下端 (Hz)。負ならMel, Barkは0、Octaveはビン2つ分
+	 * @param max_freq 最も高い帯域の上端 (Hz)。0以下ならナイキスト周波数
+	 * @throw std::invalid_argument 帯域数や周波数の範囲が正しくない場合
+	 */
+	static std::shared_ptr<const FilterbankTable> get(BandScale scale, std::uint32_t bands, std::uint32_t transform_size, std::uint32_t sample_rate, float min_freq = -1, float max_freq = 0);
+};
+
+/**
+ * @class Filterbank
+ * @brief FFTの振幅 (N/2個のビン) を知覚的な帯域にまとめる。
+ * 帯域ごとに、係数の列と振幅の内積をSIMD段階に応じた内積の関数で求める。内部状態を変更しないため、複数スレッドから同時に呼び出せる。
+ */
+class Filterbank
+{
+	const std::shared_ptr<const FilterbankTable> table;
+	const DotKernel dot;
+
+public:
+	/**
+	 * @param scale 帯域の並べ方
+	 * @param bands 帯域数
+	 * @param transform_size FFTの点数
+	 * @param sample_rate サンプリングレート
+	 * @param min_freq 最も低い帯域の下端 (Hz)。負なら既定値
+	 * @param max_freq 最も高い帯域の上端 (Hz)。0以下ならナイキスト周波数
+	 * @param level 内積に使うSIMD段階。省略時はCPUIDと環境変数 MEDIAANALYSIS_SIMD から決める
+	 */
+	Filterbank(BandScale scale, std::uint32_t bands, std::uint32_t transform_size, std::uint32_t sample_rate, float min_freq = -1, float max_freq = 0, SimdLevel level = simd_level());
+
+	std::uint32_t bands() const { return table->bands; }
+	std::uint32_t bins() const { return table->transform_size >> 1; }
+	const FilterbankTable& coefficients() const { return *table; }
+
+	/**
+	 * @brief 1フレーム分の振幅を帯域にまとめる。
+	 *
+	 * @param magnitude bins()個の振幅
+	 * @param out bands()個の出力先
+	 */
+	void apply(const float* magnitude, float* out) const {
+		const FilterbankTable& t = *table;
+		for (std::uint32_t b = 0; b < t.bands; ++b) {
+			out[b] = dot(magnitude + t.first[b], t.weights.data() + t.offset[b], t.length[b]);
+		}
+	}
+};
@@ -0,0 +1,199 @@
+﻿#include "pch.h"
+#include "FrameCodec.h"
+
+namespace {
+    constexpr unsigned KBits = 5;   // フレームごとのkのビット数
+
+    // 下位ビットから詰めるビット列の書き込み
+    class BitWriter {
+        std::vector<std::byte>& out;
+        std::uint64_t acc = 0;
+        unsigned count = 0;
+    public:
+        explicit BitWriter(std::vector<std::byte>& out) : out(out) {}
+
+        // valueの下位bitsビット (32まで) を書く
+        void put(std::uint32_t value, unsigned bits) {
+            acc |= std::uint64_t(value) << count;
+            count += bits;
+            while (count >= 8) {
+                out.push_back(static_cast<std::byte>(acc));
+                acc >>= 8;
+                count -= 8;
+            }
+        }
+
+        void ones(unsigned n) {
+            for (; n >= 16; n -= 16) put(0xFFFF, 16);
+            put((1u << n) - 1, n);
+        }
+
+        void finish() {
+            if (count > 0) out.push_back(static_cast<std::byte>(acc));
+            acc = 0;
+            count = 0;
+        }
+    };
+
+    // 下位ビットから読むビット列の読み出し。末尾より先は0として読み、finishで読み過ぎを検出する
+    class BitReader {
+        const std::byte* p;
+        const std::byte* const end;
+        const std::size_t bytes;
+        std::uint64_t acc = 0;
+        unsigned count = 0;
+        std::size_t over = 0;   // 末尾より先に読んだバイト数
+
+        void refill() {
+            while (count <= 56) {
+                if (p < end) acc |= std::uint64_t(std::to_integer<std::uint8_t>(*p++)) << count;
+                else ++over;
+                count += 8;
+            }
+        }
+    public:
+        BitReader(const std::byte* data, std::size_t bytes) : p(data), end(data + bytes), bytes(bytes) {}
+
+        std::uint32_t get(unsigned bits) {
+            if (bits == 0) return 0;
+            refill();
+            const std::uint32_t v = static_cast<std::uint32_t>(acc & ((std::uint64_t(1) << bits) - 1));
+            acc >>= bits;
+            count -= bits;
+            return v;
+        }
+
+        // 0までの1の数 (limitで打ち切り)。0は読み捨てる
+        std::uint32_t unary(std::uint32_t limit) {
+            refill();
+            const std::uint32_t q = std::min<std::uint32_t>(std::countr_one(acc), limit);
+            const unsigned used = q + (q < limit ? 1 : 0);
+            acc >>= used;
+            count -= used;
+            return q;
+        }
+
+        // 読んだビット数がデータに収まっているか
+        bool valid() const { return over * 8 <= count; }
+    };
+
+    template<typename U>
+    U zigzag(U current, U previous) {
+        using S = std::make_signed_t<U>;
+        const S d = static_cast<S>(static_cast<U>(current - previous));
+        return static_cast<U>((static_cast<U>(d) << 1) ^ static_cast<U>(d >> (sizeof(U) * 8 - 1)));
+    }
+
+    template<typename U>
+    U unzigzag(U z, U previous) {
+        const U d = static_cast<U>((z >> 1) ^ static_cast<U>(0 - (z & 1)));
+        return static_cast<U>(previous + d);
+    }
+
+    // kのライス符号で書いた場合のビット数
+    template<typename U>
+    std::uint64_t rice_cost(const U* z, std::uint32_t n, unsigned k) {
+        constexpr unsigned bits = sizeof(U) * 8;
+        std::uint64_t cost = 0;
+        for (std::uint32_t i = 0; i < n; ++i) {
+            const std::uint32_t q = std::uint32_t(z[i]) >> k;
+            cost += q < frame_codec::Escape ? q + 1 + k : frame_codec::Escape + bits;
+        }
+        return cost;
+    }
+
+    template<typename U>
+    void encode(const U* frames, std::uint32_t count, std::uint32_t frame_values, std::vector<std::byte>& out) {
+        constexpr unsigned bits = sizeof(U) * 8;
+        std::vector<U> z(frame_values);
+        BitWriter writer(out);
+        for (std::uint32_t f = 0; f < count; ++f) {
+            const U* cur = frames + std::size_t(f) * frame_values;
+            const U* prev = f == 0 ? nullptr : cur - frame_values;
+            std::uint64_t sum = 0;
+            for (std::uint32_t i = 0; i < frame_values; ++i) {
+                z[i] = zigzag<U>(cur[i], prev ? prev[i] : U(0));
+                sum += z[i];
+            }
+
+            // 平均から見積もったkの前後で、実際のビット数が最小のものを選ぶ
+            const unsigned estimate = std::bit_width(sum / std::max<std::uint32_t>(frame_values, 1));
+            unsigned k = 0;
+            std::uint64_t best = UINT64_MAX;
+            for (unsigned c = estimate > 0 ? estimate - 1 : 0; c <= std::min(estimate + 1, bits); ++c) {
+                const std::uint64_t cost = rice_cost(z.data(), frame_values, c);
+                if (cost < best) {
+                    best = cost;
+                    k = c;
+                }
+            }
+
+            writer.put(k, KBits);
+            for (std::uint32_t i = 0; i < frame_values; ++i) {
+                const std::uint32_t q = std::uint32_t(z[i]) >> k;
+                if (q < frame_codec::Escape) {
+                    writer.ones(q);
+                    writer.put(0, 1);
+                    writer.put(std::uint32_t(z[i]) & ((1u << k) - 1), k);
+                }
+                else {
+                    writer.ones(frame_codec::Escape);
+                    writer.put(z[i], bits);
+                }
+            }
+        }
+        writer.finish();
+    }
+
+    template<typename U>
+    void decode(const std::byte* data, std::size_t bytes, std::uint32_t count, std::uint32_t frame_values, U* out) {
+        constexpr unsigned bits = sizeof(U) * 8;
+        BitReader reader(data, bytes);
+        for (std::uint32_t f = 0; f < count; ++f) {
+            U* cur = out + std::size_t(f) * frame_values;
+            const U* prev = f == 0 ? nullptr : cur - frame_values;
+            const unsigned k = reader.get(KBits);
+            if (k > bits) {
+                throw std::runtime_error("broken compressed chunk");
+            }
+            for (std::uint32_t i = 0; i < frame_values; ++i) {
+                const std::uint32_t q = reader.unary(frame_codec::Escape);
+                const std::uint32_t z = q < frame_codec::Escape ? (q << k) | reader.get(k) : reader.get(bits);
+                cur[i] = unzigzag<U>(static_cast<U>(z), prev ? prev[i] : U(0));
+            }
+        }
+        if (!reader.valid()) {
+            throw std::runtime_error("truncated compressed chunk");
+        }
+    }
+}
+
+void frame_codec::encode_delta_rice(const std::byte* frames, std::uint32_t count, std::uint32_t frame_values, std::uint32_t value_bytes, std::vector<std::byte>& out)
+{
+    switch (value_bytes)
+    {
+    case 1:
+        encode(reinterpret_cast<const std::uint8_t*>(frames), count, frame_values, out);
+        break;
+    case 2:
+        encode(reinterpret_cast<const std::uint16_t*>(frames), count, frame_values, out);
+        break;
+    default:
+        throw std::invalid_argument("delta-rice compression supports 8 and 16 bit values");
+    }
+}
+
+void frame_codec::decode_delta_rice(const std::byte* data, std::size_t bytes, std::uint32_t count, std::uint32_t frame_values, std::uint32_t value_bytes, std::byte* out)
+{
+    switch (value_bytes)
+    {
+    case 1:
+        decode(data, bytes, count, frame_values, reinterpret_cast<std::uint8_t*>(out));
+        break;
+    case 2:
+        decode(data, bytes, count, frame_values, reinterpret_cast<std::uint16_t*>(out));
+        break;
+    default:
+        throw std::invalid_argument("delta-rice compression supports 8 and 16 bit values");
+    }
+}
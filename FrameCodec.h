@@ -0,0 +1,43 @@
+﻿#pragma once
+
+/**
+ * @brief フレームファイルのチャンクの圧縮方式
+ */
+enum class FrameCompression : std::uint32_t {
+	None = 0,		/// 圧縮しない
+	DeltaRice = 1,	/// 前のフレームとの差分をライス符号で符号化する (8bit, 16bitの要素のみ)
+};
+
+/**
+ * @brief フレームの差分とライス符号によるチャンクの可逆圧縮。
+ * 要素ごとに同じ位置の前のフレームとの差を要素のビット数で折り返して求め、ジグザグ変換 (0, -1, 1, -2, ... を 0, 1, 2, 3, ...) した値を
+ * フレームごとに選んだパラメーターkのライス符号で書く。チャンクの先頭フレームは0との差なので、チャンクごとに単独で復号できる。
+ * スペクトルの符号は時間方向にゆっくり変わるため、差の多くは小さい値に集まる。
+ *
+ * ビット列は下位ビットから詰める。フレームごとに先頭の5bitがk、続いて要素ごとに
+ * 商 (値 >> k) の1の並びと終端の0、下位kビットを置く。商がEscape以上になる値はEscape個の1の後に値をそのまま置く。
+ */
+namespace frame_codec {
+	constexpr std::uint32_t Escape = 24;	/// 値をそのまま置く商の下限
+
+	/**
+	 * @brief count個のフレームを圧縮してoutの末尾に追加する。
+	 *
+	 * @param frames 連続したcount個のフレーム
+	 * @param count フレーム数
+	 * @param frame_values 1フレームの要素数
+	 * @param value_bytes 1要素のバイト数 (1 または 2)
+	 * @param out 出力先
+	 */
+	void encode_delta_rice(const std::byte* frames, std::uint32_t count, std::uint32_t frame_values, std::uint32_t value_bytes, std::vector<std::byte>& out);
+
+	/**
+	 * @brief encode_delta_riceで圧縮したチャンクを復号する。
+	 *
+	 * @param data 圧縮したチャンク
+	 * @param bytes dataのバイト数
+	 * @param out count * frame_values * value_bytes バイトの出力先
+	 * @throw std::runtime_error データが途中で終わっている場合
+	 */
+	void decode_delta_rice(const std::byte* data, std::size_t bytes, std::uint32_t count, std::uint32_t frame_values, std::uint32_t value_bytes, std::byte* out);
+}
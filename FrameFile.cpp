@@ -0,0 +1,314 @@
+﻿#include "pch.h"
+#include "FrameFile.h"
+#include "Json.h"
+#include "SpectrumQuantizer.h"
+
+static_assert(std::endian::native == std::endian::little, "frame files are little-endian");
+
+namespace {
+    bool known_type(std::uint32_t type) {
+        return type >= std::uint32_t(FrameDataType::Float32) && type <= std::uint32_t(FrameDataType::UInt8);
+    }
+
+    bool known_compression(std::uint32_t compression) {
+        return compression <= std::uint32_t(FrameCompression::DeltaRice);
+    }
+}
+
+std::uint32_t FrameFormat::element_bytes(FrameDataType type)
+{
+    switch (type)
+    {
+    case FrameDataType::Float32:
+    case FrameDataType::UInt32:
+        return 4;
+    case FrameDataType::Float16:
+    case FrameDataType::UInt16:
+        return 2;
+    case FrameDataType::UInt8:
+        return 1;
+    default:
+        throw std::invalid_argument("unknown frame data type");
+    }
+}
+
+FrameFileWriter::FrameFileWriter(const std::filesystem::path& path, FrameFormat format, FrameFileLayout layout, std::uint32_t chunk_frames)
+    : path(path), format(std::move(format)), layout(layout), frame_bytes(this->format.frame_bytes()), chunk_frames(chunk_frames),
+    buffer{ static_cast<std::byte*>(::operator new[](BufferSize, std::align_val_t(FrameFileHeader::DataOffset))) }
+{
+    if (frame_bytes == 0 || chunk_frames == 0) {
+        throw std::invalid_argument("invalid frame format");
+    }
+    if (this->format.compression != FrameCompression::None
+        && (layout != FrameFileLayout::Framed || FrameFormat::element_bytes(this->format.type) > 2)) {
+        throw std::invalid_argument("compression needs a framed file of 8 or 16 bit values");
+    }
+    // まとめて書き込むので、ストリームのバッファは使わない (openより前に設定する)
+    stream.rdbuf()->pubsetbuf(nullptr, 0);
+    stream.open(path, std::ios::trunc | std::ios::binary);
+    if (!stream) {
+        throw std::runtime_error("cannot create " + to_utf8(path));
+    }
+    if (layout == FrameFileLayout::Framed) {
+        // ヘッダーの領域を空けておき、closeで書き込む
+        std::fill_n(buffer.get(), FrameFileHeader::DataOffset, std::byte{ 0 });
+        used = FrameFileHeader::DataOffset;
+    }
+    chunk_offset = used;
+}
+
+FrameFileWriter::~FrameFileWriter()
+{
+    if (!closed) {
+        try {
+            close();
+        }
+        catch (...) {
+        }
+    }
+}
+
+void FrameFileWriter::flush()
+{
+    if (used == 0) return;
+    stream.write(reinterpret_cast<const char*>(buffer.get()), std::streamsize(used));
+    written += used;
+    used = 0;
+    if (!stream) {
+        throw std::runtime_error("failed to write " + to_utf8(path));
+    }
+}
+
+void FrameFileWriter::append(const std::byte* data, std::size_t bytes)
+{
+    if (used + bytes > BufferSize) {
+        flush();
+    }
+    if (bytes > BufferSize) {
+        stream.write(reinterpret_cast<const char*>(data), std::streamsize(bytes));
+        written += bytes;
+    }
+    else {
+        std::memcpy(buffer.get() + used, data, bytes);
+        used += bytes;
+    }
+}
+
+void FrameFileWriter::end_chunk()
+{
+    const std::uint64_t first = index.empty() ? 0 : index.back().first_frame + index.back().frames;
+    if (frames == first) return;
+    FrameChunkEntry entry{};
+    entry.first_frame = first;
+    entry.frames = static_cast<std::uint32_t>(frames - first);
+    if (format.compression == FrameCompression::DeltaRice) {
+        encoded.clear();
+        frame_codec::encode_delta_rice(pending.data(), entry.frames, format.channels * format.frame_size, FrameFormat::element_bytes(format.type), encoded);
+        pending.clear();
+        append(encoded.data(), encoded.size());
+    }
+    entry.offset = chunk_offset;
+    entry.bytes = written + used - chunk_offset;
+    chunk_offset = written + used;
+    index.push_back(entry);
+}
+
+void FrameFileWriter::write(const void* frame)
+{
+    const std::byte* data = static_cast<const std::byte*>(frame);
+    if (format.compression != FrameCompression::None) {
+        pending.insert(pending.end(), data, data + frame_bytes);
+    }
+    else {
+        append(data, frame_bytes);
+    }
+    ++frames;
+    if (layout == FrameFileLayout::Framed && frames % chunk_frames == 0) {
+        end_chunk();
+    }
+}
+
+void FrameFileWriter::close(float max_value, float min_value)
+{
+    if (closed) return;
+    closed = true;
+    if (layout == FrameFileLayout::Framed) {
+        end_chunk();
+        // 索引はマップしたまま参照するため、FrameChunkEntryの境界から始める
+        const std::array<std::byte, alignof(FrameChunkEntry)> zeros{};
+        append(zeros.data(), (alignof(FrameChunkEntry) - (written + used) % alignof(FrameChunkEntry)) % alignof(FrameChunkEntry));
+    }
+    flush();
+
+    if (layout == FrameFileLayout::Framed) {
+        FrameFileHeader header{};
+        std::copy(FrameFileHeader::Magic.begin(), FrameFileHeader::Magic.end(), header.magic);
+        header.version = FrameFileHeader::CurrentVersion;
+        header.header_size = FrameFileHeader::DataOffset;
+        header.type = static_cast<std::uint32_t>(format.type);
+        header.channels = format.channels;
+        header.frame_size = format.frame_size;
+        header.frame_bytes = frame_bytes;
+        header.frame_rate = format.frame_rate;
+        header.sample_rate = format.sample_rate;
+        header.transform_size = format.transform_size;
+        header.frame_count = frames;
+        header.index_offset = written;
+        header.chunk_frames = chunk_frames;
+        header.chunk_count = static_cast<std::uint32_t>(index.size());
+        header.max_value = max_value;
+        header.min_value = min_value;
+        header.scale = static_cast<std::uint32_t>(format.scale);
+        header.scale_min = format.scale_min;
+        header.scale_max = format.scale_max;
+        header.compression = static_cast<std::uint32_t>(format.compression);
+        std::copy_n(format.name.begin(), std::min<std::size_t>(format.name.size(), sizeof(header.name) - 1), header.name);
+
+        // 索引は末尾に、ヘッダーは先頭に書き込む
+        stream.write(reinterpret_cast<const char*>(index.data()), std::streamsize(index.size() * sizeof(FrameChunkEntry)));
+        stream.seekp(0);
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    stream.close();
+    if (!stream) {
+        throw std::runtime_error("failed to write " + to_utf8(path));
+    }
+}
+
+FrameFileReader::FrameFileReader(const std::filesystem::path& path) : file(path)
+{
+    if (file.size() < sizeof(FrameFileHeader)) {
+        throw std::runtime_error("not a frame file: " + to_utf8(path));
+    }
+    head = reinterpret_cast<const FrameFileHeader*>(file.data());
+    if (!std::equal(FrameFileHeader::Magic.begin(), FrameFileHeader::Magic.end(), head->magic)) {
+        throw std::runtime_error("not a frame file: " + to_utf8(path));
+    }
+    if (head->version == 0 || head->version > FrameFileHeader::CurrentVersion) {
+        throw std::runtime_error("unsupported frame file version: " + to_utf8(path));
+    }
+    if (head->index_offset == 0) {
+        throw std::runtime_error("incomplete frame file: " + to_utf8(path));
+    }
+
+    // 信頼できないファイルも開くため、フレームの位置と大きさの計算に使う値はここで全て確かめておく
+    // 要素の型と1フレームのバイト数は、read_frameの復号先やread_valuesの読み出す範囲を決める
+    const std::uint64_t values = std::uint64_t(head->channels) * head->frame_size;
+    if (head->header_size != FrameFileHeader::DataOffset || !known_type(head->type) || !known_compression(head->compression)
+        || values == 0 || head->frame_bytes != values * FrameFormat::element_bytes(type())
+        || (compression() != FrameCompression::None && FrameFormat::element_bytes(type()) > 2)) {
+        throw std::runtime_error("broken frame file header: " + to_utf8(path));
+    }
+    // index_offset + index_bytes は細工したファイルでは桁あふれするため、引き算で比べる
+    const std::uint64_t index_bytes = std::uint64_t(head->chunk_count) * sizeof(FrameChunkEntry);
+    if (head->index_offset < FrameFileHeader::DataOffset || head->index_offset % alignof(FrameChunkEntry) != 0
+        || index_bytes > file.size() || head->index_offset > file.size() - index_bytes || !(head->frame_rate > 0)) {
+        throw std::runtime_error("broken frame file: " + to_utf8(path));
+    }
+    index = { reinterpret_cast<const FrameChunkEntry*>(file.data() + head->index_offset), head->chunk_count };
+
+    if (head->chunk_frames == 0 || head->frame_count > std::uint64_t(head->chunk_count) * head->chunk_frames) {
+        throw std::runtime_error("broken frame file: " + to_utf8(path));
+    }
+    const bool compressed = compression() != FrameCompression::None;
+    const std::uint32_t element = FrameFormat::element_bytes(type());
+    for (std::size_t i = 0; i < index.size(); ++i) {
+        const FrameChunkEntry& e = index[i];
+        const std::uint64_t first = std::uint64_t(i) * head->chunk_frames;
+        const std::uint64_t expected = std::min<std::uint64_t>(head->chunk_frames, head->frame_count > first ? head->frame_count - first : 0);
+        // 圧縮していなければframe_asで要素の型のまま参照するため、要素の境界にそろっていること
+        const bool valid = e.offset >= FrameFileHeader::DataOffset && e.bytes <= head->index_offset && e.offset <= head->index_offset - e.bytes
+            && e.first_frame == first && e.frames >= expected && e.frames <= head->chunk_frames
+            && (compressed || (e.bytes >= std::uint64_t(e.frames) * head->frame_bytes && e.offset % element == 0));
+        if (!valid) {
+            throw std::runtime_error("broken frame file index: " + to_utf8(path));
+        }
+    }
+}
+
+const FrameChunkEntry& FrameFileReader::chunk_of(std::uint64_t k) const
+{
+    if (k >= head->frame_count) {
+        throw std::out_of_range("frame index out of range");
+    }
+    return index[std::size_t(k / head->chunk_frames)];
+}
+
+const std::byte* FrameFileReader::frame(std::uint64_t k) const
+{
+    if (compression() != FrameCompression::None) {
+        throw std::logic_error("compressed frame file; use read_frame");
+    }
+    const FrameChunkEntry& chunk = chunk_of(k);
+    return file.data() + chunk.offset + (k - chunk.first_frame) * head->frame_bytes;
+}
+
+void FrameFileReader::read_frame(std::uint64_t k, std::byte* out) const
+{
+    if (compression() == FrameCompression::None) {
+        std::memcpy(out, frame(k), head->frame_bytes);
+        return;
+    }
+    const FrameChunkEntry& chunk = chunk_of(k);
+    const std::size_t c = std::size_t(k / head->chunk_frames);
+    if (decoded_chunk != c) {
+        if (chunk.offset + chunk.bytes > file.size()) {
+            throw std::runtime_error("broken frame file chunk");
+        }
+        decoded.resize(std::size_t(chunk.frames) * head->frame_bytes);
+        frame_codec::decode_delta_rice(file.data() + chunk.offset, chunk.bytes, chunk.frames, frame_values(),
+            FrameFormat::element_bytes(type()), decoded.data());
+        decoded_chunk = c;
+    }
+    std::memcpy(out, decoded.data() + (k - chunk.first_frame) * head->frame_bytes, head->frame_bytes);
+}
+
+void FrameFileReader::read_values(std::uint64_t k, float* out) const
+{
+    const std::uint32_t n = frame_values();
+    const FrameDataType t = type();
+    if (t == FrameDataType::Float32) {
+        read_frame(k, reinterpret_cast<std::byte*>(out));
+        return;
+    }
+    std::vector<std::byte> raw(head->frame_bytes);
+    read_frame(k, raw.data());
+
+    const bool decibel = scale() == FrameScale::Decibel;
+    auto value = [&](std::uint32_t code, std::uint32_t max_code) {
+        return decibel ? SpectrumQuantizer::decode_decibel(code, head->scale_min, head->scale_max, max_code) : float(code);
+        };
+    for (std::uint32_t i = 0; i < n; ++i) {
+        switch (t)
+        {
+        case FrameDataType::UInt32: {
+            std::uint32_t v;
+            std::memcpy(&v, raw.data() + i * 4, 4);
+            out[i] = float(v);
+            break;
+        }
+        case FrameDataType::Float16: {
+            std::uint16_t v;
+            std::memcpy(&v, raw.data() + i * 2, 2);
+            out[i] = SpectrumQuantizer::half_to_float(v);
+            break;
+        }
+        case FrameDataType::UInt16: {
+            std::uint16_t v;
+            std::memcpy(&v, raw.data() + i * 2, 2);
+            out[i] = value(v, 0xFFFF);
+            break;
+        }
+        default:
+            out[i] = value(std::to_integer<std::uint32_t>(raw[i]), 0xFF);
+            break;
+        }
+    }
+}
+
+std::uint64_t FrameFileReader::frame_at(double seconds) const
+{
+    if (head->frame_count == 0 || seconds <= 0) return 0;
+    const std::uint64_t k = static_cast<std::uint64_t>(seconds * head->frame_rate);
+    return std::min(k, head->frame_count - 1);
+}
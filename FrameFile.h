@@ -0,0 +1,270 @@
+﻿#pragma once
+
+#include "FrameCodec.h"
+#include "MappedFile.h"
+
+/**
+ * @brief フレームファイルの要素の型
+ */
+enum class FrameDataType : std::uint32_t {
+	Float32 = 1,	/// IEEE 単精度浮動小数点
+	UInt32 = 2,		/// 32bit 符号なし整数
+	Float16 = 3,	/// IEEE 半精度浮動小数点
+	UInt16 = 4,		/// 16bit 符号なし整数
+	UInt8 = 5,		/// 8bit 符号なし整数
+};
+
+/**
+ * @brief 整数の要素と値の対応
+ */
+enum class FrameScale : std::uint32_t {
+	Linear = 0,		/// 要素がそのまま値
+	Decibel = 1,	/// 0は無音、1..最大の符号は [scale_min, scale_max] dB に線形に対応する振幅 (SpectrumQuantizer)
+};
+
+/**
+ * @brief フレームファイルの書き出し方
+ */
+enum class FrameFileLayout {
+	Raw,		/// ヘッダーと索引のない、フレームを並べただけのファイル (従来の .bin)
+	Framed,		/// ヘッダーとチャンクの索引を持つ自己記述的なファイル (.maf)
+};
+
+/**
+ * @brief フレームファイルに格納するデータの形式
+ */
+struct FrameFormat
+{
+	FrameDataType type = FrameDataType::Float32;
+	std::uint32_t channels = 1;			/// 1フレームに並ぶチャンネル数
+	std::uint32_t frame_size = 0;		/// 1チャンネルあたりの要素数
+	double frame_rate = 0;				/// 毎秒のフレーム数
+	std::uint32_t sample_rate = 0;		/// 解析したPCMのサンプリングレート
+	std::uint32_t transform_size = 0;	/// FFTの点数。FFTでなければ0
+	std::string name;					/// データの名前 (FFT_Lなど)。31バイトまで
+	FrameScale scale = FrameScale::Linear;	/// 整数の要素と値の対応
+	float scale_min = 0;				/// Decibel: 符号0の上限のdB値
+	float scale_max = 0;				/// Decibel: 最大の符号のdB値
+	FrameCompression compression = FrameCompression::None;	/// チャンクの圧縮方式 (Framedのみ)
+
+	/**
+	 * @brief 1要素のバイト数
+	 */
+	static std::uint32_t element_bytes(FrameDataType type);
+
+	/**
+	 * @brief 1フレームのバイト数
+	 */
+	std::uint32_t frame_bytes() const { return element_bytes(type) * channels * frame_size; }
+};
+
+/**
+ * @brief フレームファイル (.maf) の先頭に置くヘッダー。リトルエンディアン。
+ * ファイルは、ヘッダー (DataOffsetバイト)、フレームのデータ、チャンクの索引の順に並ぶ。
+ * データはページ境界から始まるため、マップしたファイルから要素の型のまま参照できる。
+ * frame_countとindex_offsetは書き込みの完了時に書き込まれ、0なら書き込みが完了していない。
+ * 圧縮したファイルではチャンクごとに圧縮したデータが並び、索引のbytesは圧縮後のバイト数になる。
+ * バージョン1のファイルではscale以降は予約領域で0が入っているため、Linearの圧縮しないファイルとして読める。
+ */
+struct FrameFileHeader
+{
+	static constexpr std::array<char, 8> Magic = { 'M', 'A', 'F', 'R', 'A', 'M', 'E', 'S' };
+	static constexpr std::uint32_t CurrentVersion = 2;
+	static constexpr std::uint32_t DataOffset = 4096;	/// 最初のチャンクの位置
+
+	char magic[8];					/// Magic
+	std::uint32_t version;			/// CurrentVersion
+	std::uint32_t header_size;		/// データの開始位置 (DataOffset)
+	std::uint32_t type;				/// FrameDataType
+	std::uint32_t channels;			/// 1フレームに並ぶチャンネル数
+	std::uint32_t frame_size;		/// 1チャンネルあたりの要素数
+	std::uint32_t frame_bytes;		/// 1フレームのバイト数
+	double frame_rate;				/// 毎秒のフレーム数
+	std::uint32_t sample_rate;		/// 解析したPCMのサンプリングレート
+	std::uint32_t transform_size;	/// FFTの点数。FFTでなければ0
+	std::uint64_t frame_count;		/// フレーム数
+	std::uint64_t index_offset;		/// チャンクの索引の位置 (FrameChunkEntryの境界、8の倍数)
+	std::uint32_t chunk_frames;		/// 1チャンクのフレーム数 (最後のチャンクは少ないことがある)
+	std::uint32_t chunk_count;		/// チャンク数
+	float max_value;				/// 値の最大値
+	float min_value;				/// 値の最小値
+	char name[32];					/// データの名前。0終端
+	std::uint32_t scale;			/// FrameScale (バージョン2から)
+	float scale_min;				/// Decibel: 符号0の上限のdB値
+	float scale_max;				/// Decibel: 最大の符号のdB値
+	std::uint32_t compression;		/// FrameCompression (バージョン2から)
+	std::uint8_t reserved[128];
+};
+static_assert(sizeof(FrameFileHeader) == 256 && std::is_standard_layout_v<FrameFileHeader>);
+
+/**
+ * @brief チャンクの索引の1項目
+ */
+struct FrameChunkEntry
+{
+	std::uint64_t offset;			/// ファイル先頭からのバイト位置
+	std::uint64_t bytes;			/// バイト数
+	std::uint64_t first_frame;		/// 先頭のフレーム番号
+	std::uint32_t frames;			/// フレーム数
+	std::uint32_t flags;			/// 予約 (0)
+};
+static_assert(sizeof(FrameChunkEntry) == 32);
+
+/**
+ * @class FrameFileWriter
+ * @brief 固定長のフレームを順に書き出す。
+ * ページ境界にそろえた大きなバッファにためてから書き込み、ストリーム側のバッファは使わない。
+ * Framedではchunk_framesフレームごとに索引を作り、closeでヘッダーと索引を書き込む。
+ * 圧縮する場合は1チャンク分のフレームをためておき、チャンクの終わりにまとめて圧縮して書き込む。
+ */
+class FrameFileWriter
+{
+	struct AlignedDelete {
+		void operator()(std::byte* p) const { ::operator delete[](p, std::align_val_t(FrameFileHeader::DataOffset)); }
+	};
+
+	std::ofstream stream;
+	const std::filesystem::path path;
+	const FrameFormat format;
+	const FrameFileLayout layout;
+	const std::uint32_t frame_bytes;
+	const std::uint32_t chunk_frames;
+	std::unique_ptr<std::byte[], AlignedDelete> buffer;	/// 書き込み待ちのデータ
+	std::size_t used = 0;								/// bufferに入っているバイト数
+	std::uint64_t written = 0;							/// ファイルに書き込んだバイト数 (ヘッダーを含む)
+	std::uint64_t frames = 0;							/// 書き込んだフレーム数
+	std::vector<FrameChunkEntry> index;					/// 完了したチャンクの索引
+	std::uint64_t chunk_offset = 0;						/// 書き込み中のチャンクの開始位置
+	std::vector<std::byte> pending;						/// 圧縮する場合の書き込み中のチャンクのフレーム
+	std::vector<std::byte> encoded;						/// 圧縮したチャンク
+	bool closed = false;
+
+	void flush();
+	void append(const std::byte* data, std::size_t bytes);
+	void end_chunk();
+
+public:
+	static constexpr std::size_t BufferSize = std::size_t(1) << 20;	/// 1回に書き込むバイト数
+
+	/**
+	 * @param path 出力先
+	 * @param format データの形式
+	 * @param layout 書き出し方
+	 * @param chunk_frames 1チャンクのフレーム数 (Framedのみ)
+	 * @throw std::runtime_error ファイルを作成できない場合
+	 * @throw std::invalid_argument 圧縮できない形式 (Raw、または8bit, 16bit以外の要素) で圧縮を指定した場合
+	 */
+	FrameFileWriter(const std::filesystem::path& path, FrameFormat format, FrameFileLayout layout = FrameFileLayout::Framed, std::uint32_t chunk_frames = 256);
+
+	/**
+	 * @brief 閉じていなければ閉じる。失敗しても例外は投げない。
+	 */
+	~FrameFileWriter();
+	FrameFileWriter(const FrameFileWriter&) = delete;
+	FrameFileWriter& operator=(const FrameFileWriter&) = delete;
+
+	/**
+	 * @brief 1フレームを書き込む。
+	 *
+	 * @param frame format.frame_bytes()バイトのフレーム
+	 */
+	void write(const void* frame);
+
+	/**
+	 * @brief 書き込んだフレーム数
+	 */
+	std::uint64_t frame_count() const { return frames; }
+
+	/**
+	 * @brief 残りを書き込み、Framedならヘッダーと索引を書き込んで閉じる。
+	 *
+	 * @param max_value ヘッダーに記録する最大値
+	 * @param min_value ヘッダーに記録する最小値
+	 * @throw std::runtime_error 書き込みに失敗した場合
+	 */
+	void close(float max_value = 0, float min_value = 0);
+};
+
+/**
+ * @class FrameFileReader
+ * @brief フレームファイル (.maf) をマップして読み出す。圧縮していなければ、フレームはコピーせずにファイルの内容を直接参照する。
+ * 圧縮したファイルはread_frameまたはread_valuesで読む。直前に復号したチャンクを保持するため、
+ * 圧縮したファイルを複数のスレッドから読む場合はスレッドごとにFrameFileReaderを作ること。
+ */
+class FrameFileReader
+{
+	MappedFile file;
+	const FrameFileHeader* head = nullptr;
+	std::span<const FrameChunkEntry> index;
+	mutable std::vector<std::byte> decoded;	/// 復号したチャンク
+	mutable std::size_t decoded_chunk = SIZE_MAX;	/// decodedのチャンク番号
+
+	// k番目のフレームを含むチャンクの索引
+	const FrameChunkEntry& chunk_of(std::uint64_t k) const;
+
+public:
+	/**
+	 * @param path フレームファイル
+	 * @throw std::runtime_error フレームファイルでない、書き込みが完了していない、またはヘッダーや索引が壊れている場合。
+	 * 要素の型や圧縮方式が未知のもの、frame_bytesが要素の型、チャンネル数、要素数と合わないもの、
+	 * 索引やチャンクがデータ領域の外を指すものは壊れているとみなす
+	 */
+	explicit FrameFileReader(const std::filesystem::path& path);
+
+	const FrameFileHeader& header() const { return *head; }
+	FrameDataType type() const { return static_cast<FrameDataType>(head->type); }
+	std::uint64_t frame_count() const { return head->frame_count; }
+	double frame_rate() const { return head->frame_rate; }
+	std::span<const FrameChunkEntry> chunks() const { return index; }
+	FrameScale scale() const { return static_cast<FrameScale>(head->scale); }
+	FrameCompression compression() const { return static_cast<FrameCompression>(head->compression); }
+
+	/**
+	 * @brief 1フレームの要素数 (全チャンネル分)
+	 */
+	std::uint32_t frame_values() const { return head->channels * head->frame_size; }
+
+	/**
+	 * @brief k番目のフレームの先頭。索引でチャンクを求め、その中の位置を返す。
+	 * @throw std::out_of_range kがフレーム数以上の場合
+	 * @throw std::logic_error 圧縮したファイルの場合
+	 */
+	const std::byte* frame(std::uint64_t k) const;
+
+	/**
+	 * @brief k番目のフレームをoutにコピーする。圧縮したファイルではチャンクを復号する。
+	 *
+	 * @param out header().frame_bytesバイトの出力先
+	 * @throw std::out_of_range kがフレーム数以上の場合
+	 */
+	void read_frame(std::uint64_t k, std::byte* out) const;
+
+	/**
+	 * @brief k番目のフレームの値をfloatで求める。半精度は単精度に、Decibelの符号は振幅に戻す。
+	 *
+	 * @param out frame_values()個の出力先
+	 * @throw std::out_of_range kがフレーム数以上の場合
+	 */
+	void read_values(std::uint64_t k, float* out) const;
+
+	/**
+	 * @brief k番目のフレームを要素の型で参照する。
+	 * @throw std::invalid_argument Elemがファイルの要素の型と異なる場合
+	 */
+	template<typename Elem>
+	const Elem* frame_as(std::uint64_t k) const {
+		static_assert(std::is_same_v<Elem, float> || std::is_same_v<Elem, std::uint32_t> || std::is_same_v<Elem, std::uint16_t> || std::is_same_v<Elem, std::uint8_t>);
+		constexpr FrameDataType expected = std::is_same_v<Elem, float> ? FrameDataType::Float32
+			: std::is_same_v<Elem, std::uint32_t> ? FrameDataType::UInt32
+			: std::is_same_v<Elem, std::uint16_t> ? FrameDataType::UInt16 : FrameDataType::UInt8;
+		if (type() != expected) {
+			throw std::invalid_argument("frame element type mismatch");
+		}
+		return reinterpret_cast<const Elem*>(frame(k));
+	}
+
+	/**
+	 * @brief 時刻 (秒) を含むフレームの番号。範囲外なら最初または最後のフレーム
+	 */
+	std::uint64_t frame_at(double seconds) const;
+};
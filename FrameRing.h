@@ -0,0 +1,203 @@
+﻿#pragma once
+
+/**
+ * @brief リングバッファが満杯のときに、新しいフレームをどう扱うか
+ */
+enum class OverflowPolicy {
+	Block,		/// 空きができるまで書き込み側を待たせる (バックプレッシャー)
+	Drop,		/// 新しいフレームを捨てて書き込み側を止めない。捨てた数はdropped()で取得できる
+};
+
+/**
+ * @class FrameRing
+ * @brief 固定長フレームを要素とする、1書き込みスレッド・1読み出しスレッド (SPSC) 用のロックフリーなリングバッファ。
+ * 標準のatomicのみを使い、容量は構築時に固定される。書き込み側はフレームの途中まで書き込んだ状態を持ち、
+ * フレームが埋まった時点で読み出し側に公開する。
+ *
+ * @tparam T フレームの要素のタイプ。
+ */
+template<typename T>
+class FrameRing
+{
+	static constexpr std::size_t CacheLine = 64;
+
+	const std::size_t frame_size;						/// 1フレームの要素数
+	const std::size_t capacity;							/// フレーム数
+	const OverflowPolicy policy;						/// 満杯のときの扱い
+	std::unique_ptr<T[]> buffer;						/// capacity + 1 フレーム分。最後の1フレームは捨てるフレームの書き込み先
+
+	/* 読み書きのスレッドが別々に更新する値は、互いのキャッシュラインを汚さないよう分けて置く */
+	alignas(CacheLine) std::atomic<std::uint64_t> head{ 0 };		/// 公開したフレーム数 (書き込み側が更新)
+	alignas(CacheLine) std::atomic<std::uint64_t> tail{ 0 };		/// 処理を終えたフレーム数 (読み出し側が更新)
+	alignas(CacheLine) std::atomic<std::uint32_t> signal{ 0 };	/// 読み出し側を起こすためのカウンタ
+	std::atomic<bool> closed{ false };							/// これ以上書き込まない
+	std::atomic<std::uint64_t> drop_count{ 0 };					/// 捨てたフレーム数
+
+	/* 書き込みスレッドだけが触る状態 */
+	alignas(CacheLine) T* writing = nullptr;			/// 書き込み中のフレーム
+	std::size_t filled = 0;								/// 書き込み中のフレームに入っている要素数
+	bool dropping = false;								/// 書き込み中のフレームを捨てるか
+
+	T* slot(std::uint64_t index) const {
+		return buffer.get() + (index % capacity) * frame_size;
+	}
+
+	// 次のフレームの書き込み先を決める。満杯ならポリシーに従って待つか捨てる
+	void begin_frame() {
+		const std::uint64_t h = head.load(std::memory_order_relaxed);
+		std::uint64_t t = tail.load(std::memory_order_acquire);
+		if (h - t >= capacity) {
+			if (policy == OverflowPolicy::Drop) {
+				writing = buffer.get() + capacity * frame_size;
+				dropping = true;
+				return;
+			}
+			do {
+				tail.wait(t, std::memory_order_acquire);
+				t = tail.load(std::memory_order_acquire);
+			} while (h - t >= capacity);
+		}
+		writing = slot(h);
+		dropping = false;
+	}
+
+	// 埋まったフレームを読み出し側に公開する
+	void end_frame() {
+		if (dropping) {
+			drop_count.fetch_add(1, std::memory_order_relaxed);
+		}
+		else {
+			head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			signal.fetch_add(1, std::memory_order_release);
+			signal.notify_one();
+		}
+		writing = nullptr;
+		filled = 0;
+	}
+public:
+	/**
+	 * @param frame_size 1フレームの要素数。
+	 * @param capacity 保持できるフレーム数。
+	 * @param policy 満杯のときの扱い。
+	 */
+	FrameRing(std::size_t frame_size, std::size_t capacity, OverflowPolicy policy = OverflowPolicy::Block)
+		: frame_size(frame_size), capacity(capacity), policy(policy), buffer{ std::make_unique<T[]>((capacity + 1) * frame_size) } {
+		if (frame_size == 0 || capacity == 0) {
+			throw std::invalid_argument("FrameRing needs a non-zero frame size and capacity");
+		}
+	}
+
+	FrameRing(const FrameRing&) = delete;
+	FrameRing& operator=(const FrameRing&) = delete;
+
+	/**
+	 * @brief (書き込み側) 値を1つ書き込む。
+	 */
+	void write(T value) {
+		write(&value, 1, 1);
+	}
+
+	/**
+	 * @brief (書き込み側) stride個おきの値をまとめて書き込む。フレームの境界をまたいでもよい。
+	 *
+	 * @param values 書き込む最初の値へのポインタ。
+	 * @param count 書き込む値の数。
+	 * @param stride 値の間隔 (要素数)。
+	 */
+	void write(const T* values, std::size_t count, std::size_t stride = 1) {
+		while (count > 0) {
+			if (writing == nullptr) begin_frame();
+
+			const std::size_t n = std::min(count, frame_size - filled);
+			if (stride == 1) {
+				std::copy_n(values, n, writing + filled);
+			}
+			else {
+				for (std::size_t i = 0; i < n; ++i) {
+					writing[filled + i] = values[i * stride];
+				}
+			}
+			filled += n;
+			values += n * stride;
+			count -= n;
+
+			if (filled == frame_size) end_frame();
+		}
+	}
+
+	/**
+	 * @brief (書き込み側) これ以上書き込まないことを読み出し側に知らせる。途中までのフレームは公開しない。
+	 */
+	void close() {
+		closed.store(true, std::memory_order_release);
+		signal.fetch_add(1, std::memory_order_release);
+		signal.notify_all();
+	}
+
+	/**
+	 * @brief (読み出し側) 先頭のフレームを取得する。pop()を呼ぶまで内容は書き換えられない。
+	 *
+	 * @return 先頭のフレーム。空の場合はnullptr。
+	 */
+	T* front() {
+		const std::uint64_t t = tail.load(std::memory_order_relaxed);
+		return t == head.load(std::memory_order_acquire) ? nullptr : slot(t);
+	}
+
+	/**
+	 * @brief (読み出し側) フレームが公開されるまで待って先頭のフレームを取得する。
+	 *
+	 * @return 先頭のフレーム。close()された後に空になった場合はnullptr。
+	 */
+	T* wait_front() {
+		while (true) {
+			const std::uint32_t s = signal.load(std::memory_order_acquire);
+			if (T* f = front()) return f;
+			if (closed.load(std::memory_order_acquire)) return front();
+			signal.wait(s, std::memory_order_acquire);
+		}
+	}
+
+	/**
+	 * @brief (読み出し側) 先頭のフレームの処理を終え、書き込み側に返す。
+	 */
+	void pop() {
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		tail.notify_all();
+	}
+
+	/**
+	 * @brief 公開済みのフレームが全て処理されるまで待つ。書き込み側のスレッドから呼び出す。
+	 */
+	void wait_empty() const {
+		const std::uint64_t h = head.load(std::memory_order_acquire);
+		std::uint64_t t = tail.load(std::memory_order_acquire);
+		while (t != h) {
+			tail.wait(t, std::memory_order_acquire);
+			t = tail.load(std::memory_order_acquire);
+		}
+	}
+
+	/**
+	 * @brief (書き込み側) 書き込み中のフレームが埋まるまでの要素数
+	 */
+	std::size_t space() const { return frame_size - filled; }
+
+	/**
+	 * @brief 公開済みで、まだ処理を終えていないフレーム数
+	 */
+	std::size_t pending() const {
+		const std::uint64_t t = tail.load(std::memory_order_acquire);
+		return std::size_t(head.load(std::memory_order_acquire) - t);
+	}
+
+	/**
+	 * @brief Dropポリシーで捨てたフレーム数
+	 */
+	std::uint64_t dropped() const { return drop_count.load(std::memory_order_relaxed); }
+
+	/**
+	 * @brief 1フレームの要素数
+	 */
+	std::size_t size() const { return frame_size; }
+};
@@ -0,0 +1,122 @@
+﻿#include "pch.h"
+#include "Json.h"
+
+namespace {
+    void write_string(std::string& out, const std::string& s) {
+        out += '"';
+        for (const char ch : s) {
+            const unsigned char c = static_cast<unsigned char>(ch);
+            switch (c)
+            {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                }
+                else {
+                    out += ch;
+                }
+                break;
+            }
+        }
+        out += '"';
+    }
+
+    void write_number(std::string& out, double d) {
+        if (!std::isfinite(d)) {
+            out += "null";
+            return;
+        }
+        // 元の値に戻る最短の表現で出力する (整数なら小数点は付かない)
+        char buf[32];
+        const auto result = std::to_chars(buf, buf + sizeof(buf), d);
+        out.append(buf, result.ptr);
+    }
+
+    void newline(std::string& out, bool pretty, int depth) {
+        if (!pretty) return;
+        out += '\n';
+        out.append(depth, '\t');
+    }
+}
+
+JsonValue& JsonValue::insert(std::string key, JsonValue v)
+{
+    Object* o = std::get_if<Object>(&value);
+    if (o == nullptr) {
+        throw std::logic_error("JsonValue is not an object");
+    }
+    for (auto& [k, existing] : *o) {
+        if (k == key) {
+            existing = std::move(v);
+            return existing;
+        }
+    }
+    return o->emplace_back(std::move(key), std::move(v)).second;
+}
+
+JsonValue& JsonValue::append(JsonValue v)
+{
+    Array* a = std::get_if<Array>(&value);
+    if (a == nullptr) {
+        throw std::logic_error("JsonValue is not an array");
+    }
+    return a->emplace_back(std::move(v));
+}
+
+std::string JsonValue::stringify(bool pretty) const
+{
+    std::string out;
+    write(out, pretty, 0);
+    return out;
+}
+
+void JsonValue::write(std::string& out, bool pretty, int depth) const
+{
+    if (std::holds_alternative<std::nullptr_t>(value)) {
+        out += "null";
+    }
+    else if (const bool* b = std::get_if<bool>(&value)) {
+        out += *b ? "true" : "false";
+    }
+    else if (const double* d = std::get_if<double>(&value)) {
+        write_number(out, *d);
+    }
+    else if (const std::string* s = std::get_if<std::string>(&value)) {
+        write_string(out, *s);
+    }
+    else if (const Array* a = std::get_if<Array>(&value)) {
+        out += '[';
+        for (std::size_t i = 0; i < a->size(); ++i) {
+            if (i != 0) out += ',';
+            newline(out, pretty, depth + 1);
+            (*a)[i].write(out, pretty, depth + 1);
+        }
+        if (!a->empty()) newline(out, pretty, depth);
+        out += ']';
+    }
+    else if (const Object* o = std::get_if<Object>(&value)) {
+        out += '{';
+        for (std::size_t i = 0; i < o->size(); ++i) {
+            if (i != 0) out += ',';
+            newline(out, pretty, depth + 1);
+            write_string(out, (*o)[i].first);
+            out += pretty ? ": " : ":";
+            (*o)[i].second.write(out, pretty, depth + 1);
+        }
+        if (!o->empty()) newline(out, pretty, depth);
+        out += '}';
+    }
+}
+
+std::string to_utf8(const std::filesystem::path& path)
+{
+    const std::u8string s = path.u8string();
+    return std::string(s.begin(), s.end());
+}
@@ -0,0 +1,64 @@
+﻿#pragma once
+
+/**
+ * @class JsonValue
+ * @brief Data.jsonなどを書き出すための小さなJSONの値。winrt::Windows::Data::Jsonに依存せずに出力する。
+ * オブジェクトのキーは追加した順に並ぶ。文字列はUTF-8として扱う。
+ */
+class JsonValue
+{
+public:
+	using Array = std::vector<JsonValue>;
+	using Object = std::vector<std::pair<std::string, JsonValue>>;
+
+private:
+	std::variant<std::nullptr_t, bool, double, std::string, Array, Object> value;
+
+	void write(std::string& out, bool pretty, int depth) const;
+
+public:
+	JsonValue(std::nullptr_t = nullptr) : value(nullptr) {}
+	JsonValue(bool b) : value(b) {}
+	template<typename N> requires std::is_arithmetic_v<N> && (!std::is_same_v<N, bool>)
+	JsonValue(N number) : value(static_cast<double>(number)) {}
+	JsonValue(std::string s) : value(std::move(s)) {}
+	JsonValue(const char* s) : value(std::string(s)) {}
+	JsonValue(Array a) : value(std::move(a)) {}
+	JsonValue(Object o) : value(std::move(o)) {}
+
+	/**
+	 * @brief 空のオブジェクトを作成する
+	 */
+	static JsonValue object() { return JsonValue(Object{}); }
+
+	/**
+	 * @brief 空の配列を作成する
+	 */
+	static JsonValue array() { return JsonValue(Array{}); }
+
+	/**
+	 * @brief オブジェクトに値を追加する。同じキーがあれば置き換える。
+	 * @return 追加した値
+	 * @throw std::logic_error オブジェクトでない場合
+	 */
+	JsonValue& insert(std::string key, JsonValue v);
+
+	/**
+	 * @brief 配列の末尾に値を追加する。
+	 * @return 追加した値
+	 * @throw std::logic_error 配列でない場合
+	 */
+	JsonValue& append(JsonValue v);
+
+	/**
+	 * @brief JSONの文字列に変換する。有限でない数値はnullとして出力する。
+	 *
+	 * @param pretty trueならタブでインデントし、要素ごとに改行する
+	 */
+	std::string stringify(bool pretty = false) const;
+};
+
+/**
+ * @brief パスをJsonValueの文字列 (UTF-8) に変換する
+ */
+std::string to_utf8(const std::filesystem::path& path);
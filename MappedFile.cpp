@@ -0,0 +1,77 @@
+﻿#include "pch.h"
+#include "MappedFile.h"
+#include "Json.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+    HANDLE h = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("cannot open " + to_utf8(path));
+    }
+    file = h;
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(h, &size)) {
+        CloseHandle(h);
+        throw std::runtime_error("cannot get the size of " + to_utf8(path));
+    }
+    length = static_cast<std::size_t>(size.QuadPart);
+    if (length == 0) return;   // 大きさ0のファイルはマップできない
+
+    mapping = CreateFileMappingW(h, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(h);
+        throw std::runtime_error("cannot map " + to_utf8(path));
+    }
+    base = static_cast<const std::byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (base == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(h);
+        throw std::runtime_error("cannot map " + to_utf8(path));
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (base != nullptr) UnmapViewOfFile(base);
+    if (mapping != nullptr) CloseHandle(mapping);
+    if (file != nullptr) CloseHandle(file);
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open " + to_utf8(path));
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("cannot get the size of " + to_utf8(path));
+    }
+    length = static_cast<std::size_t>(st.st_size);
+    if (length == 0) return;   // 大きさ0のファイルはマップできない
+
+    void* p = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("cannot map " + to_utf8(path));
+    }
+    base = static_cast<const std::byte*>(p);
+}
+
+MappedFile::~MappedFile()
+{
+    if (base != nullptr) ::munmap(const_cast<std::byte*>(base), length);
+    if (fd >= 0) ::close(fd);
+}
+#endif
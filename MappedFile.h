@@ -0,0 +1,30 @@
+﻿#pragma once
+
+/**
+ * @class MappedFile
+ * @brief ファイル全体を読み取り専用でメモリにマップする。内容はコピーせずにポインタで参照できる。
+ */
+class MappedFile
+{
+	const std::byte* base = nullptr;	/// マップした先頭
+	std::size_t length = 0;				/// ファイルのバイト数
+#ifdef _WIN32
+	void* file = nullptr;				/// ファイルのハンドル
+	void* mapping = nullptr;			/// ファイルマッピングのハンドル
+#else
+	int fd = -1;						/// ファイル記述子
+#endif
+
+public:
+	/**
+	 * @param path マップするファイル
+	 * @throw std::runtime_error 開けない、またはマップできない場合
+	 */
+	explicit MappedFile(const std::filesystem::path& path);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const std::byte* data() const { return base; }
+	std::size_t size() const { return length; }
+};
@@ -1,172 +1,128 @@
 #pragma once
 
+#include "FrameRing.h"
+#include "Executor.h"
+
 /**
- * @class Container
- * @brief T ^̔zێAݑT|[gėpReiBMemoryUtilŎgp邽߂̃NXB
+ * @class MemoryUtil
+ * @brief ܂ꂽlŒTCỸt[ɂ܂Ƃ߁AExecutorŏԂɏB
+ * t[͗eʌŒFrameRingɒuAݑƏ̓bN炸Ɏ󂯓nB
+ * 1MemoryUtil̃t[͓1ݏɏ邪AʁXMemoryUtil͕ɏB
+ * write1̃XbhĂяoƁB
  *
- * @tparam T ReiɊi[vf̃^CvB
+ * @tparam T t[Ɋi[vf̃^CvB
  */
 template<typename T>
-struct Container
+class MemoryUtil
 {
 	/**
-	 * @brief w肳ꂽTCỸRei\zB
-	 *
-	 * @param size ReĩTCYB
+	 * @brief ^XNƋLԁBMemoryUtil̔jɏI肩̃^XNGĂȂ悤A^XNLB
 	 */
-	Container(int size) : length(size) {
-		data = new T[size];
-	}
+	struct Shared {
+		std::function<void(T*)> action;			/// f[^ɑ΂čs
+		FrameRing<T> ring;						/// ҂̃t[
+		std::atomic<bool> scheduled{ false };	/// ^XNExecutorɓĂ邩
 
-	/**
-	 * @brief ReijÃ\[XB
-	 */
-	~Container() {
-		delete[] data;
-	}
+		Shared(std::function<void(T*)> act, std::size_t n, std::size_t capacity, OverflowPolicy policy)
+			: action(std::move(act)), ring(n, capacity, policy) {}
+	};
+
+	Executor& executor;					/// sExecutor
+	std::shared_ptr<Shared> shared;		/// ^XNƋL
 
 	/**
-	 * @brief ReiɒlށB
-	 * 
-	 * @param value ޒlB
+	 * @brief ҂̃t[ɂȂ܂ŏԂɏB
+	 * IOɏ܂ꂽt[肱ڂȂ悤Ascheduled낵ɂxmFB
 	 */
-	void write(T value) {
-		data[index.load()] = value;
-		index++;
+	static void drain(const std::shared_ptr<Shared>& s) {
+		while (true) {
+			while (T* frame = s->ring.front()) {
+				s->action(frame);
+				s->ring.pop();
+			}
+			s->scheduled.store(false, std::memory_order_seq_cst);
+			if (s->ring.pending() == 0 || s->scheduled.exchange(true, std::memory_order_seq_cst)) return;
+		}
 	}
 
+	// ҂̃t[A^XNĂȂΓ
+	void schedule() {
+		if (shared->ring.pending() != 0 && !shared->scheduled.exchange(true, std::memory_order_seq_cst)) {
+			executor.submit([s = shared]() { drain(s); });
+		}
+	}
+public:
 	/**
-	 * @brief ReiςǂmFB
+	 * @brief w肳ꂽTCYƏANV MemoryUtil \zB
 	 *
-	 * @return őTCYɒBꍇtrueAłȂꍇfalse
+	 * @param n et[̃TCYB
+	 * @param act tɂȂt[̃f[^ɑ΂ĎsANVB
+	 * @param capacity ҂ɂłt[B
+	 * @param policy ҂t̂Ƃ̈BBlockȂ珑ݑ҂ADropȂVt[̂ĂB
+	 * @param exe sExecutorBȗdefault_executor()
 	 */
-	bool is_max() {
-		return index.load() == length;
-	}	
+	MemoryUtil(int n, std::function<void(T*)> act, std::size_t capacity = 16, OverflowPolicy policy = OverflowPolicy::Block, Executor& exe = default_executor())
+		: executor(exe), shared{ std::make_shared<Shared>(std::move(act), n, capacity, policy) } {}
+
+	MemoryUtil(const MemoryUtil&) = delete;
+	MemoryUtil& operator=(const MemoryUtil&) = delete;
 
 	/**
-	 * @brief Rei󂩂ǂmFB
-	 *
-	 * @return ̏ꍇ trueAłȂꍇ false.
+	 * @brief ҂̃t[SďI܂ő҂B
 	 */
-	bool is_empty() {
-		return index.load() == 0;
+	~MemoryUtil() {
+		wait_all_processes_end();
 	}
 
 	/**
-	 * @brief Reĩf[^񓯊IɏB
+	 * @brief ݂̃t[ɒl݁AtɂȂt[ɉ񂷁B
 	 *
-	 * @param action Rei f[^ɑ΂ĎsANVB
-	 * @return 񓯊\ IAsyncActionB
+	 * @param value t[ɏޒlB
 	 */
-	winrt::Windows::Foundation::IAsyncAction Process(const std::function<void(T*)> action) {
-		co_await winrt::resume_background();
-		action(data);
-		index.store(0);
-
-		co_return;
+	void write(T value) {
+		shared->ring.write(value);
+		schedule();
 	}
-private:
-	const int length;							/// ReĩTCY
-	std::atomic_int index = std::atomic_int(0);	/// ݂̃CfbNX
-	T* data;									/// f[^̔z
-
-};
-
-/**
- * @class MemoryUtil
- * @brief T ^ Container CX^X̃RNVǗAXbhZ[tȏݑƔ񓯊sB
- *
- * @tparam T ReiɊi[vf̃^CvB
- */
-template<typename T>
-class MemoryUtil
-{
-	int size;												/// ReiTCY
-	std::function<void(T*)> action;							/// f[^ɑ΂čs
-	std::vector<std::shared_ptr<Container<T>>> resource;	/// Reĩ\[X
- 	std::shared_ptr<Container<T>> current;					/// ݂̃Rei
-	concurrency::concurrent_queue<std::weak_ptr<Container<T>>> exe_queue;	/// sL[
-	std::binary_semaphore can_running{ 1 };					/// 񓯊ǗZ}tH
-	std::mutex mtx;											/// ݂Ǘ~[ebNX
 
 	/**
-	 * @brief 񓯊̊A\ȏꍇ͎̃ReȉgK[B
+	 * @brief Al܂Ƃ߂ďށBt[̋E܂ꍇ́A
+	 * tɂȂt[ɉ񂵂Ăc̃t[ɏށB
 	 *
-	 * @param asyncInfo 񓯊\ IAsyncActionB
-	 * @param asyncStatus 񓯊̃Xe[^XB
+	 * @param values ޒl̐擪B
+	 * @param count ޒl̐B
 	 */
-	void ProcessCompletedHandler(winrt::Windows::Foundation::IAsyncAction const& asyncInfo, winrt::Windows::Foundation::AsyncStatus const asyncStatus) {
-		std::weak_ptr<Container<T>> next;
-
-		_RPT1(_CRT_WARN, "%p : 1 Container Processed, %d Container Left.\n", this, exe_queue.unsafe_size());
-
-		if (!exe_queue.try_pop(next)) {
-			can_running.release();
-			return;
-		}
+	void write(const T* values, std::size_t count) {
+		write(values, count, 1);
+	}
 
-		if (auto n = next.lock()) {
-			winrt::Windows::Foundation::IAsyncAction state = n->Process(action);
-			state.Completed({ this, &MemoryUtil<T>::ProcessCompletedHandler });
-		}
-	};
-public:
 	/**
-	 * @brief w肳ꂽTCYƏANV MemoryUtil \zB
+	 * @brief stride̒l܂Ƃ߂ďށBC^[[uꂽPCM1`loꍇɎgB
 	 *
-	 * @param n eReĩTCYB
-	 * @param act őɂȂReĩf[^ɑ΂ĎsANVB
+	 * @param values ލŏ̒lւ̃|C^B
+	 * @param count ޒl̐B
+	 * @param stride l̊Ԋu (vf)B
 	 */
-	MemoryUtil(int n, std::function<void(T*)> act) : size(n), action(act) {
-		current = std::make_shared<Container<T>>(size);
-		resource.push_back(current);
+	void write(const T* values, std::size_t count, std::size_t stride) {
+		// BlockŖt҂Oɏ^XNĂ悤At[̋EƂɊmF
+		while (count > 0) {
+			const std::size_t n = std::min(count, shared->ring.space());
+			shared->ring.write(values, n, stride);
+			schedule();
+			values += n * stride;
+			count -= n;
+		}
 	}
 
 	/**
-	 * @brief ݂̃Reiɒl݁At̃ReiǗAKvɉĔ񓯊JnB
-	 *
-	 * @param value ReiɏޒlB
+	 * @brief Drop|V[Ŏ̂Ăt[
 	 */
-	void write(T value) {
-		using namespace winrt::Windows::Foundation;
-
-		std::lock_guard<std::mutex> lock(mtx);
-
-		current->write(value);
-
-		if (current->is_max()) {
-
-			// ̊JnA܂͏L[ւ̒ǉ
-			if (can_running.try_acquire()) {
-				IAsyncAction state = current->Process(action);
-				state.Completed({ this, &MemoryUtil<T>::ProcessCompletedHandler });
-			}
-			else {
-				exe_queue.push(current);
-			}
-			
-			auto result = std::find_if(resource.begin(), resource.end(), [](const std::shared_ptr<Container<T>>& c) { return c->is_empty(); });
-			if (result == resource.end()) {
-
-				current = std::make_shared<Container<T>>(size);
-				resource.push_back(current);
-			}
-			else {
-				current = *result;
-			}
-		}
-	}
+	std::uint64_t dropped() const { return shared->ring.dropped(); }
 
 	/**
-	 * @brief ׂĂ̔񓯊vZX܂őҋ@B
-	 *
-	 * @return 񓯊\ IAsyncActionB
+	 * @brief ݍς݂̃t[Sď܂őҋ@Br܂ł̃t[͏ȂB
 	 */
-	winrt::Windows::Foundation::IAsyncAction wait_all_processes_end() {
-		co_await winrt::resume_background();
-		can_running.acquire();
-		can_running.release();
-		co_return;
+	void wait_all_processes_end() {
+		schedule();
+		shared->ring.wait_empty();
 	}
 };
@@ -0,0 +1,55 @@
+﻿#include "pch.h"
+#include "OfflineAnalysis.h"
+
+namespace {
+    std::unique_ptr<OfflineSource> not_null(std::unique_ptr<OfflineSource> src) {
+        if (!src) {
+            throw std::invalid_argument("source is null");
+        }
+        return src;
+    }
+}
+
+OfflineAnalysis::OfflineAnalysis(std::unique_ptr<OfflineSource> src, uint32_t quantum_frames)
+    : source(not_null(std::move(src))), quantum(quantum_frames), graph(source->channel_count(), source->sample_rate())
+{
+}
+
+void OfflineAnalysis::execute()
+{
+    const uint32_t channels = source->channel_count();
+    const uint32_t rate = source->sample_rate();
+    std::vector<float> block(size_t(quantum) * channels);
+
+    uint64_t position = 0;
+    while (uint32_t frames = source->read(block.data(), quantum)) {
+        TimeSpan ts = TimeSpan(static_cast<int64_t>(position * TimeSpan::period::den / rate));
+        graph.push(block.data(), frames, ts);
+        position += frames;
+    }
+    graph.end_of_stream();
+}
+
+const OfflineEncodingProperties OfflineAnalysis::get_graph_properties()
+{
+    return { source->channel_count(), source->sample_rate() };
+}
+
+const OfflineAnalysis::TimeSpan OfflineAnalysis::get_audio_duration()
+{
+    return TimeSpan(static_cast<int64_t>(source->frame_count() * TimeSpan::period::den / source->sample_rate()));
+}
+
+void OfflineAnalysis::add_outnode(Callback action, OfflineEncodingProperties const& properties)
+{
+    if (properties.channel_count == 0 || properties.sample_rate == 0) {
+        throw std::invalid_argument("invalid encoding properties");
+    }
+    // 音源と同じ形式ならsource()そのものが返り、変換もコピーもしない
+    const AnalysisGraph::Stream stream = graph.resample(graph.remix(graph.source(), properties.channel_count), properties.sample_rate);
+    graph.connect(stream, [action = std::move(action)](const AudioView& view) {
+        // 変換結果はグラフの領域、変換しなければexecuteの読み出し領域で、どちらもインターリーブされた連続領域
+        action(const_cast<float*>(view.data), view.frames * view.channels, view.ts);
+        });
+}
+
@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include "AudioFileSource.h"
+#include "AnalysisGraph.h"
+
+/**
+ * @brief OfflineAnalysisの出力形式。AudioEncodingPropertiesと同名のアクセサを持つ。
+ */
+struct OfflineEncodingProperties
+{
+    uint32_t channel_count = 0;
+    uint32_t sample_rate = 0;
+
+    uint32_t ChannelCount() const { return channel_count; }
+    void ChannelCount(uint32_t value) { channel_count = value; }
+    uint32_t SampleRate() const { return sample_rate; }
+    void SampleRate(uint32_t value) { sample_rate = value; }
+};
+
+/**
+ * @class OfflineAnalysis
+ * @brief OfflineSourceから読み出したPCMを、MusicAnalysisと同じ形式のコールバックへ流すクラス。
+ * AudioGraphのクロックを使わないため、CPUが処理できる速さで解析できる。
+ * 出力ノードごとのチャンネル数やサンプリングレートの変換は、内部のAnalysisGraphの派生ストリームで行う。
+ * 同じ形式の出力ノードは同じストリームを共有するため、変換はブロックごとに1回だけ行われる。
+ */
+class OfflineAnalysis
+{
+public:
+    /// winrt::Windows::Foundation::TimeSpanと同じ型 (100ns単位)
+    using TimeSpan = std::chrono::duration<int64_t, std::ratio<1, 10'000'000>>;
+    using Callback = std::function<void(float*, uint32_t, TimeSpan)>;
+
+private:
+    const std::unique_ptr<OfflineSource> source;    /// 音源
+    const uint32_t quantum;                         /// 1回に読み出すフレーム数
+    AnalysisGraph graph;                            /// 音源の形式から出力ノードの形式への変換
+
+public:
+    /**
+     * @param src 音源
+     * @param quantum_frames 1ブロックのフレーム数
+     */
+    OfflineAnalysis(std::unique_ptr<OfflineSource> src, uint32_t quantum_frames = 4096);
+    OfflineAnalysis() = delete;
+    OfflineAnalysis(const OfflineAnalysis&) = delete;
+    OfflineAnalysis(OfflineAnalysis&&) = delete;
+
+    /**
+     * @brief 音源の終端まで読み出し、登録されたコールバックを順に呼び出す。
+     * 終端まで処理し、リサンプリングのフィルターに残った分も出力してから戻る。
+     */
+    void execute();
+
+    /**
+     * @brief 音源の形式を取得する
+     * @return 音源のチャンネル数とサンプリングレート
+     */
+    const OfflineEncodingProperties get_graph_properties();
+
+    /**
+     * @brief 音声の長さを取得する
+     */
+    const TimeSpan get_audio_duration();
+
+    /**
+     * @brief 出力ノードを追加する
+     * @param action コールバック関数。(インターリーブされたPCM, float数, ブロック先頭の時刻)
+     * @param properties 出力形式。音源と異なればチャンネル数、サンプリングレートの順に変換する
+     * @throw std::invalid_argument チャンネル数またはサンプリングレートが0の場合
+     */
+    void add_outnode(Callback action, OfflineEncodingProperties const& properties);
+};
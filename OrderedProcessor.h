@@ -0,0 +1,170 @@
+﻿#pragma once
+
+#include "Executor.h"
+
+/**
+ * @class OrderedProcessor
+ * @brief 互いに独立なフレームを複数のスレッドで同時に処理し、結果は書き込み順に確定させる。
+ * 最大in_flight個のフレームをExecutorで並列に計算し、終わった結果は並べ替えバッファ (フレーム番号 % in_flight の枠) に置く。
+ * 先頭のフレームの結果がそろった時点で、続けてそろっている結果までを順番にcommitに渡す。
+ * 書き込み (acquire, submit, write) は1つのスレッドから呼び出すこと。commitは同時に1つずつ呼ばれる。
+ *
+ * @tparam T 入力フレームの要素のタイプ。
+ * @tparam R 結果の要素のタイプ。
+ */
+template<typename T, typename R>
+class OrderedProcessor
+{
+public:
+	using Compute = std::function<void(const T* input, R* result)>;			/// フレームごとの計算。並列に呼ばれる
+	using Commit = std::function<void(const R* result, std::uint64_t frame)>;	/// 結果の確定。フレーム番号順に呼ばれる
+
+private:
+	enum SlotState : int { Free, Running, Done };
+
+	/**
+	 * @brief 計算タスクと共有する状態。終わりかけのタスクが破棄後に触れても問題ないよう、タスク側も所有する。
+	 */
+	struct Shared {
+		const std::size_t input_size;
+		const std::size_t result_size;
+		const std::size_t in_flight;
+		Compute compute;
+		Commit commit;
+		std::unique_ptr<T[]> inputs;					/// in_flight個の入力フレーム
+		std::unique_ptr<R[]> results;					/// in_flight個の結果 (並べ替えバッファ)
+		std::unique_ptr<std::atomic<int>[]> states;		/// 枠ごとのSlotState
+		std::mutex commit_mtx;							/// 結果の確定を1スレッドずつにする
+		std::uint64_t next_commit = 0;					/// 次に確定するフレーム番号。commit_mtxで保護する
+		std::atomic<std::uint64_t> committed{ 0 };		/// 確定したフレーム数
+
+		Shared(std::size_t input_size, std::size_t result_size, std::size_t in_flight, Compute compute, Commit commit)
+			: input_size(input_size), result_size(result_size), in_flight(in_flight), compute(std::move(compute)), commit(std::move(commit)),
+			inputs{ std::make_unique<T[]>(input_size * in_flight) }, results{ std::make_unique<R[]>(result_size * in_flight) },
+			states{ std::make_unique<std::atomic<int>[]>(in_flight) } {
+			for (std::size_t i = 0; i < in_flight; ++i) states[i].store(Free);
+		}
+
+		// frame番目のフレームを計算し、先頭からそろっている結果を確定する
+		void run(std::uint64_t frame) {
+			const std::size_t index = std::size_t(frame % in_flight);
+			compute(inputs.get() + index * input_size, results.get() + index * result_size);
+			states[index].store(Done, std::memory_order_release);
+
+			std::lock_guard<std::mutex> lock(commit_mtx);
+			while (true) {
+				const std::size_t head = std::size_t(next_commit % in_flight);
+				if (states[head].load(std::memory_order_acquire) != Done) break;
+				commit(results.get() + head * result_size, next_commit);
+				++next_commit;
+				states[head].store(Free, std::memory_order_release);
+				states[head].notify_all();
+				committed.store(next_commit, std::memory_order_release);
+				committed.notify_all();
+			}
+		}
+	};
+
+	Executor& executor;
+	std::shared_ptr<Shared> shared;
+	std::uint64_t submitted = 0;		/// 計算に回したフレーム数
+	std::size_t filled = 0;				/// writeで書き込み中のフレームに入っている要素数
+	T* writing = nullptr;				/// writeで書き込み中のフレーム
+
+public:
+	/**
+	 * @param input_size 入力フレームの要素数。
+	 * @param result_size 結果の要素数。
+	 * @param in_flight 同時に処理中にできるフレーム数。並べ替えバッファの大きさでもある。
+	 * @param compute フレームごとの計算。
+	 * @param commit 結果の確定。フレーム番号順に1つずつ呼ばれる。
+	 * @param exe 計算を実行するExecutor。省略時はdefault_executor()
+	 */
+	OrderedProcessor(std::size_t input_size, std::size_t result_size, std::size_t in_flight, Compute compute, Commit commit, Executor& exe = default_executor())
+		: executor(exe), shared{ std::make_shared<Shared>(input_size, result_size, in_flight, std::move(compute), std::move(commit)) } {
+		if (input_size == 0 || in_flight == 0) {
+			throw std::invalid_argument("OrderedProcessor needs a non-zero frame size and in_flight");
+		}
+	}
+
+	OrderedProcessor(const OrderedProcessor&) = delete;
+	OrderedProcessor& operator=(const OrderedProcessor&) = delete;
+
+	/**
+	 * @brief 計算に回したフレームが全て確定するまで待つ。
+	 */
+	~OrderedProcessor() {
+		wait_all_processes_end();
+	}
+
+	/**
+	 * @brief 次のフレームの入力を書き込む領域を取得する。枠が処理中なら確定するまで待つ (バックプレッシャー)。
+	 *
+	 * @return input_size個の要素を書き込める領域。submitを呼ぶまで有効。
+	 */
+	T* acquire() {
+		const std::size_t index = std::size_t(submitted % shared->in_flight);
+		std::atomic<int>& state = shared->states[index];
+		for (int s = state.load(std::memory_order_acquire); s != Free; s = state.load(std::memory_order_acquire)) {
+			state.wait(s, std::memory_order_acquire);
+		}
+		return shared->inputs.get() + index * shared->input_size;
+	}
+
+	/**
+	 * @brief acquireで取得した領域のフレームを計算に回す。
+	 */
+	void submit() {
+		const std::uint64_t frame = submitted++;
+		shared->states[std::size_t(frame % shared->in_flight)].store(Running, std::memory_order_release);
+		executor.submit([s = shared, frame]() { s->run(frame); });
+	}
+
+	/**
+	 * @brief stride個おきの値をまとめて書き込み、input_size個たまるごとに計算に回す。
+	 *
+	 * @param values 書き込む最初の値へのポインタ。
+	 * @param count 書き込む値の数。
+	 * @param stride 値の間隔 (要素数)。
+	 */
+	void write(const T* values, std::size_t count, std::size_t stride = 1) {
+		while (count > 0) {
+			if (writing == nullptr) writing = acquire();
+
+			const std::size_t n = std::min(count, shared->input_size - filled);
+			if (stride == 1) {
+				std::copy_n(values, n, writing + filled);
+			}
+			else {
+				for (std::size_t i = 0; i < n; ++i) {
+					writing[filled + i] = values[i * stride];
+				}
+			}
+			filled += n;
+			values += n * stride;
+			count -= n;
+
+			if (filled == shared->input_size) {
+				submit();
+				writing = nullptr;
+				filled = 0;
+			}
+		}
+	}
+
+	/**
+	 * @brief 確定したフレーム数
+	 */
+	std::uint64_t committed() const { return shared->committed.load(std::memory_order_acquire); }
+
+	/**
+	 * @brief 計算に回したフレームが全て確定するまで待機する。writeで途中までのフレームは処理しない。
+	 */
+	void wait_all_processes_end() {
+		std::uint64_t c = shared->committed.load(std::memory_order_acquire);
+		while (c != submitted) {
+			shared->committed.wait(c, std::memory_order_acquire);
+			c = shared->committed.load(std::memory_order_acquire);
+		}
+	}
+};
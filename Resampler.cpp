@@ -0,0 +1,152 @@
+﻿#include "pch.h"
+#include "Resampler.h"
+
+namespace {
+    constexpr std::uint32_t BaseTaps = 32;     // 縮小しない場合のタップ数
+    constexpr double Rolloff = 0.94;           // 遮断周波数 (ナイキスト周波数に対する比)
+    constexpr double KaiserBeta = 8.6;         // 阻止域の減衰 約 -90dB
+
+    // 0次の第1種変形ベッセル関数 (級数展開)
+    double bessel_i0(double x) {
+        double sum = 1, term = 1;
+        const double q = x * x / 4;
+        for (int k = 1; k < 64 && term > sum * 1e-17; ++k) {
+            term *= q / (double(k) * k);
+            sum += term;
+        }
+        return sum;
+    }
+
+    std::shared_ptr<const PolyphaseTable> build_table(std::uint32_t up, std::uint32_t down) {
+        auto t = std::make_shared<PolyphaseTable>();
+        t->up = up;
+        t->down = down;
+        t->phases = std::min(up, PolyphaseTable::MaxPhases);
+
+        // ダウンサンプリングでは遮断周波数を下げる分、窓を広げる
+        const double ratio = std::min(1.0, double(up) / down);
+        const std::uint32_t taps = static_cast<std::uint32_t>(std::ceil(BaseTaps / ratio));
+        t->taps = (taps + 7) & ~7u;
+
+        const double fc = 0.5 * ratio * Rolloff;                   // 入力1サンプルあたりの周期数
+        const double half = t->taps / 2.0;
+        const double norm = bessel_i0(KaiserBeta);
+        t->coeffs.resize(size_t(t->phases) * t->taps);
+        for (std::uint32_t p = 0; p < t->phases; ++p) {
+            float* c = t->coeffs.data() + size_t(p) * t->taps;
+            const double frac = double(p) / t->phases;
+            double sum = 0;
+            for (std::uint32_t j = 0; j < t->taps; ++j) {
+                // タップjの入力と出力位置の距離 (入力サンプル単位)
+                const double d = double(j) - (half - 1) - frac;
+                const double x = 2 * fc * d;
+                const double sinc = x == 0 ? 1.0 : std::sin(std::numbers::pi * x) / (std::numbers::pi * x);
+                const double r = d / half;
+                const double w = r * r < 1 ? bessel_i0(KaiserBeta * std::sqrt(1 - r * r)) / norm : 0.0;
+                const double h = 2 * fc * sinc * w;
+                c[j] = static_cast<float>(h);
+                sum += h;
+            }
+            // 位相ごとに直流の利得を1にそろえる
+            for (std::uint32_t j = 0; j < t->taps; ++j) {
+                c[j] = static_cast<float>(c[j] / sum);
+            }
+        }
+        return t;
+    }
+}
+
+std::shared_ptr<const PolyphaseTable> PolyphaseTable::get(std::uint32_t in_rate, std::uint32_t out_rate)
+{
+    const std::uint32_t g = std::gcd(in_rate, out_rate);
+    const std::uint32_t up = out_rate / g;
+    const std::uint32_t down = in_rate / g;
+
+    static std::mutex mtx;
+    static std::map<std::pair<std::uint32_t, std::uint32_t>, std::shared_ptr<const PolyphaseTable>> cache;
+    std::lock_guard<std::mutex> lock(mtx);
+    auto& entry = cache[{ up, down }];
+    if (!entry) {
+        entry = build_table(up, down);
+    }
+    return entry;
+}
+
+PolyphaseResampler::PolyphaseResampler(std::uint32_t channels, std::uint32_t in_rate, std::uint32_t out_rate, SimdLevel level)
+    : channels(channels), table(PolyphaseTable::get(in_rate, out_rate)), dot(select_dot_kernel(level)), history(channels)
+{
+    if (channels == 0 || in_rate == 0 || out_rate == 0) {
+        throw std::invalid_argument("invalid resampler format");
+    }
+    reset();
+}
+
+void PolyphaseResampler::reset()
+{
+    // 最初の出力が入力の先頭に合うよう、先頭タップより前の分を0で埋めておく
+    for (auto& h : history) {
+        h.assign(table->taps / 2 - 1, 0.0f);
+    }
+    position = 0;
+    phase = 0;
+}
+
+std::uint32_t PolyphaseResampler::flush(std::vector<float>& out)
+{
+    // 最後の入力を中心とする出力には、その後ろにtaps / 2個の入力が要る
+    const std::uint32_t pad = table->taps / 2;
+    const std::vector<float> zeros(std::size_t(pad) * channels, 0.0f);
+    const std::uint32_t count = process(zeros.data(), channels, pad, out);
+    reset();
+    return count;
+}
+
+std::uint32_t PolyphaseResampler::process(const float* src, std::size_t stride, std::uint32_t frames, std::vector<float>& out)
+{
+    const PolyphaseTable& t = *table;
+
+    // チャンネルごとに連続した領域へ並べ替え、内積を連続したメモリで行えるようにする
+    for (std::uint32_t c = 0; c < channels; ++c) {
+        std::vector<float>& h = history[c];
+        const std::size_t old = h.size();
+        h.resize(old + frames);
+        for (std::uint32_t f = 0; f < frames; ++f) {
+            h[old + f] = src[f * stride + c];
+        }
+    }
+
+    const std::size_t available = history[0].size();
+    out.resize((std::size_t(double(frames) * t.up / t.down) + 2) * channels);
+    std::size_t count = 0;
+    for (;;) {
+        // 位相を表の最も近い位相に丸める。丸めた結果がphasesになれば次の入力の位相0と同じ
+        std::uint32_t p = phase;
+        std::size_t start = position;
+        if (t.phases != t.up) {
+            p = static_cast<std::uint32_t>((std::uint64_t(phase) * t.phases + t.up / 2) / t.up);
+            if (p == t.phases) {
+                p = 0;
+                ++start;
+            }
+        }
+        if (start + t.taps > available) break;
+
+        const float* coeff = t.coeffs.data() + size_t(p) * t.taps;
+        if (count + channels > out.size()) out.resize(out.size() * 2);
+        for (std::uint32_t c = 0; c < channels; ++c) {
+            out[count++] = dot(history[c].data() + start, coeff, t.taps);
+        }
+        phase += t.down;
+        position += phase / t.up;
+        phase %= t.up;
+    }
+    out.resize(count);
+
+    // 使い終わった入力を捨てる
+    const std::size_t consumed = std::min(position, available);
+    for (auto& h : history) {
+        h.erase(h.begin(), h.begin() + consumed);
+    }
+    position -= consumed;
+    return static_cast<std::uint32_t>(count / channels);
+}
@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include "DotKernels.h"
+
+/**
+ * @brief ポリフェーズリサンプラーのフィルター係数表。変換比ごとに1つだけ作り、全てのリサンプラーで共有する。
+ * 入力と出力のサンプリングレートの比を up / down (既約分数) とし、出力サンプルの入力上の位置の端数 p / up ごとに
+ * taps個のカイザー窓付きsincを並べる。
+ */
+struct PolyphaseTable
+{
+	static constexpr std::uint32_t MaxPhases = 4096;	/// 位相数の上限。upがこれを超える場合は最も近い位相で代用する
+
+	std::uint32_t up = 1;				/// 出力レート / gcd
+	std::uint32_t down = 1;				/// 入力レート / gcd
+	std::uint32_t phases = 1;			/// 表の位相数 (min(up, MaxPhases))
+	std::uint32_t taps = 0;				/// 位相あたりのタップ数 (8の倍数)
+	std::vector<float> coeffs;			/// phases * taps。位相ごとに連続して並ぶ
+
+	/**
+	 * @brief 変換比に対応する表を取得する。初回は作成し、以降はキャッシュしたものを返す。スレッドセーフ。
+	 */
+	static std::shared_ptr<const PolyphaseTable> get(std::uint32_t in_rate, std::uint32_t out_rate);
+};
+
+/**
+ * @class PolyphaseResampler
+ * @brief 窓付きsincのポリフェーズフィルターでサンプリングレートを変換する。
+ * ダウンサンプリングでは出力レートの半分より上を落としてから間引くため、折り返し雑音が出ない。
+ * ブロックをまたいで直前のtaps個の入力を保持し、ストリームとして連続に変換する。出力は入力に合わせて遅れずに出るが、最後のtaps / 2サンプル分はflushするまで出ない。
+ */
+class PolyphaseResampler
+{
+	const std::uint32_t channels;					/// チャンネル数
+	std::shared_ptr<const PolyphaseTable> table;	/// フィルター係数
+	const DotKernel dot;							/// SIMD段階に応じた内積
+	std::vector<std::vector<float>> history;		/// チャンネルごとの未使用の入力
+	std::size_t position = 0;						/// 次の出力の先頭タップに対応するhistoryの位置
+	std::uint32_t phase = 0;						/// 次の出力の位相 (0 <= phase < up)
+
+	void reset();
+
+public:
+	/**
+	 * @param channels チャンネル数
+	 * @param in_rate 入力のサンプリングレート
+	 * @param out_rate 出力のサンプリングレート
+	 * @param level 内積に使うSIMD段階。省略時はCPUIDと環境変数 MEDIAANALYSIS_SIMD から決める
+	 */
+	PolyphaseResampler(std::uint32_t channels, std::uint32_t in_rate, std::uint32_t out_rate, SimdLevel level = simd_level());
+
+	/**
+	 * @brief 1ブロック分を変換する。
+	 *
+	 * @param src 入力の先頭フレームへのポインタ。
+	 * @param stride 入力のフレーム間隔 (要素数)。インターリーブされた1チャンネル分なら元のチャンネル数。
+	 * @param frames 入力のフレーム数。
+	 * @param out 出力先。インターリーブした結果で置き換える。
+	 * @return 出力したフレーム数。
+	 */
+	std::uint32_t process(const float* src, std::size_t stride, std::uint32_t frames, std::vector<float>& out);
+
+	/**
+	 * @brief ストリームの終端で、フィルターの後ろ半分を0で埋めて残りの出力を求める。
+	 * 最後の入力サンプルの時刻までの出力がそろう。呼び出した後は作成直後の状態に戻り、次のストリームを変換できる。
+	 *
+	 * @param out 出力先。インターリーブした結果で置き換える。
+	 * @return 出力したフレーム数。
+	 */
+	std::uint32_t flush(std::vector<float>& out);
+};
@@ -0,0 +1,294 @@
+﻿#pragma once
+
+#include "FFTExecutor.h"
+#include "OrderedProcessor.h"
+#include "Filterbank.h"
+
+/**
+ * @brief PCMを逐次受け取り、ホップ長ごとに重なりのあるフレームをFFTする短時間フーリエ変換 (STFT) のステージ。
+ * 入力は元のサンプリングレートのまま受け取り、毎秒のフレーム数はホップ長で決める。
+ * ホップ長は sample_rate / frame_rate で、割り切れない場合はフレームごとに切り捨て、切り上げを混ぜて平均を合わせる。
+ *
+ * 直近Nサンプルを保持するリングバッファは同じ値を2か所 (i と i + N) に書く二重写しで、
+ * 最新のNサンプルが常に連続した領域になる。重なりがあってもフレームごとのコピーは発生しない。
+ * Executorを指定した場合は、各フレームを並べ替えバッファの枠に1回コピーして複数のスレッドで同時にFFTし、
+ * コールバックはフレーム番号順に1つずつ呼ぶ。
+ * SpectrumQuantizerを指定した場合は振幅を出力形式 (半精度、dBの符号など) に変換したバイト列を渡す。
+ * Filterbankを指定した場合は、変換と同じタスクの中で振幅を帯域にまとめて渡す。
+ * write は1つのスレッドから呼び出すこと。
+ *
+ * @tparam T FFT 計算用の浮動小数点型。
+ */
+template<std::floating_point T>
+class STFT
+{
+public:
+	/**
+	 * @brief 1フレーム分のスペクトルを受け取る関数。
+	 * l, r はそれぞれ N/2 個の振幅。モノラルの場合 r は nullptr。frame は先頭からのフレーム番号。
+	 */
+	using Callback = std::function<void(const T* l, const T* r, std::uint64_t frame)>;
+
+	/**
+	 * @brief 1フレーム分の変換したスペクトルを受け取る関数。
+	 * l, r はそれぞれ channel_bytes() バイト。モノラルの場合 r は nullptr。
+	 */
+	using EncodedCallback = std::function<void(const std::byte* l, const std::byte* r, std::uint64_t frame)>;
+
+	/**
+	 * @brief 変換したスペクトルの出力内容。1チャンネル分の結果は、ビン (binsが真の場合) の後に帯域 (filterbankがある場合) が続く。
+	 * quantizer, filterbankはSTFTより長く生存させること。どちらも T = float の場合のみ使える。
+	 */
+	struct Output {
+		const SpectrumQuantizer* quantizer = nullptr;	/// 振幅の変換。nullptrならTの振幅のまま
+		const Filterbank* filterbank = nullptr;			/// 帯域にまとめるフィルターバンク。nullptrなら帯域を出力しない
+		bool bins = true;								/// N/2個のビンを出力するか。偽にできるのはfilterbankがある場合のみ
+	};
+
+private:
+	const FFTExecutor<T>& executor;
+	const std::uint32_t channels;					/// チャンネル数 (1 または 2)
+	const std::uint32_t sample_rate;				/// 入力のサンプリングレート
+	const std::uint32_t frame_rate;					/// 毎秒のフレーム数
+	const Output output;							/// 出力内容
+	const std::size_t value_bytes;					/// 1つの値のバイト数
+	const std::size_t result_bytes;					/// 1チャンネル分の結果のバイト数
+	EncodedCallback callback;						/// フレームごとに呼び出す処理
+	std::vector<T> ring;							/// 二重写しのリングバッファ。2 * N * channels
+	std::vector<std::byte> spectrum;				/// 結果。result_bytes * channels
+	typename FFTExecutor<T>::Workspace workspace;	/// FFTの作業領域
+	std::uint32_t position = 0;						/// 次に書き込むリング上の位置 (最も古いサンプルの位置)
+	std::uint32_t filled = 0;						/// リングに入っているサンプル数 (N まで)
+	std::uint32_t until_next;						/// 次のフレームまでのサンプル数
+	std::uint32_t hop_remainder = 0;				/// ホップ長の端数の累積 (frame_rate 分の1サンプル単位)
+	std::uint64_t frame_count = 0;					/// 出力したフレーム数
+	std::unique_ptr<OrderedProcessor<T, std::byte>> parallel;	/// 並列に処理する場合の処理器
+
+	// 次のフレームまでのホップ長を求める
+	std::uint32_t next_hop() {
+		hop_remainder += sample_rate;
+		const std::uint32_t hop = hop_remainder / frame_rate;
+		hop_remainder %= frame_rate;
+		return hop;
+	}
+
+	// フレームを変換して l, r に書き込む。wsがnullptrならスレッドごとの作業領域を使う
+	void transform(const T* frame, std::byte* l, std::byte* r, typename FFTExecutor<T>::Workspace* ws) const {
+		if constexpr (std::is_same_v<T, float>) {
+			if (output.filterbank) {
+				transform_bands(frame, l, r, ws);
+				return;
+			}
+			if (output.quantizer) {
+				// 振幅は変換のループの中で出力形式にする
+				if (channels == 2) {
+					if (ws) executor.FFT_encoded(frame, frame + 1, 2, l, r, *output.quantizer, *ws);
+					else executor.FFT_encoded_stereo(frame, l, r, *output.quantizer);
+				}
+				else {
+					if (ws) executor.FFT_encoded(frame, l, *output.quantizer, *ws);
+					else executor.FFT_encoded(frame, l, *output.quantizer);
+				}
+				return;
+			}
+		}
+		magnitude(frame, reinterpret_cast<T*>(l), reinterpret_cast<T*>(r), ws);
+	}
+
+	// フレームの振幅を求める
+	void magnitude(const T* frame, T* l_result, T* r_result, typename FFTExecutor<T>::Workspace* ws) const {
+		if (channels == 2) {
+			if (ws) executor.FFT(frame, frame + 1, 2, l_result, r_result, *ws);
+			else executor.FFT_stereo(frame, l_result, r_result);
+		}
+		else {
+			if (ws) executor.FFT(frame, l_result, *ws);
+			else executor.FFT(frame, l_result);
+		}
+	}
+
+	// 振幅を求めてから帯域にまとめ、ビン (output.binsの場合) と帯域を出力形式で書き込む。T = float のみ
+	void transform_bands(const T* frame, std::byte* l, std::byte* r, typename FFTExecutor<T>::Workspace* ws) const {
+		const std::size_t half = executor.N >> 1;
+		const std::uint32_t bands = output.filterbank->bands();
+		T* values = thread_scratch(half * 2 + bands);
+		T* band = values + half * 2;
+		magnitude(frame, values, values + half, ws);
+
+		std::byte* const out[2] = { l, r };
+		for (std::uint32_t c = 0; c < channels; ++c) {
+			const T* m = values + half * c;
+			std::byte* dst = out[c];
+			if (output.bins) {
+				encode(m, half, dst);
+				dst += half * value_bytes;
+			}
+			output.filterbank->apply(m, band);
+			encode(band, bands, dst);
+		}
+	}
+
+	// n個の値を出力形式で書き込む
+	void encode(const T* values, std::size_t n, std::byte* out) const {
+		if (output.quantizer) output.quantizer->quantize(values, n, out);
+		else std::memcpy(out, values, n * sizeof(T));
+	}
+
+	// スレッドごとの振幅と帯域の作業領域
+	static T* thread_scratch(std::size_t size) {
+		thread_local std::vector<T> buffer;
+		if (buffer.size() < size) buffer.resize(size);
+		return buffer.data();
+	}
+
+	// リングの最新Nサンプルを変換してコールバックに渡す
+	void emit() {
+		const T* frame = ring.data() + std::size_t(position) * channels;
+		if (parallel) {
+			T* dst = parallel->acquire();
+			std::copy_n(frame, std::size_t(executor.N) * channels, dst);
+			parallel->submit();
+		}
+		else {
+			std::byte* r = channels == 2 ? spectrum.data() + result_bytes : nullptr;
+			transform(frame, spectrum.data(), r, &workspace);
+			callback(spectrum.data(), r, frame_count);
+		}
+		++frame_count;
+	}
+
+	// Tの振幅を受け取るコールバックをバイト列のコールバックに包む
+	static EncodedCallback wrap(Callback callback) {
+		return [callback = std::move(callback)](const std::byte* l, const std::byte* r, std::uint64_t frame) {
+			callback(reinterpret_cast<const T*>(l), reinterpret_cast<const T*>(r), frame);
+			};
+	}
+
+	// 変換を並列に行う処理器を作る
+	void start_parallel(Executor& pool, std::size_t in_flight) {
+		parallel = std::make_unique<OrderedProcessor<T, std::byte>>(std::size_t(executor.N) * channels, result_bytes * channels, in_flight,
+			[this](const T* frame, std::byte* result) {
+				transform(frame, result, channels == 2 ? result + result_bytes : nullptr, nullptr);
+			},
+			[this](const std::byte* result, std::uint64_t frame) {
+				callback(result, channels == 2 ? result + result_bytes : nullptr, frame);
+			}, pool);
+	}
+
+public:
+	/**
+	 * @param executor フレームの変換に使うFFTExecutor。フレーム長と窓関数はこれに従う。STFTより長く生存させること
+	 * @param channels 入力のチャンネル数。1 または 2 (L,R交互)
+	 * @param sample_rate 入力のサンプリングレート
+	 * @param frame_rate 毎秒のフレーム数
+	 * @param output 出力内容
+	 * @param callback フレームごとに呼び出す処理
+	 */
+	STFT(const FFTExecutor<T>& executor, std::uint32_t channels, std::uint32_t sample_rate, std::uint32_t frame_rate, const Output& output, EncodedCallback callback)
+		: executor(executor), channels(channels), sample_rate(sample_rate), frame_rate(frame_rate), output(output),
+		value_bytes(output.quantizer ? output.quantizer->bytes_per_value() : sizeof(T)),
+		result_bytes(value_bytes * ((output.bins ? executor.N >> 1 : 0) + (output.filterbank ? output.filterbank->bands() : 0))),
+		callback(std::move(callback)), ring(std::size_t(executor.N) * 2 * channels), spectrum(result_bytes * channels),
+		workspace(executor.make_workspace()), until_next(executor.N) {
+		if (channels != 1 && channels != 2) {
+			throw std::invalid_argument("STFT supports 1 or 2 channels");
+		}
+		if (frame_rate == 0 || sample_rate < frame_rate) {
+			throw std::invalid_argument("STFT hop length must be at least one sample");
+		}
+		if ((output.quantizer || output.filterbank) && !std::is_same_v<T, float>) {
+			throw std::invalid_argument("encoded spectra need STFT<float>");
+		}
+		if (output.filterbank ? output.filterbank->bins() != (executor.N >> 1) : !output.bins) {
+			throw std::invalid_argument("STFT output needs bins or a filterbank of the same transform size");
+		}
+	}
+
+	/**
+	 * @brief 出力内容を指定し、フレームを複数のスレッドで同時に変換するSTFTを構築する。コールバックはフレーム番号順に1つずつ呼ばれる。
+	 *
+	 * @param pool 変換を実行するExecutor
+	 * @param in_flight 同時に変換中にできるフレーム数
+	 */
+	STFT(const FFTExecutor<T>& executor, std::uint32_t channels, std::uint32_t sample_rate, std::uint32_t frame_rate, const Output& output, EncodedCallback callback, Executor& pool, std::size_t in_flight)
+		: STFT(executor, channels, sample_rate, frame_rate, output, std::move(callback)) {
+		start_parallel(pool, in_flight);
+	}
+
+	/**
+	 * @param callback N/2個の振幅を受け取る処理
+	 */
+	STFT(const FFTExecutor<T>& executor, std::uint32_t channels, std::uint32_t sample_rate, std::uint32_t frame_rate, Callback callback)
+		: STFT(executor, channels, sample_rate, frame_rate, Output{}, wrap(std::move(callback))) {}
+
+	/**
+	 * @brief フレームを複数のスレッドで同時に変換するSTFTを構築する。コールバックはフレーム番号順に1つずつ呼ばれる。
+	 *
+	 * @param pool 変換を実行するExecutor
+	 * @param in_flight 同時に変換中にできるフレーム数
+	 */
+	STFT(const FFTExecutor<T>& executor, std::uint32_t channels, std::uint32_t sample_rate, std::uint32_t frame_rate, Callback callback, Executor& pool, std::size_t in_flight)
+		: STFT(executor, channels, sample_rate, frame_rate, std::move(callback)) {
+		start_parallel(pool, in_flight);
+	}
+
+	STFT(const STFT&) = delete;
+	STFT& operator=(const STFT&) = delete;
+
+	/**
+	 * @brief 並列に処理している場合、変換に回したフレームが全てコールバックに渡るまで待つ。
+	 */
+	void wait_all_processes_end() {
+		if (parallel) parallel->wait_all_processes_end();
+	}
+
+	/**
+	 * @brief コールバックに渡す1チャンネル分の結果のバイト数
+	 */
+	std::size_t channel_bytes() const { return result_bytes; }
+
+	/**
+	 * @brief 平均のホップ長 (サンプル数)
+	 */
+	double hop() const { return double(sample_rate) / frame_rate; }
+
+	/**
+	 * @brief 出力したフレーム数
+	 */
+	std::uint64_t frames() const { return frame_count; }
+
+	/**
+	 * @brief PCMを追加し、ホップ長に達するごとにフレームを変換する。
+	 *
+	 * @param pcm チャンネル交互に並んだPCM。
+	 * @param count サンプル数 (チャンネルあたり)。
+	 */
+	void write(const T* pcm, std::size_t count) {
+		write(pcm, count, channels);
+	}
+
+	/**
+	 * @brief フレームの間隔を指定してPCMを追加する。AnalysisGraphのチャンネルを取り出したストリームなどに使う。
+	 *
+	 * @param pcm 先頭フレームの先頭チャンネルへのポインタ。フレーム内のチャンネルは連続している。
+	 * @param count サンプル数 (チャンネルあたり)。
+	 * @param stride フレームの間隔 (要素数)。channels以上。
+	 */
+	void write(const T* pcm, std::size_t count, std::size_t stride) {
+		const std::size_t mirror = std::size_t(executor.N) * channels;
+		for (std::size_t i = 0; i < count; ++i) {
+			T* dst = ring.data() + std::size_t(position) * channels;
+			const T* src = pcm + i * stride;
+			for (std::uint32_t c = 0; c < channels; ++c) {
+				dst[c] = dst[c + mirror] = src[c];
+			}
+			if (++position == executor.N) position = 0;
+			if (filled < executor.N) ++filled;
+
+			if (--until_next == 0) {
+				until_next = next_hop();
+				if (filled == executor.N) emit();
+			}
+		}
+	}
+};
@@ -0,0 +1,259 @@
+﻿#include "pch.h"
+#include "SpectrumQuantizer.h"
+
+namespace {
+    constexpr float DbPerLog2 = 6.020599913279624f;     // 20 * log10(2)
+    constexpr float Sqrt2 = 1.41421356237309505f;
+
+    // 振幅のdB値の符号。SIMD版と同じ式で求める
+    // log2は [√½, √2) に寄せた仮数mについて s = (m - 1) / (m + 1) の級数 2/ln2 (s + s^3/3 + s^5/5 + s^7/7) で求める
+    std::uint32_t decibel_code(float magnitude, const SpectrumQuantizer::Params& p) {
+        if (!(magnitude > p.min_magnitude)) return 0;
+        const std::uint32_t bits = std::bit_cast<std::uint32_t>(magnitude);
+        float e = float(int((bits >> 23) & 0xFF) - 127);
+        float m = std::bit_cast<float>((bits & 0x7FFFFF) | 0x3F800000);
+        if (m > Sqrt2) {
+            m *= 0.5f;
+            e += 1.0f;
+        }
+        const float s = (m - 1.0f) / (m + 1.0f);
+        const float s2 = s * s;
+        const float log2 = e + s * (2.8853900817779268f + s2 * (0.9617966939259756f + s2 * (0.5770780163555854f + s2 * 0.4121985831111325f)));
+        const float code = (log2 * DbPerLog2 - p.floor_db) * p.scale + 0.5f;
+        return code >= float(p.max_code) ? p.max_code : std::max<std::uint32_t>(1, static_cast<std::uint32_t>(code));
+    }
+
+    void quantize_f32(const float* magnitude, std::size_t n, std::byte* out, const SpectrumQuantizer::Params&) {
+        std::memcpy(out, magnitude, n * sizeof(float));
+    }
+
+    void quantize_f16_scalar(const float* magnitude, std::size_t n, std::byte* out, const SpectrumQuantizer::Params&) {
+        std::uint16_t* dst = reinterpret_cast<std::uint16_t*>(out);
+        for (std::size_t i = 0; i < n; ++i) dst[i] = SpectrumQuantizer::float_to_half(magnitude[i]);
+    }
+
+    template<typename Code>
+    void quantize_db_scalar(const float* magnitude, std::size_t n, std::byte* out, const SpectrumQuantizer::Params& p) {
+        Code* dst = reinterpret_cast<Code*>(out);
+        for (std::size_t i = 0; i < n; ++i) dst[i] = static_cast<Code>(decibel_code(magnitude[i], p));
+    }
+
+    MA_TARGET("avx2,f16c")
+    void quantize_f16_avx2(const float* magnitude, std::size_t n, std::byte* out, const SpectrumQuantizer::Params& p) {
+        std::uint16_t* dst = reinterpret_cast<std::uint16_t*>(out);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(magnitude + i), _MM_FROUND_TO_NEAREST_INT));
+        }
+        quantize_f16_scalar(magnitude + i, n - i, out + i * 2, p);
+    }
+
+    // 8個の振幅のdB値の符号 (32bit整数)
+    MA_TARGET("avx2")
+    __m256i decibel_code_avx2(__m256 x, const SpectrumQuantizer::Params& p) {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256i bits = _mm256_castps_si256(x);
+        __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+        __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x7FFFFF)), _mm256_set1_epi32(0x3F800000)));
+        const __m256 big = _mm256_cmp_ps(m, _mm256_set1_ps(Sqrt2), _CMP_GT_OQ);
+        m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+        e = _mm256_add_ps(e, _mm256_and_ps(big, one));
+
+        const __m256 s = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+        const __m256 s2 = _mm256_mul_ps(s, s);
+        __m256 poly = _mm256_add_ps(_mm256_set1_ps(0.5770780163555854f), _mm256_mul_ps(s2, _mm256_set1_ps(0.4121985831111325f)));
+        poly = _mm256_add_ps(_mm256_set1_ps(0.9617966939259756f), _mm256_mul_ps(s2, poly));
+        poly = _mm256_add_ps(_mm256_set1_ps(2.8853900817779268f), _mm256_mul_ps(s2, poly));
+        const __m256 log2 = _mm256_add_ps(e, _mm256_mul_ps(s, poly));
+
+        __m256 code = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(log2, _mm256_set1_ps(DbPerLog2)), _mm256_set1_ps(p.floor_db)), _mm256_set1_ps(p.scale)), _mm256_set1_ps(0.5f));
+        code = _mm256_min_ps(_mm256_max_ps(code, one), _mm256_set1_ps(float(p.max_code)));
+        // floor_db以下 (0、NaNを含む) は0
+        const __m256 audible = _mm256_cmp_ps(x, _mm256_set1_ps(p.min_magnitude), _CMP_GT_OQ);
+        return _mm256_and_si256(_mm256_cvttps_epi32(code), _mm256_castps_si256(audible));
+    }
+
+    MA_TARGET("avx2")
+    void quantize_db16_avx2(const float* magnitude, std::size_t n, std::byte* out, const SpectrumQuantizer::Params& p) {
+        std::uint16_t* dst = reinterpret_cast<std::uint16_t*>(out);
+        std::size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            const __m256i a = decibel_code_avx2(_mm256_loadu_ps(magnitude + i), p);
+            const __m256i b = decibel_code_avx2(_mm256_loadu_ps(magnitude + i + 8), p);
+            // packusはレーンごとに詰めるので、64bit単位で並べ直す
+            const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+        }
+        quantize_db_scalar<std::uint16_t>(magnitude + i, n - i, out + i * 2, p);
+    }
+
+    MA_TARGET("avx2")
+    void quantize_db8_avx2(const float* magnitude, std::size_t n, std::byte* out, const SpectrumQuantizer::Params& p) {
+        std::uint8_t* dst = reinterpret_cast<std::uint8_t*>(out);
+        std::size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            const __m256i a = decibel_code_avx2(_mm256_loadu_ps(magnitude + i), p);
+            const __m256i b = decibel_code_avx2(_mm256_loadu_ps(magnitude + i + 8), p);
+            const __m256i c = decibel_code_avx2(_mm256_loadu_ps(magnitude + i + 16), p);
+            const __m256i d = decibel_code_avx2(_mm256_loadu_ps(magnitude + i + 24), p);
+            const __m256i ab = _mm256_packus_epi32(a, b);
+            const __m256i cd = _mm256_packus_epi32(c, d);
+            const __m256i bytes = _mm256_packus_epi16(ab, cd);
+            // レーンごとの詰め込みで 0,2,4,6 / 1,3,5,7 番目の4要素組に分かれるので並べ直す
+            const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_permutevar8x32_epi32(bytes, order));
+        }
+        quantize_db_scalar<std::uint8_t>(magnitude + i, n - i, out + i, p);
+    }
+
+    SpectrumQuantizer::Kernel select_kernel(SpectrumEncoding encoding, SimdLevel level) {
+        const bool avx2 = level == SimdLevel::AVX2 || level == SimdLevel::AVX512;  // AVX2の段階はF16Cを含む
+        switch (encoding)
+        {
+        case SpectrumEncoding::Float16:
+            return avx2 ? &quantize_f16_avx2 : &quantize_f16_scalar;
+        case SpectrumEncoding::DecibelU16:
+            return avx2 ? &quantize_db16_avx2 : &quantize_db_scalar<std::uint16_t>;
+        case SpectrumEncoding::DecibelU8:
+            return avx2 ? &quantize_db8_avx2 : &quantize_db_scalar<std::uint8_t>;
+        default:
+            return &quantize_f32;
+        }
+    }
+
+    std::uint32_t max_code(SpectrumEncoding encoding) {
+        return encoding == SpectrumEncoding::DecibelU8 ? 0xFF : 0xFFFF;
+    }
+}
+
+const char* to_string(SpectrumEncoding encoding)
+{
+    switch (encoding)
+    {
+    case SpectrumEncoding::Float16: return "f16";
+    case SpectrumEncoding::DecibelU16: return "db16";
+    case SpectrumEncoding::DecibelU8: return "db8";
+    default: return "f32";
+    }
+}
+
+SpectrumQuantizer::SpectrumQuantizer(SpectrumEncoding encoding, float floor_db, float ceil_db, SimdLevel level)
+    : encoding(encoding), floor_db(floor_db), ceil_db(ceil_db),
+    params{ floor_db, float(max_code(encoding)) / (ceil_db - floor_db), std::pow(10.0f, floor_db / 20), max_code(encoding) },
+    kernel(select_kernel(encoding, level))
+{
+    // 下限の振幅が正規化数に収まる範囲に限る
+    if (!(floor_db < ceil_db) || floor_db < -700.0f || ceil_db > 700.0f) {
+        throw std::invalid_argument("invalid decibel range");
+    }
+}
+
+std::uint32_t SpectrumQuantizer::bytes_per_value(SpectrumEncoding encoding)
+{
+    switch (encoding)
+    {
+    case SpectrumEncoding::Float16:
+    case SpectrumEncoding::DecibelU16:
+        return 2;
+    case SpectrumEncoding::DecibelU8:
+        return 1;
+    default:
+        return 4;
+    }
+}
+
+float SpectrumQuantizer::max_value(const std::byte* values, std::size_t n) const
+{
+    if (n == 0) return 0;
+    switch (encoding)
+    {
+    case SpectrumEncoding::Float32: {
+        const float* v = reinterpret_cast<const float*>(values);
+        return *std::max_element(v, v + n);
+    }
+    case SpectrumEncoding::DecibelU8: {
+        const std::uint8_t* v = reinterpret_cast<const std::uint8_t*>(values);
+        return decode(reinterpret_cast<const std::byte*>(std::max_element(v, v + n)));
+    }
+    default: {
+        const std::uint16_t* v = reinterpret_cast<const std::uint16_t*>(values);
+        return decode(reinterpret_cast<const std::byte*>(std::max_element(v, v + n)));
+    }
+    }
+}
+
+float SpectrumQuantizer::decode(const std::byte* value) const
+{
+    switch (encoding)
+    {
+    case SpectrumEncoding::Float32: {
+        float v;
+        std::memcpy(&v, value, sizeof(v));
+        return v;
+    }
+    case SpectrumEncoding::Float16: {
+        std::uint16_t v;
+        std::memcpy(&v, value, sizeof(v));
+        return half_to_float(v);
+    }
+    case SpectrumEncoding::DecibelU16: {
+        std::uint16_t v;
+        std::memcpy(&v, value, sizeof(v));
+        return decode_decibel(v, floor_db, ceil_db, params.max_code);
+    }
+    default:
+        return decode_decibel(std::to_integer<std::uint32_t>(*value), floor_db, ceil_db, params.max_code);
+    }
+}
+
+float SpectrumQuantizer::decode_decibel(std::uint32_t code, float floor_db, float ceil_db, std::uint32_t max_code)
+{
+    if (code == 0) return 0;
+    const float db = floor_db + (ceil_db - floor_db) * float(code) / float(max_code);
+    return std::pow(10.0f, db / 20);
+}
+
+std::uint16_t SpectrumQuantizer::float_to_half(float value)
+{
+    const std::uint32_t bits = std::bit_cast<std::uint32_t>(value);
+    const std::uint16_t sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000);
+    const std::uint32_t abs = bits & 0x7FFFFFFF;
+
+    if (abs >= 0x7F800000) {                    // Inf, NaN
+        // NaNはF16Cと同じく、quiet NaNにして仮数の上位10bitを残す
+        return sign | (abs > 0x7F800000 ? 0x7E00 | static_cast<std::uint16_t>((abs >> 13) & 0x3FF) : 0x7C00);
+    }
+    if (abs >= 0x477FF000) {                    // 65520以上は丸めるとInf
+        return sign | 0x7C00;
+    }
+    if (abs < 0x38800000) {                     // 半精度の非正規化数 (2^-14未満)
+        if (abs < 0x33000000) return sign;      // 2^-25以下は0
+        const std::uint32_t mantissa = (abs & 0x7FFFFF) | 0x800000;
+        const int shift = 126 - int(abs >> 23);   // 14 + (127 - 指数) - 1
+        const std::uint32_t half = mantissa >> (shift + 0);
+        const std::uint32_t rest = mantissa & ((1u << shift) - 1);
+        const std::uint32_t mid = 1u << (shift - 1);
+        const std::uint32_t rounded = half + (rest > mid || (rest == mid && (half & 1)));
+        return sign | static_cast<std::uint16_t>(rounded);
+    }
+    // 正規化数。仮数の下位13bitを最近接偶数に丸める (桁上がりは指数に伝わる)
+    const std::uint32_t rebased = abs - 0x38000000;
+    const std::uint32_t rounded = rebased + 0xFFF + ((rebased >> 13) & 1);
+    return sign | static_cast<std::uint16_t>(rounded >> 13);
+}
+
+float SpectrumQuantizer::half_to_float(std::uint16_t value)
+{
+    const std::uint32_t sign = std::uint32_t(value & 0x8000) << 16;
+    const std::uint32_t exponent = (value >> 10) & 0x1F;
+    const std::uint32_t mantissa = value & 0x3FF;
+    if (exponent == 0) {
+        // 非正規化数と0は 仮数 * 2^-24
+        const float v = float(mantissa) * (1.0f / 16777216.0f);
+        return sign ? -v : v;
+    }
+    if (exponent == 0x1F) {
+        return std::bit_cast<float>(sign | 0x7F800000 | (mantissa << 13));
+    }
+    return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
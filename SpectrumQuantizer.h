@@ -0,0 +1,101 @@
+﻿#pragma once
+
+#include "CpuFeatures.h"
+
+/**
+ * @brief スペクトルの振幅の出力形式
+ */
+enum class SpectrumEncoding {
+	Float32,		/// IEEE 単精度浮動小数点 (従来の形式)
+	Float16,		/// IEEE 半精度浮動小数点
+	DecibelU16,		/// 振幅のdB値を16bitに量子化
+	DecibelU8,		/// 振幅のdB値を8bitに量子化
+};
+
+/**
+ * @brief 出力形式の名前 (f32 / f16 / db16 / db8)
+ */
+const char* to_string(SpectrumEncoding encoding);
+
+/**
+ * @class SpectrumQuantizer
+ * @brief FFTの振幅を出力形式に変換する。FFTExecutor::FFT_encodedが振幅のループの中で小さなブロックごとに呼び出す。
+ * dB形式では [floor_db, ceil_db] を 1..最大の符号 に線形に割り当て、floor_db以下 (無音を含む) は0にする。
+ * 変換の範囲は解析前に決まるため、全フレームの最大値を待たずに書き出せる。
+ */
+class SpectrumQuantizer
+{
+public:
+	/**
+	 * @brief 量子化の係数
+	 */
+	struct Params {
+		float floor_db;			/// 符号0の上限のdB値
+		float scale;			/// 1dBあたりの符号の増分
+		float min_magnitude;	/// floor_dbに対応する振幅。これ以下は0
+		std::uint32_t max_code;	/// 最大の符号
+	};
+
+	/// n個の振幅を変換してoutに書き込む関数
+	using Kernel = void (*)(const float* magnitude, std::size_t n, std::byte* out, const Params& params);
+
+	static constexpr float DefaultFloorDb = -100.0f;	/// 既定の下限。振幅1e-5
+	static constexpr float DefaultCeilDb = 60.0f;		/// 既定の上限。振幅1000 (1024点のFFTで最大振幅の正弦波は約48dB)
+
+	const SpectrumEncoding encoding;
+	const float floor_db;
+	const float ceil_db;
+
+private:
+	const Params params;
+	const Kernel kernel;
+
+public:
+	/**
+	 * @param encoding 出力形式
+	 * @param floor_db dB形式の下限
+	 * @param ceil_db dB形式の上限
+	 * @param level 変換に使うSIMD段階。省略時はCPUIDと環境変数 MEDIAANALYSIS_SIMD から決める
+	 * @throw std::invalid_argument 範囲が正しくない場合
+	 */
+	SpectrumQuantizer(SpectrumEncoding encoding, float floor_db = DefaultFloorDb, float ceil_db = DefaultCeilDb, SimdLevel level = simd_level());
+
+	/**
+	 * @brief 1つの値のバイト数
+	 */
+	std::uint32_t bytes_per_value() const { return bytes_per_value(encoding); }
+	static std::uint32_t bytes_per_value(SpectrumEncoding encoding);
+
+	/**
+	 * @brief dB形式か
+	 */
+	bool decibel() const { return encoding == SpectrumEncoding::DecibelU16 || encoding == SpectrumEncoding::DecibelU8; }
+
+	/**
+	 * @brief n個の振幅を変換する
+	 *
+	 * @param magnitude 振幅
+	 * @param n 個数
+	 * @param out n * bytes_per_value()バイトの出力先
+	 */
+	void quantize(const float* magnitude, std::size_t n, std::byte* out) const { kernel(magnitude, n, out, params); }
+
+	/**
+	 * @brief 変換したn個の値のうち最大のものを振幅に戻して返す。
+	 * 符号と半精度浮動小数点 (負でないもの) は大小関係が整数の大小関係と一致するので、整数のまま比べる。
+	 */
+	float max_value(const std::byte* values, std::size_t n) const;
+
+	/**
+	 * @brief 1つの値を振幅に戻す
+	 */
+	float decode(const std::byte* value) const;
+
+	/**
+	 * @brief dB形式の符号を振幅に戻す
+	 */
+	static float decode_decibel(std::uint32_t code, float floor_db, float ceil_db, std::uint32_t max_code);
+
+	static std::uint16_t float_to_half(float value);
+	static float half_to_float(std::uint16_t value);
+};
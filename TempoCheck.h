@@ -1,11 +1,34 @@
-#pragma once
+﻿#pragma once
+
+#include "FFTExecutor.h"
+#include "DotKernels.h"
+
+/**
+ * @brief BPMごとの強さの求め方
+ */
+enum class TempoMethod {
+	Direct,		/// BPMごとにcos, sinの表との内積でDFTを計算する。O(BPM数 * N)
+	ChirpZ,		/// BPMの範囲をチャープZ変換でまとめて計算する。O(L log L), L >= N + BPM数 - 1
+};
+
+/**
+ * @brief BPMごとの強さの極大1つ。極大が足りない場合の残りは全て0
+ */
+template<std::floating_point T>
+struct TempoPeak {
+	T bpm = 0;			/// 極大とその両隣の強さに放物線を当てはめて求めた小数のBPM
+	T strength = 0;		/// 放物線の頂点での強さ
+	T confidence = 0;	/// 探索範囲の全ての極大の強さの和に対するstrengthの割合 (0～1)
+};
 
 template<std::floating_point T>
 class TempoCheck
 {
-	std::vector<T> han_windows; 
+	std::shared_ptr<const T[]> han_windows;	/// N点のハン窓。FFTTableCacheで共有する
+	const DotKernel dot;	/// SIMD段階に応じた内積 (floatのみ)
+	std::vector<T> strength;	/// get_BPMのBPMごとの強さ。範囲が広がったときだけ確保し直す
 	T get_han_window(uint32_t value) const {
-		return han_windows[value < (N >> 1) ? value : N - value];
+		return han_windows[value];
 	}
 
 	void to_volume_diff(T* volume) {
@@ -20,50 +43,356 @@ class TempoCheck
 		}
 	}
 
+	/**
+	 * @brief チャープZ変換の計画。lower, upperが変わったときだけ作り直す。
+	 * BPM i の周波数 i / lower [Hz] は等間隔なので、X_m = Σ x_n A^n W^(nm) の形になり、
+	 * nm = (n^2 + m^2 - (m - n)^2) / 2 と分けるとL点FFTの畳み込み1回で全てのBPMが求まる。
+	 */
+	struct ChirpPlan {
+		uint32_t lower = 0;
+		uint32_t upper = 0;
+		std::unique_ptr<FFTExecutor<T>> fft;			/// L点のFFT
+		typename FFTExecutor<T>::Workspace ws;			/// fftの作業領域
+		std::vector<std::complex<T>> pre;				/// 入力にかける A^n W^(n^2 / 2)
+		std::vector<std::complex<T>> filter;			/// W^(-k^2 / 2) をFFTしたもの
+		std::vector<std::complex<T>> buffer;			/// 畳み込み用の領域
+	} plan;
+
+	void prepare_plan(uint32_t lower, uint32_t upper) {
+		if (plan.fft && plan.lower == lower && plan.upper == upper) return;
+
+		const uint32_t M = upper - lower;
+		uint32_t L = 1;
+		while (L < N + M - 1) L <<= 1;
+
+		// 位相は n^2 が大きくなるのでdoubleで求める
+		const double theta = -2.0 * std::numbers::pi / frame_sample_rate;	// 1Hzあたりの1サンプルの位相
+		const double start = 1.0;											// BPM lower の周波数 (lower / lower Hz)
+		const double step = 1.0 / lower;									// BPMが1増えたときの周波数の増分
+
+		plan.lower = lower;
+		plan.upper = upper;
+		plan.fft = std::make_unique<FFTExecutor<T>>(L);
+		plan.ws = plan.fft->make_workspace();
+		plan.pre.resize(N);
+		for (uint32_t n = 0; n < N; ++n) {
+			const double phase = theta * (start * n + step * 0.5 * double(n) * n);
+			plan.pre[n] = std::complex<T>(T(std::cos(phase)), T(std::sin(phase)));
+		}
+		plan.filter.assign(L, std::complex<T>(0));
+		auto chirp = [theta, step](int64_t k) {
+			const double phase = -theta * step * 0.5 * double(k) * double(k);
+			return std::complex<T>(T(std::cos(phase)), T(std::sin(phase)));
+		};
+		for (uint32_t k = 0; k < M; ++k) plan.filter[k] = chirp(k);
+		for (uint32_t k = 1; k < N; ++k) plan.filter[L - k] = chirp(-int64_t(k));
+		plan.fft->FFT_complex(plan.filter.data(), plan.ws);
+		plan.buffer.resize(L);
+	}
+
+	/**
+	 * @brief 直接DFTの表。lower, upperが変わったときだけ作り直す。
+	 * BPMごとに cos, sin を別の配列 (SoA) に長さstrideで並べ、強さは入力との内積2回で求める。
+	 * 内積のカーネルが8要素ずつ読むため、strideはNを8の倍数に切り上げ、余りは0で埋める。
+	 */
+	struct DirectPlan {
+		uint32_t lower = 0;
+		uint32_t upper = 0;
+		uint32_t stride = 0;
+		std::vector<T> cos;			/// (upper - lower) * stride。BPM lower + m の cos(φ_m n) が cos[m * stride + n]
+		std::vector<T> sin;			/// cosと同じ並びの sin(φ_m n)
+		std::vector<T> input;		/// stride個。0で埋めた入力の写し
+	} direct;
+
+	void prepare_direct(uint32_t lower, uint32_t upper) {
+		if (!direct.cos.empty() && direct.lower == lower && direct.upper == upper) return;
+
+		const uint32_t M = upper - lower;
+		const uint32_t stride = (N + 7) & ~7u;
+		const double theta = -2.0 * std::numbers::pi / frame_sample_rate;	// 1Hzあたりの1サンプルの位相
+
+		direct.lower = lower;
+		direct.upper = upper;
+		direct.stride = stride;
+		direct.cos.assign(std::size_t(M) * stride, T(0));
+		direct.sin.assign(std::size_t(M) * stride, T(0));
+		direct.input.assign(stride, T(0));
+		for (uint32_t m = 0; m < M; ++m) {
+			const double phi = theta * (lower + m) / lower;
+			T* c = direct.cos.data() + std::size_t(m) * stride;
+			T* s = direct.sin.data() + std::size_t(m) * stride;
+			for (uint32_t n = 0; n < N; ++n) {
+				c[n] = T(std::cos(phi * n));
+				s[n] = T(std::sin(phi * n));
+			}
+		}
+	}
+
+	T dot_product(const T* a, const T* b, uint32_t n) const {
+		if constexpr (std::is_same_v<T, float>) {
+			return dot(a, b, n);
+		}
+		else {
+			return std::inner_product(a, a + n, b, T(0));
+		}
+	}
+
+	// BPM lower..upper-1 の強さを表との内積で求める。三角関数も0の判定も内側のループに残さない
+	void strength_direct(const T* volume, uint32_t lower, uint32_t upper, T* out) {
+		prepare_direct(lower, upper);
+		const uint32_t stride = direct.stride;
+		std::copy(volume, volume + N, direct.input.begin());
+		const T* x = direct.input.data();
+		for (uint32_t m = 0; m < upper - lower; ++m) {
+			const T re = dot_product(x, direct.cos.data() + std::size_t(m) * stride, stride);
+			const T im = dot_product(x, direct.sin.data() + std::size_t(m) * stride, stride);
+			out[m] = std::sqrt(re * re + im * im);
+		}
+	}
+
+	// BPM lower..upper-1 の強さをチャープZ変換でまとめて求める
+	void strength_chirp_z(const T* volume, uint32_t lower, uint32_t upper, T* out) {
+		prepare_plan(lower, upper);
+		const uint32_t L = plan.fft->N;
+		std::complex<T>* y = plan.buffer.data();
+		for (uint32_t n = 0; n < N; ++n) {
+			y[n] = volume[n] * plan.pre[n];
+		}
+		std::fill(y + N, y + L, std::complex<T>(0));
+		plan.fft->FFT_complex(y, plan.ws);
+
+		// 逆FFTは共役を取って順FFTで行う。振幅だけが必要なので後ろの W^(m^2 / 2) は省ける
+		for (uint32_t k = 0; k < L; ++k) {
+			y[k] = std::conj(complex_mul(y[k], plan.filter[k]));
+		}
+		plan.fft->FFT_complex(y, plan.ws);
+		const T scale = T(1) / L;
+		for (uint32_t m = 0; m < upper - lower; ++m) {
+			out[m] = std::sqrt(std::norm(y[m])) * scale;
+		}
+	}
+
+	/**
+	 * @brief 強さの極大を大きい順にS個取り出す。
+	 * 上位S個はS要素の最小ヒープで保持するため、強さが同じ極大も区別して残る。
+	 * 両端は両隣がないため極大として扱わない。
+	 */
+	template <std::size_t S>
+	static std::array<TempoPeak<T>, S> pick_peaks(const T* strength, uint32_t lower, uint32_t upper) {
+		std::array<TempoPeak<T>, S> heap{};
+		std::size_t count = 0;
+		T total = 0;
+		auto greater = [](const TempoPeak<T>& a, const TempoPeak<T>& b) { return a.strength > b.strength; };
+		const uint32_t M = upper - lower;
+		for (uint32_t m = 1; m + 1 < M; ++m) {
+			const T a = strength[m - 1], b = strength[m], c = strength[m + 1];
+			if (!(b > a && b >= c)) continue;
+
+			// 3点を通る放物線の頂点。b > a, b >= c なので |p| <= 0.5
+			const T curvature = a - 2 * b + c;
+			const T p = curvature < 0 ? T(0.5) * (a - c) / curvature : T(0);
+			const TempoPeak<T> peak{ T(lower + m) + p, b - T(0.25) * (a - c) * p, 0 };
+			total += peak.strength;
+
+			if (count < S) {
+				heap[count++] = peak;
+				std::push_heap(heap.begin(), heap.begin() + count, greater);
+			}
+			else if (S > 0 && peak.strength > heap[0].strength) {
+				std::pop_heap(heap.begin(), heap.end(), greater);
+				heap[S - 1] = peak;
+				std::push_heap(heap.begin(), heap.end(), greater);
+			}
+		}
+
+		std::sort_heap(heap.begin(), heap.begin() + count, greater);
+		if (total > 0) {
+			for (std::size_t k = 0; k < count; ++k) heap[k].confidence = heap[k].strength / total;
+		}
+		return heap;
+	}
+
+public:
+	/**
+	 * @brief 逐次更新で使う、BPMの範囲ごとに決まる回転の表。内容は変更しないため、同じ設定のTempoCheck間で共有できる。
+	 */
+	struct TrackingTable {
+		uint32_t size = 0;							/// 作成したTempoCheckのN
+		T frame_sample_rate = 0;					/// 作成したTempoCheckのframe_sample_rate
+		uint32_t lower = 0;
+		uint32_t upper = 0;
+		std::vector<std::complex<double>> rotate;	/// BPMごとに3つずつ並んだ、窓を1つ進めたときの回転 e^(-iφ)
+		std::vector<std::complex<double>> tail;		/// 窓の末尾の位相 e^(iφ(N - 1))
+	};
+
+private:
+	/**
+	 * @brief 逐次更新 (スライディングDFT) の状態。
+	 * ハン窓は 0.5 - 0.25 e^(i2πn/N) - 0.25 e^(-i2πn/N) と書けるので、BPMごとに窓なしの和を周波数を
+	 * ±1/N ずらして3つ持てば、窓をかけたDFTが1フレームあたりO(BPM数)の更新で求まる。
+	 */
+	struct SlidingState {
+		uint32_t lower = 0;
+		uint32_t upper = 0;
+		std::shared_ptr<const TrackingTable> table;		/// 回転の表 (共有する)
+		std::vector<std::complex<double>> sums;		/// BPMごとに3つずつ並んだ窓なしの和
+		std::vector<T> history;						/// 窓内の音量の差分 (リングバッファ)
+		mutable std::vector<T> strength;			/// tracked_BPMのBPMごとの強さ。start_trackingで確保する
+		uint32_t position = 0;						/// historyの最も古い位置
+		uint32_t since_resync = 0;					/// 最後に和を計算し直してからのフレーム数
+		T previous = 0;								/// 直前の音量
+	} sliding;
+
+	// 丸め誤差がたまらないよう、窓内の値から和を直接計算し直す
+	void resync_sliding() {
+		for (std::size_t j = 0; j < sliding.sums.size(); ++j) {
+			const std::complex<double> step = std::conj(sliding.table->rotate[j]);	// e^(iφ)
+			std::complex<double> phase = 1.0;
+			std::complex<double> sum = 0.0;
+			for (uint32_t n = 0; n < N; ++n) {
+				sum += double(sliding.history[(sliding.position + n) % N]) * phase;
+				phase *= step;
+			}
+			sliding.sums[j] = sum;
+		}
+		sliding.since_resync = 0;
+	}
+
 public:
 	const uint32_t N;
 	const uint32_t frame_size;
 	const uint32_t sample_rate;
 	const T frame_sample_rate;
-	TempoCheck(uint32_t size, uint32_t frame_size, uint32_t sample_rate) : N(size), frame_size(frame_size), sample_rate(sample_rate), frame_sample_rate(T(sample_rate) / T(frame_size)), han_windows(size / 2 + 1) {
-		for (int i = 0; i < han_windows.size(); i++) {
-			han_windows[i] = T(0.5) - T(0.5) * std::cos(T(2.0) * std::numbers::pi_v<T> *i / N);
-		}
-	}
+	/**
+	 * @param size 音量の窓の長さN
+	 * @param frame_size 音量1フレームあたりのサンプル数
+	 * @param sample_rate サンプリングレート
+	 * @param level TempoMethod::Directの内積に使うSIMD段階。省略時はCPUIDと環境変数 MEDIAANALYSIS_SIMD から決める
+	 */
+	TempoCheck(uint32_t size, uint32_t frame_size, uint32_t sample_rate, SimdLevel level = simd_level()) : han_windows(FFTTableCache<T>::window(size, WindowType::Hann)), dot(select_dot_kernel(level)), N(size), frame_size(frame_size), sample_rate(sample_rate), frame_sample_rate(T(sample_rate) / T(frame_size)) {}
 
+	/**
+	 * @brief 音量の列から強いBPMを上位S個求める。BPMは整数の間隔で探索し、極大の周りを補間して小数まで求める。
+	 *
+	 * @param volume N個の音量。差分の計算に使われ、内容は破壊される
+	 * @param lower 探索するBPMの下限
+	 * @param upper 探索するBPMの上限 (含まない)
+	 * @param method BPMごとの強さの求め方。結果は誤差の範囲で一致する
+	 * @return 強さの大きい順に並んだ極大
+	 */
 	template <std::size_t S>
-	std::array<uint32_t, S> get_BPM(T* volume, uint32_t lower, uint32_t upper) {
+	std::array<TempoPeak<T>, S> get_BPM(T* volume, uint32_t lower, uint32_t upper, TempoMethod method = TempoMethod::ChirpZ) {
 		to_volume_diff(volume);
 
-		std::map<T, int> max;
-		T b_result = 0;
-		T b_slope = 0;
-		for (uint32_t i = lower; i < upper; ++i) {
-			std::complex<T> sum = 0;
-			T b = T(i) / lower;
-			T temp = T(-2.0) * std::numbers::pi_v<T> * b / frame_sample_rate;
-			for (uint32_t n = 0; n < N; ++n) {
-			 	if (volume[n] == 0) continue;
-				sum += volume[n] * std::polar(T(1.0), temp * n);
-			}
-			T result = std::abs(sum);
+		strength.resize(upper - lower);
+		if (method == TempoMethod::Direct) {
+			strength_direct(volume, lower, upper, strength.data());
+		}
+		else {
+			strength_chirp_z(volume, lower, upper, strength.data());
+		}
+
+		return pick_peaks<S>(strength.data(), lower, upper);
+	}
 
-			T slope = result - b_result;
-			if (b_slope > 0 && slope <= 0) {
-				max.try_emplace(result, i);
-				if (max.size() > S) max.erase(max.begin());
+	/**
+	 * @brief 逐次更新で使う回転の表を作成する。同じN, frame_sample_rateのTempoCheckであれば共有できる。
+	 *
+	 * @param lower 探索するBPMの下限
+	 * @param upper 探索するBPMの上限 (含まない)
+	 */
+	std::shared_ptr<const TrackingTable> make_tracking_table(uint32_t lower, uint32_t upper) const {
+		const uint32_t M = upper - lower;
+		auto table = std::make_shared<TrackingTable>();
+		table->size = N;
+		table->frame_sample_rate = frame_sample_rate;
+		table->lower = lower;
+		table->upper = upper;
+		table->rotate.resize(std::size_t(M) * 3);
+		table->tail.resize(std::size_t(M) * 3);
+
+		const double theta = -2.0 * std::numbers::pi / frame_sample_rate;
+		const double shift = 2.0 * std::numbers::pi / N;
+		for (uint32_t m = 0; m < M; ++m) {
+			const double base = theta * (lower + m) / lower;
+			const double phi[3] = { base, base + shift, base - shift };
+			for (int k = 0; k < 3; ++k) {
+				table->rotate[m * 3 + k] = std::polar(1.0, -phi[k]);
+				table->tail[m * 3 + k] = std::polar(1.0, phi[k] * (N - 1));
 			}
-			b_result = result;
-			b_slope = slope;
 		}
+		return table;
+	}
 
-		std::array<uint32_t, S> arr{};
-		int cnt = 0;
-		for (auto i = max.crbegin(); i != max.crend(); ++i) {
-			arr[cnt] = i->second;
-			cnt++;
+	/**
+	 * @brief 逐次更新モードを開始する。窓内の音量は0で初期化される。
+	 *
+	 * @param lower 探索するBPMの下限
+	 * @param upper 探索するBPMの上限 (含まない)
+	 */
+	void start_tracking(uint32_t lower, uint32_t upper) {
+		start_tracking(make_tracking_table(lower, upper));
+	}
+
+	/**
+	 * @brief 作成済みの回転の表を使って逐次更新モードを開始する。窓内の音量は0で初期化される。
+	 *
+	 * @param table make_tracking_tableで作成した表。同じN, frame_sample_rateのTempoCheckで作成したものに限る
+	 * @throw std::invalid_argument 表の設定が異なる場合
+	 */
+	void start_tracking(std::shared_ptr<const TrackingTable> table) {
+		if (!table || table->size != N || table->frame_sample_rate != frame_sample_rate) {
+			throw std::invalid_argument("tracking table does not match this TempoCheck");
 		}
-		return arr;
+		const uint32_t M = table->upper - table->lower;
+		sliding.lower = table->lower;
+		sliding.upper = table->upper;
+		sliding.table = std::move(table);
+		sliding.sums.assign(std::size_t(M) * 3, 0.0);
+		sliding.history.assign(N, T(0));
+		sliding.strength.assign(M, T(0));
+		sliding.position = 0;
+		sliding.since_resync = 0;
+		sliding.previous = 0;
 	}
-};
 
+	/**
+	 * @brief 逐次更新モードで音量を1フレーム追加し、窓を1つ進める。O(BPM数)
+	 * 差分と窓のかけ方はget_BPMと同じ。Nフレームごとに和を計算し直して誤差の蓄積を防ぐ。
+	 *
+	 * @param volume 音量
+	 */
+	void push(T volume) {
+		const T diff = volume - sliding.previous;
+		const T value = diff > 0 ? diff : T(0);
+		sliding.previous = volume;
+
+		const double old = sliding.history[sliding.position];
+		sliding.history[sliding.position] = value;
+		sliding.position = sliding.position + 1 == N ? 0 : sliding.position + 1;
+
+		if (++sliding.since_resync >= N) {
+			resync_sliding();
+			return;
+		}
+		const TrackingTable& table = *sliding.table;
+		for (std::size_t j = 0; j < sliding.sums.size(); ++j) {
+			sliding.sums[j] = (sliding.sums[j] - old) * table.rotate[j] + double(value) * table.tail[j];
+		}
+	}
+
+	/**
+	 * @brief 逐次更新モードで、現在の窓 (直近Nフレーム) の強いBPMを上位S個求める。O(BPM数)
+	 * 強さはstart_trackingで確保した領域に求めるため、メモリを確保しない。同じTempoCheckを複数スレッドから呼ばないこと。
+	 */
+	template <std::size_t S>
+	std::array<TempoPeak<T>, S> tracked_BPM() const {
+		const uint32_t M = sliding.upper - sliding.lower;
+		T* out = sliding.strength.data();
+		for (uint32_t m = 0; m < M; ++m) {
+			const std::complex<double>* s = sliding.sums.data() + m * 3;
+			out[m] = T(std::abs(0.5 * s[0] - 0.25 * s[1] - 0.25 * s[2]));
+		}
+		return pick_peaks<S>(out, sliding.lower, sliding.upper);
+	}
+};
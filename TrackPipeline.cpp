@@ -0,0 +1,285 @@
+﻿#include "pch.h"
+#include "TrackPipeline.h"
+
+namespace {
+    constexpr int FFTResultSize = FFT_N / 2;
+    constexpr std::size_t VolumeRingCapacity = 16;     // volume_memにためられるバッチ数
+    constexpr std::size_t GraphBlockFrames = 4096;     // AnalysisGraphの1ブロックの想定フレーム数
+
+    // STFTで同時に処理中にするフレーム数
+    std::size_t spectrum_in_flight(const Executor& pool) {
+        return pool.concurrency() * 2;
+    }
+
+    std::unique_ptr<const Filterbank> make_filterbank(const TrackOutputOptions& options, std::uint32_t sample_rate) {
+        if (options.band_count == 0) {
+            if (!options.bins) {
+                throw std::invalid_argument("output needs spectrum bins or bands");
+            }
+            return nullptr;
+        }
+        return std::make_unique<const Filterbank>(options.band_scale, options.band_count, FFT_N, sample_rate);
+    }
+}
+
+SharedAnalysisTables::SharedAnalysisTables()
+    : spectrum_fft(FFT_N, SpectrumWindow), volume_fft(BPMFFT_N),
+    tempo_table(TempoCheck<float>(BPMDataSize, BPMFFT_N, DisplayFrameRate * FFT_N).make_tracking_table(BPMLower, BPMUpper))
+{
+}
+
+JsonValue TrackSummary::to_json() const
+{
+    JsonValue j = JsonValue::object();
+    j.insert("source", to_utf8(source));
+    j.insert("output", to_utf8(output));
+    j.insert("succeeded", succeeded());
+    if (!succeeded()) {
+        j.insert("error", error);
+        return j;
+    }
+    j.insert("channels", channels);
+    j.insert("sampleRate", sample_rate);
+    j.insert("duration", duration);
+    j.insert("elapsed", elapsed);
+    j.insert("spectrumFrames", spectrum_frames);
+    j.insert("volumeFrames", volume_frames);
+    j.insert("bpm", bpm);
+    return j;
+}
+
+TrackPipeline::TrackPipeline(AnalysisGraph& graph, const std::filesystem::path& output, const SharedAnalysisTables& tables, const TrackOutputOptions& options, Executor& pool, Progress progress)
+    : tables(tables), out_path(output), started(std::chrono::steady_clock::now()),
+    channels(graph.channels(graph.source())), fft_sample_rate(graph.sample_rate(graph.source())), options(options),
+    quantizer(options.encoding, options.floor_db, options.ceil_db), filterbank(make_filterbank(options, fft_sample_rate)),
+    tempo(BPMDataSize, BPMFFT_N, DisplayFrameRate * FFT_N), bpm_votes(BPMUpper - BPMLower),
+    bpmFFT_result{ std::make_unique<float[]>(BPMFFT_N / 2 * VolumeBatch) },
+    // 重なりのあるフレームごとに、L,Rを1回の複素FFTで同時に変換する
+    // フレームは複数のスレッドで並列に変換し、ファイルへはフレーム順に書き込む
+    // 振幅は変換と同じループの中で出力形式にし、帯域へのまとめも変換と同じタスクで行う
+    stft(tables.spectrum_fft, 2, fft_sample_rate, SpectrumFrameRate, { &quantizer, filterbank.get(), options.bins }, [this](const std::byte* l_result, const std::byte* r_result, uint64_t) {
+        write_spectrum(l_result, r_result);
+        }, pool, spectrum_in_flight(pool)),
+    // VolumeBatchフレーム分をためてからまとめてFFTする
+    volume_mem(BPMFFT_N * VolumeBatch, [this](float* pcm) { process_volume(pcm); }, VolumeRingCapacity, OverflowPolicy::Block, pool)
+{
+    std::filesystem::create_directories(out_path);
+    constexpr double VolumeFrameRate = double(DisplayFrameRate) * FFT_N / BPMFFT_N;
+    if (options.bins) {
+        lStream = open("FFT_L", spectrum_format("FFT_L", FFTResultSize));
+        rStream = open("FFT_R", spectrum_format("FFT_R", FFTResultSize));
+    }
+    if (filterbank) {
+        lbStream = open("Bands_L", spectrum_format("Bands_L", filterbank->bands()));
+        rbStream = open("Bands_R", spectrum_format("Bands_R", filterbank->bands()));
+    }
+    tStream = open("BPM", { FrameDataType::UInt32, 1, BPMOutputCount, VolumeFrameRate, DisplayFrameRate * FFT_N, 0, "BPM" });
+    vStream = open("Volume", { FrameDataType::Float32, 1, 1, VolumeFrameRate, DisplayFrameRate * FFT_N, BPMFFT_N, "Volume" });
+
+    // 秒間(samplerate(第3引数) / framesize(第2引数))データ
+    // (size(第1引数) * framesize / samplerate)秒分のBPMを取得可能
+    // 直近BPMDataSizeフレームの窓を1フレームずつ進め、音量1フレームごとにBPMを出力する
+    tempo.start_tracking(tables.tempo_table);
+
+    graph.connect(graph.source(), [this](const AudioView& view) {
+        source_frames += view.frames;
+        });
+
+    // 元のサンプリングレートのまま、インターリーブされたL,Rを流す
+    const AnalysisGraph::Stream stereo = graph.remix(graph.source(), 2);
+    graph.connect(stereo, [this](const AudioView& view) {
+        stft.write(view.data, view.frames, view.stride);
+        });
+
+    // 音量への変換、BPM解析の実行
+    const AnalysisGraph::Stream mono = graph.resample(graph.remix(graph.source(), 1), DisplayFrameRate * FFT_N);
+    graph.connect(mono, [this, progress](const AudioView& view) {
+        volume_mem.write(view.data, view.frames, view.stride);
+        if (progress) progress(view.ts);  // 処理進捗の表示
+        });
+}
+
+std::unique_ptr<FrameFileWriter> TrackPipeline::open(const char* name, FrameFormat format) const
+{
+    const char* extension = options.layout == FrameFileLayout::Framed ? ".maf" : ".bin";
+    return std::make_unique<FrameFileWriter>(out_path / (std::string(name) + extension), std::move(format), options.layout);
+}
+
+FrameFormat TrackPipeline::spectrum_format(const char* name, std::uint32_t frame_size) const
+{
+    FrameFormat format{ FrameDataType::Float32, 1, frame_size, SpectrumFrameRate, fft_sample_rate, FFT_N, name };
+    switch (options.encoding)
+    {
+    case SpectrumEncoding::Float16:
+        format.type = FrameDataType::Float16;
+        break;
+    case SpectrumEncoding::DecibelU16:
+        format.type = FrameDataType::UInt16;
+        break;
+    case SpectrumEncoding::DecibelU8:
+        format.type = FrameDataType::UInt8;
+        break;
+    default:
+        break;
+    }
+    if (quantizer.decibel()) {
+        format.scale = FrameScale::Decibel;
+        format.scale_min = quantizer.floor_db;
+        format.scale_max = quantizer.ceil_db;
+    }
+    if (options.compress) {
+        format.compression = FrameCompression::DeltaRice;
+    }
+    return format;
+}
+
+void TrackPipeline::write_spectrum(const std::byte* l_result, const std::byte* r_result)
+{
+    write_channel(l_result, lStream.get(), lmax, lbStream.get(), lbmax);
+    write_channel(r_result, rStream.get(), rmax, rbStream.get(), rbmax);
+    ++spectrum_frames;
+}
+
+// 1チャンネル分の結果 (ビンの後に帯域) を書き込む
+void TrackPipeline::write_channel(const std::byte* result, FrameFileWriter* bins, float& bins_max, FrameFileWriter* bands, float& bands_max)
+{
+    if (bins) {
+        bins->write(result);
+        bins_max = std::max(bins_max, quantizer.max_value(result, FFTResultSize));
+        result += std::size_t(FFTResultSize) * quantizer.bytes_per_value();
+    }
+    if (bands) {
+        bands->write(result);
+        bands_max = std::max(bands_max, quantizer.max_value(result, filterbank->bands()));
+    }
+}
+
+void TrackPipeline::process_volume(float* pcm)
+{
+    tables.volume_fft.FFT_batch(pcm, VolumeBatch, bpmFFT_result.get());
+    for (uint32_t f = 0; f < VolumeBatch; ++f) {
+        /* 音量の生成 */
+        float sum = 0;
+        const float* spectrum = bpmFFT_result.get() + f * (BPMFFT_N / 2);
+        for (uint32_t i = 0; i < BPMFFT_N / 2; ++i) {
+            sum += spectrum[i] * spectrum[i];
+        }
+        float vol = std::sqrt(sum / BPMFFT_N);
+        if (vmax < vol) vmax = vol;
+        track_tempo(vol);
+    }
+}
+
+// BPMの取得、出力
+void TrackPipeline::track_tempo(float vol)
+{
+    vStream->write(&vol);
+
+    tempo.push(vol);
+    // BPM.binは整数のまま出力する。補間した小数のBPMは最も近い整数に丸める
+    const auto peaks = tempo.tracked_BPM<BPMOutputCount>();
+    std::array<unsigned int, BPMOutputCount> bpms;
+    std::transform(peaks.begin(), peaks.end(), bpms.begin(), [](const TempoPeak<float>& p) { return static_cast<unsigned int>(std::lround(p.bpm)); });
+    tStream->write(bpms.data());
+
+    // 窓が埋まるまでのBPMは集計しない
+    if (++volume_frames >= BPMDataSize && bpms[0] >= BPMLower && bpms[0] < BPMUpper) {
+        ++bpm_votes[bpms[0] - BPMLower];
+    }
+}
+
+JsonValue TrackPipeline::make_data_json() const
+{
+    JsonValue j = JsonValue::object();
+    j.insert("format", options.layout == FrameFileLayout::Framed ? "maf" : "raw");
+    JsonValue& f = j.insert("fft", JsonValue::object());
+    f.insert("size", FFT_N);
+    f.insert("perSecond", SpectrumFrameRate);
+    f.insert("sampleRate", fft_sample_rate);
+    f.insert("maxValue", lmax > rmax ? lmax : rmax);
+    f.insert("encoding", to_string(options.encoding));
+    if (quantizer.decibel()) {
+        JsonValue& range = f.insert("dbRange", JsonValue::array());
+        range.append(quantizer.floor_db);
+        range.append(quantizer.ceil_db);
+    }
+    f.insert("compression", options.compress ? "delta-rice" : "none");
+    f.insert("bins", options.bins);
+    if (filterbank) {
+        const FilterbankTable& table = filterbank->coefficients();
+        JsonValue& bands = j.insert("bands", JsonValue::object());
+        bands.insert("scale", to_string(table.scale));
+        bands.insert("count", table.bands);
+        bands.insert("perSecond", SpectrumFrameRate);
+        JsonValue& range = bands.insert("range", JsonValue::array());
+        range.append(table.min_freq);
+        range.append(table.max_freq);
+        JsonValue& centers = bands.insert("centers", JsonValue::array());
+        for (float c : table.centers) centers.append(c);
+        bands.insert("maxValue", lbmax > rbmax ? lbmax : rbmax);
+    }
+
+    JsonValue& b = j.insert("bpm", JsonValue::object());
+    JsonValue& bpmRange = b.insert("estRange", JsonValue::array());
+    bpmRange.append(BPMLower);
+    bpmRange.append(BPMUpper);
+    b.insert("estSection", BPMDataSize * BPMFFT_N / (DisplayFrameRate * FFT_N));
+    b.insert("count", BPMOutputCount);
+    b.insert("perSecond", DisplayFrameRate * FFT_N / BPMFFT_N);
+
+    JsonValue& v = j.insert("volume", JsonValue::object());
+    v.insert("perSecond", DisplayFrameRate * FFT_N / BPMFFT_N);
+    v.insert("maxValue", vmax);
+    return j;
+}
+
+TrackSummary TrackPipeline::finish()
+{
+    stft.wait_all_processes_end();
+    volume_mem.wait_all_processes_end();
+
+    if (lStream) {
+        lStream->close(lmax);
+        rStream->close(rmax);
+    }
+    if (lbStream) {
+        lbStream->close(lbmax);
+        rbStream->close(rbmax);
+    }
+    vStream->close(vmax);
+    tStream->close(BPMUpper - 1, 0);
+
+    TrackSummary summary;
+    summary.output = out_path;
+    summary.channels = channels;
+    summary.sample_rate = fft_sample_rate;
+    summary.duration = double(source_frames) / fft_sample_rate;
+    summary.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    summary.spectrum_frames = spectrum_frames;
+    summary.volume_frames = volume_frames;
+    summary.fft_max = lmax > rmax ? lmax : rmax;
+    summary.volume_max = vmax;
+    const auto top = std::max_element(bpm_votes.begin(), bpm_votes.end());
+    summary.bpm = *top > 0 ? BPMLower + static_cast<uint32_t>(top - bpm_votes.begin()) : 0;
+    summary.data = make_data_json();
+
+    std::ofstream json(out_path / L"Data.json", std::ios::trunc | std::ios::binary);
+    json << summary.data.stringify();
+    if (!json) {
+        throw std::runtime_error("failed to write " + to_utf8(out_path / L"Data.json"));
+    }
+    return summary;
+}
+
+std::uint64_t TrackPipeline::working_set(std::size_t concurrency)
+{
+    // STFT: 処理中のフレームごとにL,Rの入力2N個と結果N個、ミラーリングしたリングバッファ
+    const std::uint64_t spectrum = std::uint64_t(concurrency * 2) * (FFT_N * 2 + FFT_N) + FFT_N * 2 * 2;
+    // 音量: volume_memのリングバッファと、1バッチ分のFFTの結果
+    const std::uint64_t volume = std::uint64_t(VolumeRingCapacity) * BPMFFT_N * VolumeBatch + BPMFFT_N / 2 * VolumeBatch;
+    // AnalysisGraph: ステレオ、モノラル、リサンプリング後の各ブロック
+    const std::uint64_t graph = GraphBlockFrames * (2 + 1 + 1);
+    // BPM: 窓内の差分と、BPMごとの3つの和 (complex<double>)
+    const std::uint64_t bpm = BPMDataSize + std::uint64_t(BPMUpper - BPMLower) * 3 * 4;
+    return (spectrum + volume + graph + bpm) * sizeof(float);
+}
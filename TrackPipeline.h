@@ -0,0 +1,158 @@
+﻿#pragma once
+
+#include "FFTExecutor.h"
+#include "STFT.h"
+#include "AnalysisGraph.h"
+#include "MemoryUtil.h"
+#include "TempoCheck.h"
+#include "Json.h"
+#include "FrameFile.h"
+
+constexpr int FFT_N = 1024;
+constexpr int BPMDataSize = 480;
+constexpr int BPMFFT_N = 512;
+constexpr int VolumeBatch = 8;     // 音量計算でまとめてFFTするフレーム数
+constexpr int BPMOutputCount = 3;
+constexpr int BPMLower = 60;
+constexpr int BPMUpper = 270;
+constexpr int DisplayFrameRate = 30;       // 音量,BPM解析用の基準 (DisplayFrameRate * FFT_N Hzに変換する)
+constexpr int SpectrumFrameRate = 60;      // FFT_L.bin, FFT_R.binの毎秒フレーム数
+constexpr WindowType SpectrumWindow = WindowType::Hann;
+
+/**
+ * @brief 全てのトラックの解析で共有する表。一度だけ作成し、同時に解析する全てのTrackPipelineから参照する。
+ * FFTExecutorは作業領域を呼び出し側が持つため、constのまま複数スレッドから使える。
+ */
+struct SharedAnalysisTables
+{
+	const FFTExecutor<float> spectrum_fft;		/// L,RのFFT (FFT_N点)
+	const FFTExecutor<float> volume_fft;		/// 音量のFFT (BPMFFT_N点)
+	const std::shared_ptr<const TempoCheck<float>::TrackingTable> tempo_table;	/// BPMの逐次更新の回転の表
+
+	SharedAnalysisTables();
+};
+
+/**
+ * @brief TrackPipelineの出力の設定
+ */
+struct TrackOutputOptions
+{
+	FrameFileLayout layout = FrameFileLayout::Raw;	/// Rawなら従来の .bin、Framedならヘッダーと索引付きの .maf
+	SpectrumEncoding encoding = SpectrumEncoding::Float32;	/// FFT_L, FFT_Rの振幅の形式
+	bool compress = false;							/// FFT_L, FFT_Rのチャンクを圧縮する (Framedの8bit, 16bitの形式のみ)
+	float floor_db = SpectrumQuantizer::DefaultFloorDb;	/// dB形式の下限
+	float ceil_db = SpectrumQuantizer::DefaultCeilDb;	/// dB形式の上限
+	std::uint32_t band_count = 0;					/// Bands_L, Bands_Rの帯域数。0なら帯域を書き出さない
+	BandScale band_scale = BandScale::Mel;			/// 帯域の並べ方
+	bool bins = true;								/// FFT_L, FFT_Rを書き出すか。偽にできるのは帯域を書き出す場合のみ
+};
+
+/**
+ * @brief 1トラックの解析結果の概要。バッチ処理の集計に使う。
+ */
+struct TrackSummary
+{
+	std::filesystem::path source;		/// 入力ファイル
+	std::filesystem::path output;		/// 出力先フォルダー
+	std::string error;					/// 失敗した場合のエラー。成功なら空
+	uint32_t channels = 0;				/// 入力のチャンネル数
+	uint32_t sample_rate = 0;			/// 入力のサンプリングレート
+	double duration = 0;				/// 解析した長さ (秒)
+	double elapsed = 0;					/// 解析にかかった時間 (秒)
+	uint64_t spectrum_frames = 0;		/// FFT_L.bin, FFT_R.binのフレーム数
+	uint64_t volume_frames = 0;			/// Volume.bin, BPM.binのフレーム数
+	float fft_max = 0;					/// FFTの最大値
+	float volume_max = 0;				/// 音量の最大値
+	uint32_t bpm = 0;					/// 窓が埋まってから最も多く1位になったBPM。求まらなければ0
+	JsonValue data;						/// Data.jsonの内容
+
+	bool succeeded() const { return error.empty(); }
+
+	/**
+	 * @brief バッチ処理の集計に載せる1トラック分の値
+	 */
+	JsonValue to_json() const;
+};
+
+/**
+ * @class TrackPipeline
+ * @brief 1トラック分の解析処理 (L,RのFFT、音量、BPM) をAnalysisGraphにつなぎ、出力先フォルダーに
+ * FFT_L, FFT_R, Volume, BPM (.binまたは.maf) とData.jsonを書き出す。
+ * 帯域数を指定した場合は、L,RのFFTの振幅をフィルターバンクでまとめたBands_L, Bands_Rも (またはFFT_L, FFT_Rの代わりに) 書き出す。
+ * 音源 (MusicAnalysis, OfflineAnalysis) に依存しないため、バッチ処理では1ファイルごとに作成して同時に複数動かせる。
+ * graphより先に破棄しないこと。
+ */
+class TrackPipeline
+{
+public:
+	using TimeSpan = AudioView::TimeSpan;
+	using Progress = std::function<void(TimeSpan)>;	/// 音量・BPMのストリームのブロックごとに呼ばれる
+
+private:
+	const SharedAnalysisTables& tables;
+	const std::filesystem::path out_path;
+	const std::chrono::steady_clock::time_point started;
+	const uint32_t channels;
+	const uint32_t fft_sample_rate;
+
+	const TrackOutputOptions options;
+	const SpectrumQuantizer quantizer;				/// FFT_L, FFT_Rの振幅の変換
+	const std::unique_ptr<const Filterbank> filterbank;	/// 帯域を書き出さない場合はnullptr
+	std::unique_ptr<FrameFileWriter> lStream;
+	std::unique_ptr<FrameFileWriter> rStream;
+	std::unique_ptr<FrameFileWriter> lbStream;
+	std::unique_ptr<FrameFileWriter> rbStream;
+	std::unique_ptr<FrameFileWriter> vStream;
+	std::unique_ptr<FrameFileWriter> tStream;
+	float lmax = 0; // 検証用
+	float rmax = 0;
+	float lbmax = 0;
+	float rbmax = 0;
+	float vmax = 0;
+	uint64_t source_frames = 0;
+	uint64_t spectrum_frames = 0;
+	uint64_t volume_frames = 0;
+
+	TempoCheck<float> tempo;
+	std::vector<uint64_t> bpm_votes;				/// BPMごとの1位になったフレーム数
+	std::unique_ptr<float[]> bpmFFT_result;
+
+	STFT<float> stft;
+	MemoryUtil<float> volume_mem;
+
+	std::unique_ptr<FrameFileWriter> open(const char* name, FrameFormat format) const;
+	FrameFormat spectrum_format(const char* name, std::uint32_t frame_size) const;
+	void write_spectrum(const std::byte* l_result, const std::byte* r_result);
+	void write_channel(const std::byte* result, FrameFileWriter* bins, float& bins_max, FrameFileWriter* bands, float& bands_max);
+	void process_volume(float* pcm);
+	void track_tempo(float vol);
+	JsonValue make_data_json() const;
+
+public:
+	/**
+	 * @param graph 解析する音源のグラフ。必要な派生ストリームを作成して処理をつなぐ
+	 * @param output 出力先フォルダー。なければ作成する
+	 * @param tables 共有する表。TrackPipelineより長く存在すること
+	 * @param options 出力の設定
+	 * @param pool FFTを並列に実行するExecutor
+	 * @param progress 進捗の通知。省略可
+	 * @throw std::runtime_error 出力ファイルを作成できない場合
+	 * @throw std::invalid_argument 出力の設定が正しくない場合
+	 */
+	TrackPipeline(AnalysisGraph& graph, const std::filesystem::path& output, const SharedAnalysisTables& tables, const TrackOutputOptions& options = {}, Executor& pool = default_executor(), Progress progress = nullptr);
+	TrackPipeline(const TrackPipeline&) = delete;
+	TrackPipeline& operator=(const TrackPipeline&) = delete;
+
+	/**
+	 * @brief 音源を終端まで流した後に呼び出す。処理中のフレームを待ってファイルを閉じ、Data.jsonを書き出す。
+	 * @return 解析結果の概要
+	 */
+	TrackSummary finish();
+
+	/**
+	 * @brief 1トラックの解析が使うメモリの見積もり (バイト)。デコーダーの分は含まない。
+	 *
+	 * @param concurrency FFTを実行するExecutorの並列数
+	 */
+	static std::uint64_t working_set(std::size_t concurrency);
+};
@@ -0,0 +1,388 @@
+﻿#include "pch.h"
+#include "TrackPipeline.h"
+#include "OfflineAnalysis.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+// FFTExecutor, TempoCheck, MemoryUtilと解析全体の速度を測り、Google Benchmarkと同じ形のJSONを出力する。
+// 入力はすべて固定のシードから作るため、同じ設定なら毎回同じデータを処理する。
+//
+// 使い方: MediaAnalysisBench [--filter 文字列] [--min-time 秒] [--repetitions N] [--pin CPU] [--out ファイル] [--list]
+//   JSONは--outのファイル (省略時は標準出力) に、経過は標準エラーに出力する。
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::string filter;             // 名前にこの文字列を含むものだけ測る
+        double min_time = 0.5;          // 1回の計測の最短時間 (秒)
+        std::uint32_t repetitions = 3;  // 計測の繰り返し回数
+        int pin = -1;                   // 固定するCPU番号。負なら固定しない
+        std::filesystem::path out;      // JSONの出力先。空なら標準出力
+        bool list = false;              // 名前の一覧だけを出力する
+    };
+
+    /**
+     * @brief 1回の計測で処理した量
+     */
+    struct Work {
+        double items = 0;   // 処理した項目数 (フレーム、サンプルなど)
+        double bytes = 0;   // 処理したバイト数。0なら出力しない
+    };
+
+    /// iterations回処理して処理量を返す計測対象
+    using Body = std::function<Work(std::uint64_t iterations)>;
+
+    // プロセスのCPU時間 (秒)
+    double cpu_seconds() {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+        auto seconds = [](const FILETIME& t) { return ((std::uint64_t(t.dwHighDateTime) << 32) | t.dwLowDateTime) * 1e-7; };
+        return seconds(kernel) + seconds(user);
+#else
+        timespec ts{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+    }
+
+    // 呼び出したスレッドを1つのCPUに固定する
+    bool pin_thread(int cpu) {
+#ifdef _WIN32
+        return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#else
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+    }
+
+    std::string utc_now() {
+        const std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        std::tm tm{};
+#ifdef _WIN32
+        gmtime_s(&tm, &now);
+#else
+        gmtime_r(&now, &tm);
+#endif
+        char buf[32];
+        std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm);
+        return buf;
+    }
+
+    // 最適化で計算が消えないよう、結果を外から見える場所に書く
+    volatile float sink;
+
+    /**
+     * @brief 計測の実行と結果の収集。
+     * 1回の計測がmin_time以上になるまで繰り返し回数を増やしてから、同じ回数でrepetitions回計測し、各回と中央値を記録する。
+     */
+    class Runner {
+        const Options& options;
+        JsonValue results = JsonValue::array();
+
+        struct Sample {
+            std::uint64_t iterations;
+            double real;    // 経過時間 (秒)
+            double cpu;     // CPU時間 (秒)
+            Work work;
+        };
+
+        static Sample measure(const Body& body, std::uint64_t iterations) {
+            const double cpu0 = cpu_seconds();
+            const auto t0 = Clock::now();
+            const Work work = body(iterations);
+            const double real = std::chrono::duration<double>(Clock::now() - t0).count();
+            return { iterations, real, cpu_seconds() - cpu0, work };
+        }
+
+        JsonValue to_json(const std::string& name, const Sample& s, std::size_t repetition, const char* aggregate) const {
+            JsonValue j = JsonValue::object();
+            j.insert("name", aggregate ? name + "_" + aggregate : name);
+            j.insert("run_name", name);
+            j.insert("run_type", aggregate ? "aggregate" : "iteration");
+            j.insert("repetitions", options.repetitions);
+            j.insert("repetition_index", repetition);
+            if (aggregate) j.insert("aggregate_name", aggregate);
+            j.insert("iterations", s.iterations);
+            j.insert("real_time", s.real * 1e9 / s.iterations);
+            j.insert("cpu_time", s.cpu * 1e9 / s.iterations);
+            j.insert("time_unit", "ns");
+            j.insert("items_per_second", s.work.items / s.real);
+            if (s.work.bytes > 0) j.insert("bytes_per_second", s.work.bytes / s.real);
+            return j;
+        }
+
+    public:
+        explicit Runner(const Options& options) : options(options) {}
+
+        void run(const std::string& name, const Body& body) {
+            if (name.find(options.filter) == std::string::npos) return;
+            if (options.list) {
+                std::cout << name << "\n";
+                return;
+            }
+
+            std::uint64_t iterations = 1;
+            for (Sample s = measure(body, iterations); s.real < options.min_time; s = measure(body, iterations)) {
+                const double scale = s.real > 0 ? options.min_time * 1.4 / s.real : 10.0;
+                iterations = std::min<std::uint64_t>(std::max<std::uint64_t>(iterations * 2, std::uint64_t(iterations * scale)), 1'000'000'000);
+            }
+
+            std::vector<Sample> samples;
+            for (std::uint32_t r = 0; r < options.repetitions; ++r) {
+                samples.push_back(measure(body, iterations));
+                results.append(to_json(name, samples.back(), r, nullptr));
+            }
+            std::sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b) { return a.real < b.real; });
+            const Sample& median = samples[samples.size() / 2];
+            results.append(to_json(name, median, 0, "median"));
+
+            char line[160];
+            std::snprintf(line, sizeof(line), "%-40s %14.1f ns %14.4g items/s\n", name.c_str(), median.real * 1e9 / median.iterations, median.work.items / median.real);
+            std::cerr << line;
+        }
+
+        JsonValue take_results() { return std::move(results); }
+    };
+
+    std::vector<float> noise(std::size_t n, std::uint32_t seed) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+        std::vector<float> v(n);
+        for (float& x : v) x = dist(rng);
+        return v;
+    }
+
+    // FFTのスループット。フレームごとにFFTを呼ぶ
+    template<std::floating_point T>
+    void bench_fft(Runner& runner, const char* type, SimdLevel level) {
+        for (std::uint32_t n = 256; n <= 8192; n <<= 1) {
+            const FFTExecutor<T> executor(n, WindowType::Hann, level);
+            auto ws = executor.make_workspace();
+            const std::vector<float> source = noise(n, n);
+            std::vector<T> pcm(source.begin(), source.end());
+            std::vector<T> result(n / 2);
+            runner.run(std::string("FFT<") + type + ">/" + to_string(level) + "/" + std::to_string(n), [&](std::uint64_t iterations) {
+                for (std::uint64_t i = 0; i < iterations; ++i) {
+                    executor.FFT(pcm.data(), result.data(), ws);
+                }
+                sink = float(result[1]);
+                return Work{ double(iterations), double(iterations) * n * sizeof(T) };
+                });
+        }
+    }
+
+    // 1つの窓のBPMを求める時間
+    void bench_tempo(Runner& runner) {
+        TempoCheck<float> tempo(BPMDataSize, BPMFFT_N, DisplayFrameRate * FFT_N);
+        std::vector<float> volume = noise(BPMDataSize, 7);
+        for (float& v : volume) v = std::abs(v);
+        std::vector<float> work(BPMDataSize);
+        for (auto [method, name] : { std::pair{ TempoMethod::ChirpZ, "chirp_z" }, std::pair{ TempoMethod::Direct, "direct" } }) {
+            runner.run(std::string("TempoCheck/get_BPM/") + name, [&](std::uint64_t iterations) {
+                for (std::uint64_t i = 0; i < iterations; ++i) {
+                    std::copy(volume.begin(), volume.end(), work.begin());  // get_BPMは入力を書き換える
+                    sink = float(tempo.get_BPM<BPMOutputCount>(work.data(), BPMLower, BPMUpper, method)[0].bpm);
+                }
+                return Work{ double(iterations), 0 };
+                });
+        }
+
+        // 逐次更新では音量1フレームごとのBPM
+        tempo.start_tracking(BPMLower, BPMUpper);
+        runner.run("TempoCheck/push+tracked_BPM", [&](std::uint64_t iterations) {
+            for (std::uint64_t i = 0; i < iterations; ++i) {
+                tempo.push(volume[i % BPMDataSize]);
+                sink = float(tempo.tracked_BPM<BPMOutputCount>()[0].bpm);
+            }
+            return Work{ double(iterations), 0 };
+            });
+    }
+
+    // 複数のスレッドがそれぞれのMemoryUtilに書き込み、同じExecutorで処理する (バッチ処理で複数トラックを解析する状況)
+    void bench_memory_util(Runner& runner) {
+        constexpr std::size_t Block = 4096;
+        const std::vector<float> source = noise(Block, 11);
+        const std::size_t hardware = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+        for (std::size_t writers = 1; writers <= hardware; writers *= 2) {
+            runner.run("MemoryUtil/write/writers:" + std::to_string(writers), [&](std::uint64_t iterations) {
+                std::vector<std::thread> threads;
+                for (std::size_t w = 0; w < writers; ++w) {
+                    threads.emplace_back([&]() {
+                        float energy = 0;
+                        MemoryUtil<float> mem(BPMFFT_N * VolumeBatch, [&energy](float* frame) {
+                            float sum = 0;
+                            for (int i = 0; i < BPMFFT_N * VolumeBatch; ++i) sum += frame[i] * frame[i];
+                            energy += sum;
+                            });
+                        for (std::uint64_t i = 0; i < iterations; ++i) {
+                            mem.write(source.data(), Block);
+                        }
+                        mem.wait_all_processes_end();
+                        sink = energy;
+                        });
+                }
+                for (auto& t : threads) t.join();
+                const double samples = double(iterations) * Block * writers;
+                return Work{ samples, samples * sizeof(float) };
+                });
+        }
+    }
+
+    // 和音、チャープ、120BPMのクリックを重ねたステレオのWAVを書き出す
+    void write_synthetic_wav(const std::filesystem::path& path, std::uint32_t sample_rate, double seconds) {
+        const std::uint32_t frames = static_cast<std::uint32_t>(sample_rate * seconds);
+        std::vector<float> pcm(std::size_t(frames) * 2);
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<float> dist(-0.05f, 0.05f);
+        for (std::uint32_t i = 0; i < frames; ++i) {
+            const double t = double(i) / sample_rate;
+            const double chirp = std::sin(2 * std::numbers::pi * (100 * t + 200 * t * t / seconds));
+            const double chord = std::sin(2 * std::numbers::pi * 440 * t) + 0.5 * std::sin(2 * std::numbers::pi * 660 * t);
+            const double beat = std::fmod(t, 0.5);
+            const double click = beat < 0.02 ? std::exp(-beat * 300) * std::sin(2 * std::numbers::pi * 1500 * t) : 0.0;
+            pcm[i * 2] = static_cast<float>(0.2 * chord + 0.2 * chirp + 0.5 * click) + dist(rng);
+            pcm[i * 2 + 1] = static_cast<float>(0.2 * chord - 0.2 * chirp + 0.5 * click) + dist(rng);
+        }
+
+        auto put = [](std::ofstream& f, auto v) { f.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+        const std::uint32_t data_bytes = static_cast<std::uint32_t>(pcm.size() * sizeof(float));
+        std::ofstream f(path, std::ios::binary | std::ios::trunc);
+        f.write("RIFF", 4);
+        put(f, std::uint32_t(36 + data_bytes));
+        f.write("WAVEfmt ", 8);
+        put(f, std::uint32_t(16));
+        put(f, std::uint16_t(3));      // WAVE_FORMAT_IEEE_FLOAT
+        put(f, std::uint16_t(2));
+        put(f, sample_rate);
+        put(f, std::uint32_t(sample_rate * 2 * sizeof(float)));
+        put(f, std::uint16_t(2 * sizeof(float)));
+        put(f, std::uint16_t(32));
+        f.write("data", 4);
+        put(f, data_bytes);
+        f.write(reinterpret_cast<const char*>(pcm.data()), data_bytes);
+        if (!f) {
+            throw std::runtime_error("cannot write " + to_utf8(path));
+        }
+    }
+
+    // WAVのデコードからData.jsonの書き出しまで。items_per_secondはFFT_L, FFT_Rのフレーム数
+    void bench_end_to_end(Runner& runner, const SharedAnalysisTables& tables) {
+        constexpr double Seconds = 30;
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "MediaAnalysisBench";
+        std::filesystem::create_directories(dir);
+        const std::filesystem::path wav = dir / "synthetic.wav";
+        write_synthetic_wav(wav, 44100, Seconds);
+
+        struct Case { const char* name; TrackOutputOptions options; };
+        TrackOutputOptions bands{ FrameFileLayout::Framed, SpectrumEncoding::DecibelU8, true };
+        bands.band_count = 64;
+        bands.bins = false;
+        for (const Case& c : { Case{ "raw_f32", {} }, Case{ "maf_db16_compressed", { FrameFileLayout::Framed, SpectrumEncoding::DecibelU16, true } }, Case{ "maf_mel64_db8", bands } }) {
+            runner.run(std::string("EndToEnd/synthetic_30s/") + c.name, [&](std::uint64_t iterations) {
+                double frames = 0;
+                for (std::uint64_t i = 0; i < iterations; ++i) {
+                    OfflineAnalysis ma(std::make_unique<WaveFileSource>(wav));
+                    auto properties = ma.get_graph_properties();
+                    AnalysisGraph graph(properties.ChannelCount(), properties.SampleRate());
+                    TrackPipeline pipeline(graph, dir / c.name, tables, c.options);
+                    graph.attach(ma);
+                    ma.execute();
+                    graph.end_of_stream();
+                    frames += double(pipeline.finish().spectrum_frames);
+                }
+                return Work{ frames, 0 };
+                });
+        }
+        std::error_code ec;
+        std::filesystem::remove_all(dir, ec);
+    }
+
+    Options parse(int argc, char* argv[]) {
+        Options o;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "--filter" && i + 1 < argc) o.filter = argv[++i];
+            else if (arg == "--min-time" && i + 1 < argc) o.min_time = std::stod(argv[++i]);
+            else if (arg == "--repetitions" && i + 1 < argc) o.repetitions = std::max(1ul, std::stoul(argv[++i]));
+            else if (arg == "--pin" && i + 1 < argc) o.pin = std::stoi(argv[++i]);
+            else if (arg == "--out" && i + 1 < argc) o.out = argv[++i];
+            else if (arg == "--list") o.list = true;
+            else throw std::invalid_argument("unknown argument: " + arg);
+        }
+        return o;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    try {
+        options = parse(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n"
+            << "Usage: MediaAnalysisBench [--filter TEXT] [--min-time SEC] [--repetitions N] [--pin CPU] [--out FILE] [--list]" << std::endl;
+        return 1;
+    }
+    if (options.pin >= 0 && !pin_thread(options.pin)) {
+        std::cerr << "cannot pin to CPU " << options.pin << std::endl;
+        return 1;
+    }
+
+    Runner runner(options);
+    try {
+        // floatはCPUが対応する全てのSIMD段階、doubleは汎用のスカラー版
+        for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE4, SimdLevel::AVX2, SimdLevel::AVX512 }) {
+            if (level <= detect_simd_level()) bench_fft<float>(runner, "float", level);
+        }
+        bench_fft<double>(runner, "double", SimdLevel::Scalar);
+        bench_tempo(runner);
+        bench_memory_util(runner);
+        const SharedAnalysisTables tables;
+        bench_end_to_end(runner, tables);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (options.list) return 0;
+
+    JsonValue root = JsonValue::object();
+    JsonValue& context = root.insert("context", JsonValue::object());
+    context.insert("date", utc_now());
+    context.insert("executable", argc > 0 ? argv[0] : "");
+    context.insert("num_cpus", std::thread::hardware_concurrency());
+    context.insert("simd", to_string(detect_simd_level()));
+    context.insert("pinned_cpu", options.pin);
+    context.insert("min_time", options.min_time);
+#ifdef NDEBUG
+    context.insert("library_build_type", "release");
+#else
+    context.insert("library_build_type", "debug");
+#endif
+    root.insert("benchmarks", runner.take_results());
+
+    const std::string json = root.stringify(true);
+    if (options.out.empty()) {
+        std::cout << json << std::endl;
+    }
+    else {
+        std::ofstream f(options.out, std::ios::binary | std::ios::trunc);
+        f << json << "\n";
+        if (!f) {
+            std::cerr << "cannot write " << to_utf8(options.out) << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -1,34 +1,29 @@
 ﻿#include "pch.h"
-#include "FFTExecutor.h"
+#include "TrackPipeline.h"
+#include "BatchScheduler.h"
+#include "OfflineAnalysis.h"
+#ifdef MEDIAANALYSIS_WINRT
 #include "MusicAnalysis.h"
-#include "MemoryUtil.h"
-#include "TempoCheck.h"
+#endif
 
 #include <chrono>
 #include <ratio>
+#include <iomanip>
+#include <locale>
 
-winrt::Windows::Foundation::IAsyncAction FFTAndBPMOutput(const winrt::Windows::Storage::StorageFile& audioSource, const winrt::Windows::Storage::StorageFolder& output);
+constexpr std::uint64_t DecoderReserve = 32ull << 20;  // AudioGraphのデコーダーが使うメモリの見込み (バッチ処理の見積もり用)
+constexpr std::uint32_t DefaultBandCount = 64;         // --bandsで帯域数を指定しない場合の帯域数
 
-static winrt::Windows::Foundation::IAsyncOperation<winrt::Windows::Storage::StorageFolder> getCurrentStorageFolder()
-{
-    const DWORD bufferSize = GetCurrentDirectory(0, NULL);
-    if (bufferSize == 0) {
-        winrt::throw_last_error();
-    }
-    std::unique_ptr<wchar_t[]> lpBuffer = std::make_unique<wchar_t[]>(bufferSize);
-    winrt::check_bool(GetCurrentDirectory(bufferSize, lpBuffer.get()));
-    // wprintf(L"%ls\n", lpBuffer.get());
-    return winrt::Windows::Storage::StorageFolder::GetFolderFromPathAsync(lpBuffer.get());
-}
+// バッチ処理でディレクトリから拡張子で選ぶ音声ファイル。WinRTがなければWAVだけを読める
+#ifdef MEDIAANALYSIS_WINRT
+static const std::vector<std::wstring> AudioExtensions = { L".wav", L".mp3", L".m4a", L".aac", L".wma", L".flac" };
+#else
+static const std::vector<std::wstring> AudioExtensions = { L".wav" };
+#endif
 
-// StorageFile::DisplayName()が拡張子付きファイル名を返す場合があるらしいため確実に拡張子を外した文字列を返す
-static std::filesystem::path getFileNameWithoutExtension(const winrt::Windows::Storage::StorageFile& item)
-{
-    std::filesystem::path p = item.Name().c_str();
-    return p.stem();
-}
+using TimeSpan = TrackPipeline::TimeSpan;   // winrt::Windows::Foundation::TimeSpanと同じ型
 
-void printTimeSpan(const winrt::Windows::Foundation::TimeSpan& ts)
+void printTimeSpan(const TimeSpan& ts)
 {
     int64_t totalMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(ts).count();
 
@@ -42,7 +37,7 @@ void printTimeSpan(const winrt::Windows::Foundation::TimeSpan& ts)
         << '\r' << std::flush;
 }
 
-static void printChangeTimeSpan(const winrt::Windows::Foundation::TimeSpan& ts)
+static void printChangeTimeSpan(const TimeSpan& ts)
 {
     static int64_t before = 0;
     int64_t count = std::chrono::duration_cast<std::chrono::duration<int_fast64_t, std::deci>>(ts).count();
@@ -60,230 +55,245 @@ static void printChangeTimeSpan(const winrt::Windows::Foundation::TimeSpan& ts)
     }
 }
 
-static void printJson(const winrt::Windows::Data::Json::IJsonValue value, int tab = 0)
+static void printUsage()
 {
-    switch (value.ValueType())
-    {
-        using enum winrt::Windows::Data::Json::JsonValueType;
-    case Object:
-        for (const auto& j : value.GetObjectW()) {
-            std::wcout << '\n' << std::wstring(tab, '\t') << j.Key().c_str() << "\t:";
-            printJson(j.Value(), tab + 1);
-        }
-        break;
-    case Array:
-        for (const auto& i : value.GetArray()) {
-            printJson(i);
-        }
-        break;
-    default:
-        std::wcout << value.Stringify().c_str() << '\t';
-        break;
-    }
+    std::wcerr << "Usage: MediaAnalysis <file> [output folder]\n"
+        << "       MediaAnalysis --batch <folder | wildcard | list file> [output root] [--jobs N] [--memory MB]\n"
+        << "Options: --format raw | maf   raw: headerless .bin (default), maf: .maf with a header and a chunk index\n"
+        << "         --encoding f32 | f16 | db16 | db8   spectrum values: float (default), half float, 16/8 bit decibel codes\n"
+        << "         --db-range MIN MAX   decibel range of db16 / db8 (default -100 60)\n"
+        << "         --compress   delta + Rice coding of the spectrum chunks (maf with f16 / db16 / db8 only)\n"
+        << "         --bands mel | bark | octave   also write Bands_L / Bands_R aggregated by a filterbank\n"
+        << "         --band-count N   number of bands (default 64)\n"
+        << "         --bands-only   write the bands instead of FFT_L / FFT_R" << std::endl;
 }
 
-constexpr int FFT_N = 1024;
-constexpr int BPMDataSize = 480;
-constexpr int BPMFFT_N = 512;
-constexpr int BPMOutputCount = 3;
-constexpr int BPMLower = 60;
-constexpr int BPMUpper = 270;
-constexpr int DisplayFrameRate = 30;
-
-int wmain(int argc, wchar_t* argv[])
+// WAVはAudioGraphを介さずOfflineAnalysisで読む
+static bool isWaveFile(const std::filesystem::path& p)
 {
-    using namespace winrt::Windows::Storage;
-
-    // 初期化
-    winrt::init_apartment(); 
-    std::wcout.imbue(std::locale("japanese"));
+    std::wstring ext = p.extension().wstring();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+    return ext == L".wav";
+}
 
-    // ファイル取得
-#if true // test
-    StorageFile r = getCurrentStorageFolder().get().GetFileAsync(L"80.mp3").get();
-#else
-    // ファイルが指定されなければエラー
-    StorageFile r{ nullptr };
-    if (argc >= 2) {
-        r = StorageFile::GetFileFromPathAsync(argv[1]).get();
-    }
-    else {
-        std::wcerr << "Not enough arguments. Specify a path." << endl;
-        return 1;
-    }
-#endif
-    // 出力先フォルダーが指定されなければファイル名を指定
-    StorageFolder f{ nullptr };
-    if (argc >= 3) {
-        f = StorageFolder::GetFolderFromPathAsync(argv[2]).get();
+// MusicAnalysisはAudioGraphの再生完了を待ち、OfflineAnalysisは呼び出したスレッドで終端まで処理する
+template<class Analysis>
+static void executeAnalysis(Analysis& ma)
+{
+    if constexpr (std::is_void_v<decltype(ma.execute())>) {
+        ma.execute();
     }
     else {
-        f = getCurrentStorageFolder().get().CreateFolderAsync(getFileNameWithoutExtension(r).c_str(), CreationCollisionOption::OpenIfExists).get();
+        ma.execute().get();
     }
-    std::wcout << f.Path().c_str() << std::endl;
+}
 
-    FFTAndBPMOutput(r, f).get();
+template<class Analysis>
+static TrackSummary analyzeTrack(Analysis& ma, const std::filesystem::path& output, const SharedAnalysisTables& tables, const TrackOutputOptions& options, TrackPipeline::Progress progress)
+{
+    // デコードは1回だけ行い、チャンネル数やサンプリングレートを変えたストリームはグラフから各処理に配る
+    auto source_aep = ma.get_graph_properties();
+    AnalysisGraph graph(source_aep.ChannelCount(), source_aep.SampleRate());
+    TrackPipeline pipeline(graph, output, tables, options, default_executor(), progress);
 
-    return 0;
+    // 実行
+    graph.attach(ma);
+    executeAnalysis(ma);
+    graph.end_of_stream();
+    return pipeline.finish();
 }
 
-winrt::Windows::Foundation::IAsyncAction FFTAndBPMOutput(const winrt::Windows::Storage::StorageFile& audioSource, const winrt::Windows::Storage::StorageFolder& output)
+// 1ファイルを解析する。複数のスレッドから同時に呼び出せる
+static TrackSummary analyzeFile(const std::filesystem::path& input, const std::filesystem::path& output, const SharedAnalysisTables& tables, const TrackOutputOptions& options, TrackPipeline::Progress progress = nullptr)
 {
-    using namespace winrt::Windows::Media::Core;
-    using namespace winrt::Windows::Media::Audio;
-    using namespace winrt::Windows::Media::MediaProperties;
-
-    MusicAnalysis ma(audioSource);
+    // WAVはAudioGraphを介さず、再生時間に縛られずに解析する
+    if (isWaveFile(input)) {
+        OfflineAnalysis ma(std::make_unique<WaveFileSource>(input));
+        return analyzeTrack(ma, output, tables, options, progress);
+    }
+#ifdef MEDIAANALYSIS_WINRT
+    using namespace winrt::Windows::Storage;
+    try {
+        MusicAnalysis ma(StorageFile::GetFileFromPathAsync(std::filesystem::absolute(input).c_str()).get());
+        return analyzeTrack(ma, output, tables, options, progress);
+    }
+    catch (const winrt::hresult_error& e) {
+        throw std::runtime_error(winrt::to_string(e.message()));
+    }
+#else
+    throw std::runtime_error("unsupported input (only WAV can be decoded without WinRT): " + to_utf8(input));
+#endif
+}
 
-    std::filesystem::path out_path = output.Path().c_str();
+static int runSingle(const std::vector<std::wstring>& args, const TrackOutputOptions& output_options, const SharedAnalysisTables& tables)
+{
+    const std::filesystem::path input = args[0];
+    // 出力先フォルダーが指定されなければファイル名を指定
+    const std::filesystem::path output = args.size() >= 2 ? std::filesystem::path(args[1]) : std::filesystem::current_path() / input.stem();
+    std::wcout << output.wstring() << std::endl;
 
-#pragma region /****** L,RチャンネルのFFTを出力する準備 ここから *******/
-    /* FFT関連の初期化 */
-    FFTExecutor<float> executor(FFT_N);
-    constexpr int FFTResultSize = FFT_N / 2;
-    std::unique_ptr<float[]> l_result = std::make_unique<float[]>(FFTResultSize);
-    std::unique_ptr<float[]> r_result = std::make_unique<float[]>(FFTResultSize);
+    TrackSummary summary = analyzeFile(input, output, tables, output_options, printChangeTimeSpan);
+    std::wcout << '\n' << summary.data.stringify(true).c_str() << std::endl;
+    return 0;
+}
 
-    /* FFT関連の出力先の作成 */
-    // Lチャンネル
-    std::ofstream lStream((out_path / L"FFT_L.bin"), std::ios::trunc | std::ios::binary);
-    float lmax = 0; // 検証用
-    MemoryUtil<float> l_pcm = MemoryUtil<float>(FFT_N, [&lStream, &executor, &l_result, &lmax](float* pcm) {
-        executor.FFT(pcm, l_result.get());
-        lStream.write(reinterpret_cast<const char*>(l_result.get()), sizeof(float) * FFTResultSize);
-        for (int i = 0; i < FFTResultSize; i++) if (l_result[i] > lmax) lmax = l_result[i];
-        });
-    // Rチャンネル
-    std::ofstream rStream((out_path / L"FFT_R.bin"), std::ios::trunc | std::ios::binary);
-    float rmax = 0;
-    MemoryUtil<float> r_pcm = MemoryUtil<float>(FFT_N, [&rStream, &executor, &r_result, &rmax](float* pcm) {
-        executor.FFT(pcm, r_result.get());
-        rStream.write(reinterpret_cast<const char*>(r_result.get()), sizeof(float) * FFTResultSize);
-        for (int i = 0; i < FFTResultSize; i++) if (r_result[i] > rmax) rmax = r_result[i];
+static int runBatch(const std::vector<std::wstring>& args, const BatchOptions& options, const TrackOutputOptions& output_options, const SharedAnalysisTables& tables)
+{
+    const std::vector<std::filesystem::path> inputs = collect_batch_inputs(args[0], AudioExtensions);
+    if (inputs.empty()) {
+        std::wcerr << "No input files." << std::endl;
+        return 1;
+    }
+    const std::filesystem::path root = args.size() >= 2 ? std::filesystem::path(args[1]) : std::filesystem::current_path();
+    std::filesystem::create_directories(root);
+
+    BatchScheduler scheduler(options);
+    const auto started = std::chrono::steady_clock::now();
+    const std::uint64_t working_set = TrackPipeline::working_set(default_executor().concurrency());
+    std::vector<TrackSummary> results = scheduler.run(inputs, root,
+        [&tables, &output_options](const std::filesystem::path& input, const std::filesystem::path& output) {
+            return analyzeFile(input, output, tables, output_options);
+        },
+        [working_set](const std::filesystem::path& input) {
+            return working_set + (isWaveFile(input) ? 0 : DecoderReserve);
+        },
+        [](const TrackSummary& s, std::size_t done, std::size_t total) {
+            std::wcout << '[' << done << '/' << total << "] " << s.source.filename().wstring();
+            if (s.succeeded()) {
+                std::wcout << "\tBPM " << s.bpm << "\t" << s.elapsed << "s" << std::endl;
+            }
+            else {
+                std::wcout << "\tfailed: " << s.error.c_str() << std::endl;
+            }
         });
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
 
-    /* 処理の作成 */
-    // PCMデータ出力形式の設定
-    AudioEncodingProperties fft_aep = ma.get_graph_properties();
-    fft_aep.ChannelCount(2);
-    fft_aep.SampleRate(DisplayFrameRate * FFT_N);
+    // 全体の集計
+    const JsonValue summary = scheduler.make_summary(results, elapsed);
+    std::ofstream(root / L"Summary.json", std::ios::trunc | std::ios::binary) << summary.stringify(true);
 
-    // PCMデータをL,Rに振分け
-    ma.add_outnode([&l_pcm, &r_pcm](float* pcm, uint32_t capacity, winrt::Windows::Foundation::TimeSpan ts) {
-        uint32_t i = 0;
-        while (i < capacity) {
-            l_pcm.write(pcm[i]);
-            i++;
-            r_pcm.write(pcm[i]);
-            i++;
-        }
-        }, fft_aep);
-    /****** L,RチャンネルのFFTを出力する準備 ここまで *******/
-#pragma endregion
-
-#pragma region /****** BPMと音量を出力する準備 ここから *******/
-    std::ofstream tStream((out_path / L"BPM.bin"), std::ios::trunc | std::ios::binary);
-    std::ofstream vStream((out_path / L"Volume.bin"), std::ios::trunc | std::ios::binary);
-
-
-    /* BPM関連の初期化 */
-    // 秒間(samplerate(第3引数) / framesize(第2引数))データ
-    // (size(第1引数) * framesize / samplerate)秒分のBPMを取得可能
-    TempoCheck<float> tempo(BPMDataSize, BPMFFT_N, DisplayFrameRate * FFT_N);
-    MemoryUtil<float> tempo_mem(BPMDataSize, [&vStream, &tStream, &tempo](float* pcm) {  // BPMの取得、出力用関数
-        vStream.write(reinterpret_cast<const char*>(pcm), sizeof(float) * BPMDataSize);
-
-        std::array<unsigned int, BPMOutputCount> bpms = tempo.get_BPM<BPMOutputCount>(pcm, BPMLower, BPMUpper);
-        // std::wcout << bpms[0] << ',' << bpms[1] << ',' << bpms[2] << std::endl;
-        tStream.write(reinterpret_cast<const char*>(bpms.data()), sizeof(unsigned int) * BPMOutputCount);
-        });  // BPMの取得、出力用バッファ
+    const auto failed = std::count_if(results.begin(), results.end(), [](const TrackSummary& s) { return !s.succeeded(); });
+    std::wcout << results.size() - failed << '/' << results.size() << " succeeded in " << elapsed << "s" << std::endl;
+    return failed == 0 ? 0 : 2;
+}
 
-    FFTExecutor<float> bpmFFT(BPMFFT_N);
-    std::unique_ptr<float[]> bpmFFT_result = std::make_unique<float[]>(BPMFFT_N / 2);
-    // 音量への変換、BPM解析の実行
-    float vmax = 0;
-    MemoryUtil<float> volume_mem = MemoryUtil<float>(BPMFFT_N, [&tempo_mem, &bpmFFT, &bpmFFT_result, &vmax](float* pcm) {
-        /* 音量の生成 */
-        float sum = 0;
-#if true
-        bpmFFT.FFT(pcm, bpmFFT_result.get());
-        for (uint32_t i = 0; i < BPMFFT_N / 2; ++i) {
-            sum += bpmFFT_result[i] * bpmFFT_result[i];
+static int run(const std::vector<std::wstring>& argv)
+{
+    const int argc = static_cast<int>(argv.size());
+
+    // 引数の解析
+    std::vector<std::wstring> args;
+    BatchOptions options;
+    TrackOutputOptions output_options;
+    bool batch = false;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::wstring arg = argv[i];
+            if (arg == L"--batch") {
+                batch = true;
+            }
+            else if (arg == L"--jobs" && i + 1 < argc) {
+                options.jobs = std::stoul(argv[++i]);
+            }
+            else if (arg == L"--memory" && i + 1 < argc) {
+                options.memory_limit = std::stoull(argv[++i]) << 20;
+            }
+            else if (arg == L"--format" && i + 1 < argc) {
+                const std::wstring format = argv[++i];
+                if (format == L"raw") output_options.layout = FrameFileLayout::Raw;
+                else if (format == L"maf") output_options.layout = FrameFileLayout::Framed;
+                else throw std::invalid_argument("unknown format");
+            }
+            else if (arg == L"--encoding" && i + 1 < argc) {
+                const std::wstring encoding = argv[++i];
+                if (encoding == L"f32") output_options.encoding = SpectrumEncoding::Float32;
+                else if (encoding == L"f16") output_options.encoding = SpectrumEncoding::Float16;
+                else if (encoding == L"db16") output_options.encoding = SpectrumEncoding::DecibelU16;
+                else if (encoding == L"db8") output_options.encoding = SpectrumEncoding::DecibelU8;
+                else throw std::invalid_argument("unknown encoding");
+            }
+            else if (arg == L"--db-range" && i + 2 < argc) {
+                output_options.floor_db = std::stof(argv[++i]);
+                output_options.ceil_db = std::stof(argv[++i]);
+            }
+            else if (arg == L"--compress") {
+                output_options.compress = true;
+            }
+            else if (arg == L"--bands" && i + 1 < argc) {
+                const std::wstring scale = argv[++i];
+                if (scale == L"mel") output_options.band_scale = BandScale::Mel;
+                else if (scale == L"bark") output_options.band_scale = BandScale::Bark;
+                else if (scale == L"octave") output_options.band_scale = BandScale::Octave;
+                else throw std::invalid_argument("unknown band scale");
+                if (output_options.band_count == 0) output_options.band_count = DefaultBandCount;
+            }
+            else if (arg == L"--band-count" && i + 1 < argc) {
+                output_options.band_count = std::stoul(argv[++i]);
+            }
+            else if (arg == L"--bands-only") {
+                output_options.bins = false;
+            }
+            else {
+                args.push_back(arg);
+            }
         }
-        float vol = std::sqrt(sum / BPMFFT_N);
-#else 
-        // 実行値
-        for (uint32_t i = 0; i < BPMFFT_N; ++i) {
-            sum += pcm[i] * pcm[i];
+        if (output_options.compress && (output_options.layout != FrameFileLayout::Framed || output_options.encoding == SpectrumEncoding::Float32)) {
+            throw std::invalid_argument("--compress needs --format maf and an f16 / db16 / db8 encoding");
         }
-        float vol = std::sqrt(sum / BPMFFT_N);
-#endif
-        if (vmax < vol) vmax = vol;
-        tempo_mem.write(vol);
-    });
-
-    // PCMデータ出力形式の設定
-    AudioEncodingProperties bpm_aep = ma.get_graph_properties();
-    bpm_aep.ChannelCount(1);
-    bpm_aep.SampleRate(DisplayFrameRate * FFT_N);
-
-    // PCMデータを流す
-    ma.add_outnode([&volume_mem](float* pcm, uint32_t capacity, winrt::Windows::Foundation::TimeSpan ts) {
-        for (uint32_t i = 0; i < capacity; ++i) {
-            volume_mem.write(pcm[i]);
+        // dBの範囲が正しくなければここで invalid_argument になる
+        SpectrumQuantizer(output_options.encoding, output_options.floor_db, output_options.ceil_db);
+        if (!output_options.bins && output_options.band_count == 0) {
+            throw std::invalid_argument("--bands-only needs --bands");
         }
-        printChangeTimeSpan(ts);  // 処理進捗の表示
-        }, bpm_aep);
-    /****** BPMと音量を出力する準備 ここまで *******/
-#pragma endregion
-
-    // 実行
-    co_await ma.execute();
-    co_await l_pcm.wait_all_processes_end();
-    co_await r_pcm.wait_all_processes_end();
-    co_await volume_mem.wait_all_processes_end();
-    co_await tempo_mem.wait_all_processes_end();
-
-    lStream.close();
-    rStream.close();
-    vStream.close();
-    tStream.close();
-
-    float fmax = lmax > rmax ? lmax : rmax;
+    }
+    catch (const std::logic_error& e) {
+        std::wcerr << e.what() << std::endl;
+        printUsage();
+        return 1;
+    }
+    // ファイルが指定されなければエラー
+    if (args.empty()) {
+        std::wcerr << "Not enough arguments. Specify a path." << std::endl;
+        printUsage();
+        return 1;
+    }
+    std::wcout << "FFT kernel: " << to_string(simd_level()) << std::endl;   // MEDIAANALYSIS_SIMDで変更可能
 
-    winrt::Windows::Data::Json::JsonObject json = [&]() -> winrt::Windows::Data::Json::JsonObject {
-        using namespace winrt::Windows::Data::Json;
-        JsonObject j{};
-        j.Insert(L"fft", [&fmax]() {
-            JsonObject f{};
-            f.Insert(L"size", JsonValue::CreateNumberValue(FFT_N));
-            f.Insert(L"perSecond", JsonValue::CreateNumberValue(DisplayFrameRate));
-            f.Insert(L"maxValue", JsonValue::CreateNumberValue(fmax));
-            return f;
-            }());
-        j.Insert(L"bpm", []() {
-            JsonObject b{};
-            b.Insert(L"estRange", []() {
-                JsonArray bpmRange{};
-                bpmRange.Append(JsonValue::CreateNumberValue(BPMLower));
-                bpmRange.Append(JsonValue::CreateNumberValue(BPMUpper));
-                return bpmRange;
-                }());
-            b.Insert(L"estSection", JsonValue::CreateNumberValue(BPMDataSize * BPMFFT_N / (DisplayFrameRate * FFT_N)));
-            b.Insert(L"count", JsonValue::CreateNumberValue(BPMOutputCount));
-            return b;
-            }());
-        j.Insert(L"volume", [&vmax]() {
-            JsonObject v{};
-            v.Insert(L"perSecond", JsonValue::CreateNumberValue(DisplayFrameRate * FFT_N / BPMFFT_N));
-            v.Insert(L"maxValue", JsonValue::CreateNumberValue(vmax));
-            return v;
-            }());
-        return j;
-        }();
-    winrt::Windows::Storage::StorageFile jsonfile{ co_await output.CreateFileAsync(L"Data.json", winrt::Windows::Storage::CreationCollisionOption::ReplaceExisting) };
-    co_await winrt::Windows::Storage::FileIO::WriteTextAsync(jsonfile, json.ToString());
-    printJson(json);
+    // FFTとBPMの表は全てのファイルで共有する
+    const SharedAnalysisTables tables;
+    try {
+        return batch ? runBatch(args, options, output_options, tables) : runSingle(args, output_options, tables);
+    }
+    catch (const std::exception& e) {
+        std::wcerr << e.what() << std::endl;
+        return 1;
+    }
+}
 
-    co_return;
-}
\ No newline at end of file
+#ifdef _WIN32
+int wmain(int argc, wchar_t* argv[])
+{
+    // 初期化
+#ifdef MEDIAANALYSIS_WINRT
+    winrt::init_apartment(); 
+#endif
+    std::wcout.imbue(std::locale("japanese"));
+    return run(std::vector<std::wstring>(argv, argv + argc));
+}
+#else
+int main(int argc, char* argv[])
+{
+    // 引数と出力は環境のロケール (通常はUTF-8) で扱う。ロケールが使えなければCのまま
+    try {
+        std::locale::global(std::locale(""));
+        std::wcout.imbue(std::locale());
+        std::wcerr.imbue(std::locale());
+    }
+    catch (const std::runtime_error&) {}
+    std::vector<std::wstring> args;
+    for (int i = 0; i < argc; ++i) {
+        args.push_back(std::filesystem::path(argv[i]).wstring());
+    }
+    return run(args);
+}
+#endif
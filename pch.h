@@ -1,6 +1,7 @@
 ﻿#pragma once
 
-/* winrt関連 */
+/* winrt関連 (MusicAnalysisを使うターゲットだけがMEDIAANALYSIS_WINRTを定義する) */
+#ifdef MEDIAANALYSIS_WINRT
 #include <winrt/Windows.Foundation.h>
 #include <winrt/Windows.Foundation.Collections.h>
 
@@ -12,12 +13,12 @@
 #include <winrt/Windows.Media.Render.h>
 #include <winrt/Windows.Media.MediaProperties.h>
 #include <winrt/Windows.Data.Json.h>
-
-/* windows関連 */
-#include <concurrent_queue.h>
+#endif
 
 /* デバッグ */
+#ifdef _MSC_VER
 #include <crtdbg.h>
+#endif
   
 /* 標準 */
 #include <iostream>
@@ -25,22 +26,41 @@
 
 #include <filesystem>
 #include <string>
+#include <cstring>
+#include <cwctype>
+#include <cstddef>
+#include <stdexcept>
+#include <charconv>
+#include <cstdio>
 
 #include <vector>
 #include <queue>
+#include <deque>
 #include <map>
 #include <array>
+#include <span>
+#include <variant>
+
+#include <memory>
+#include <algorithm>
 
 #include <complex>
 #include <numbers>
 #include <cmath>
+#include <numeric>
+#include <bit>
 
 #include <concepts>
 #include <functional>
+#include <chrono>
+#include <ctime>
+#include <random>
 
 #include <atomic>
 #include <semaphore>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
 
 /* ターゲットによる */
 #include <immintrin.h>
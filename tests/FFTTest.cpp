@@ -0,0 +1,130 @@
+﻿#include "pch.h"
+#include "FFTExecutor.h"
+#include "TestUtil.h"
+
+// FFTExecutorの各SIMD段階のカーネルを倍精度の素朴なDFTと比べる。
+// 実数FFT (N/2点の複素FFTと分離)、L,Rを1回で変換するFFT_stereo、複数フレームのFFT_batchは
+// 1フレームずつのFFTとも比べ、N = 8 から 8192 までの全ての2の乗数で確かめる。
+
+namespace {
+    constexpr std::uint32_t MinN = 8;
+    constexpr std::uint32_t MaxN = 8192;
+    constexpr double Tolerance = 5e-7;   // 許容誤差 (入力のL2ノルム * log2(N) に対する比)
+
+    // 倍精度の素朴なDFT。X[k] = Σ x[n] e^{-2πikn/N} のk < binsを求める
+    std::vector<std::complex<double>> naive_dft(const std::vector<std::complex<double>>& x, std::uint32_t bins) {
+        const std::size_t n = x.size();
+        std::vector<std::complex<double>> turn(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            turn[i] = std::polar(1.0, -2 * std::numbers::pi * double(i) / double(n));
+        }
+        std::vector<std::complex<double>> out(bins);
+        for (std::size_t k = 0; k < bins; ++k) {
+            std::complex<double> sum = 0;
+            for (std::size_t i = 0, j = 0; i < n; ++i, j = (j + k) % n) {
+                sum += x[i] * turn[j];
+            }
+            out[k] = sum;
+        }
+        return out;
+    }
+
+    double l2_norm(const std::vector<std::complex<double>>& x) {
+        double sum = 0;
+        for (const auto& v : x) sum += std::norm(v);
+        return std::sqrt(sum);
+    }
+
+    // 最大の絶対誤差を許容誤差の尺度と比べる
+    template<class A, class B>
+    void check_close(const A& actual, const B& expected, std::size_t count, double scale, const std::string& what) {
+        double error = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            error = std::max(error, std::abs(std::complex<double>(actual[i]) - std::complex<double>(expected[i])));
+        }
+        test::check(error <= Tolerance * scale, what + ": max error " + std::to_string(error) + " > " + std::to_string(Tolerance * scale));
+    }
+
+    void test_size(std::uint32_t n, std::mt19937& rng) {
+        std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+        const std::uint32_t half = n / 2;
+        const double log_n = std::log2(double(n));
+
+        // 入力: 複素FFT用の複素数列と、インターリーブしたステレオPCM
+        std::vector<std::complex<float>> complex_in(n);
+        for (auto& v : complex_in) v = { dist(rng), dist(rng) };
+        std::vector<float> stereo(std::size_t(n) * 2);
+        for (auto& v : stereo) v = dist(rng);
+
+        // 基準: 窓をかけたL,Rと複素数列の倍精度DFT
+        const std::shared_ptr<const float[]> window = FFTTableCache<float>::window(n, WindowType::Hann);
+        std::vector<std::complex<double>> left(n), right(n), complex_ref_in(complex_in.begin(), complex_in.end());
+        for (std::uint32_t i = 0; i < n; ++i) {
+            left[i] = double(stereo[i * 2]) * double(window[i]);
+            right[i] = double(stereo[i * 2 + 1]) * double(window[i]);
+        }
+        const auto complex_ref = naive_dft(complex_ref_in, n);
+        const auto left_ref = naive_dft(left, half + 1);
+        const auto right_ref = naive_dft(right, half + 1);
+        std::vector<double> left_mag(half), right_mag(half);
+        for (std::uint32_t k = 0; k < half; ++k) {
+            left_mag[k] = std::abs(left_ref[k]);
+            right_mag[k] = std::abs(right_ref[k]);
+        }
+        const double complex_scale = l2_norm(complex_ref_in) * log_n;
+        const double left_scale = l2_norm(left) * log_n;
+        const double right_scale = l2_norm(right) * log_n;
+
+        // 複数フレーム: レーン数の倍数にならない数にして、端数の処理も確かめる
+        constexpr std::size_t Frames = 21;
+        std::vector<float> frames(n * Frames);
+        for (auto& v : frames) v = dist(rng);
+
+        for (SimdLevel level : test::available_levels()) {
+            const std::string name = std::string(to_string(level)) + " N=" + std::to_string(n);
+            const FFTExecutor<float> fft(n, WindowType::Hann, level);
+            auto ws = fft.make_workspace();
+
+            std::vector<std::complex<float>> data = complex_in;
+            fft.FFT_complex(data.data(), ws);
+            check_close(data, complex_ref, n, complex_scale, name + " FFT_complex");
+
+            std::vector<float> mono(n);
+            for (std::uint32_t i = 0; i < n; ++i) mono[i] = stereo[i * 2];
+            std::vector<std::complex<float>> spectrum(half + 1);
+            fft.RFFT(mono.data(), spectrum.data(), ws);
+            check_close(spectrum, left_ref, half + 1, left_scale, name + " RFFT");
+
+            std::vector<float> l_single(half), r_single(half);
+            fft.FFT(mono.data(), l_single.data(), ws);
+            check_close(l_single, left_mag, half, left_scale, name + " FFT");
+            for (std::uint32_t i = 0; i < n; ++i) mono[i] = stereo[i * 2 + 1];
+            fft.FFT(mono.data(), r_single.data(), ws);
+            check_close(r_single, right_mag, half, right_scale, name + " FFT (R)");
+
+            // FFT_stereoは1チャンネルずつのFFTと同じ結果になる
+            std::vector<float> l_stereo(half), r_stereo(half);
+            fft.FFT_stereo(stereo.data(), l_stereo.data(), r_stereo.data(), ws);
+            check_close(l_stereo, l_single, half, left_scale, name + " FFT_stereo L");
+            check_close(r_stereo, r_single, half, right_scale, name + " FFT_stereo R");
+
+            // FFT_batchは1フレームずつのFFTと同じ結果になる
+            std::vector<float> batch(half * Frames), single(half * Frames);
+            auto batch_ws = fft.make_batch_workspace();
+            fft.FFT_batch(frames.data(), Frames, batch.data(), batch_ws);
+            for (std::size_t f = 0; f < Frames; ++f) {
+                fft.FFT(frames.data() + f * n, single.data() + f * half, ws);
+            }
+            check_close(batch, single, batch.size(), std::sqrt(double(n)) * log_n, name + " FFT_batch");
+        }
+    }
+}
+
+int main()
+{
+    std::mt19937 rng(20240601);
+    for (std::uint32_t n = MinN; n <= MaxN; n <<= 1) {
+        test_size(n, rng);
+    }
+    return test::result();
+}
@@ -0,0 +1,323 @@
+﻿#include "pch.h"
+#include "FrameFile.h"
+#include "SpectrumQuantizer.h"
+#include "TestUtil.h"
+
+// FrameFileWriterで書いたファイルをFrameFileReaderで読み戻し、書いたフレームと一致することを確かめる。
+// Raw/Framed × f32/f16/db16/db8 × 圧縮なし/DeltaRiceの全ての組み合わせを試し、
+// 圧縮できない組み合わせはFrameFileWriterがinvalid_argumentを投げること、
+// 途中で切れたファイルやヘッダー、索引を書き換えたファイルはFrameFileReaderがruntime_errorを投げることを確かめる。
+
+namespace {
+    constexpr std::uint32_t Channels = 2;
+    constexpr std::uint32_t FrameSize = 33;     // 圧縮のビット列がバイト境界にそろわない要素数
+    constexpr std::uint32_t ChunkFrames = 8;
+
+    struct Encoding {
+        const char* name;
+        FrameDataType type;
+        FrameScale scale;
+    };
+    constexpr Encoding Encodings[] = {
+        { "f32", FrameDataType::Float32, FrameScale::Linear },
+        { "f16", FrameDataType::Float16, FrameScale::Linear },
+        { "db16", FrameDataType::UInt16, FrameScale::Decibel },
+        { "db8", FrameDataType::UInt8, FrameScale::Decibel },
+    };
+
+    struct TempDir {
+        std::filesystem::path path;
+        TempDir() {
+            path = std::filesystem::temp_directory_path() / ("MediaAnalysisFrameFileTest_" + std::to_string(std::random_device{}()));
+            std::filesystem::create_directories(path);
+        }
+        ~TempDir() {
+            std::error_code ec;
+            std::filesystem::remove_all(path, ec);
+        }
+    };
+
+    FrameFormat make_format(const Encoding& encoding, FrameCompression compression) {
+        FrameFormat format;
+        format.type = encoding.type;
+        format.channels = Channels;
+        format.frame_size = FrameSize;
+        format.frame_rate = 44100.0 / 512;
+        format.sample_rate = 44100;
+        format.transform_size = 64;
+        format.name = std::string("FFT_") + encoding.name;
+        format.scale = encoding.scale;
+        if (encoding.scale == FrameScale::Decibel) {
+            format.scale_min = SpectrumQuantizer::DefaultFloorDb;
+            format.scale_max = SpectrumQuantizer::DefaultCeilDb;
+        }
+        format.compression = compression;
+        return format;
+    }
+
+    // スペクトルのように時間方向にゆっくり変わるフレーム。時々大きく跳ばして、圧縮のエスケープも通す
+    std::vector<std::byte> make_frames(const FrameFormat& format, std::uint32_t count, std::mt19937& rng) {
+        const std::uint32_t values = format.channels * format.frame_size;
+        const std::uint32_t bytes = format.frame_bytes();
+        std::vector<std::byte> frames(std::size_t(count) * bytes);
+        std::vector<float> level(values);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (auto& v : level) v = unit(rng);
+
+        for (std::uint32_t f = 0; f < count; ++f) {
+            for (std::uint32_t i = 0; i < values; ++i) {
+                level[i] = std::clamp(level[i] + (unit(rng) - 0.5f) * 0.02f, 0.0f, 1.0f);
+                const float v = unit(rng) < 0.05f ? unit(rng) : level[i];
+                std::byte* out = frames.data() + std::size_t(f) * bytes + std::size_t(i) * FrameFormat::element_bytes(format.type);
+                switch (format.type)
+                {
+                case FrameDataType::Float32: {
+                    const float x = v * 1000.0f;
+                    std::memcpy(out, &x, 4);
+                    break;
+                }
+                case FrameDataType::Float16: {
+                    const std::uint16_t x = SpectrumQuantizer::float_to_half(v * 1000.0f);
+                    std::memcpy(out, &x, 2);
+                    break;
+                }
+                case FrameDataType::UInt16: {
+                    const std::uint16_t x = std::uint16_t(v * 65535.0f);
+                    std::memcpy(out, &x, 2);
+                    break;
+                }
+                default:
+                    *out = std::byte(std::uint8_t(v * 255.0f));
+                    break;
+                }
+            }
+        }
+        return frames;
+    }
+
+    std::vector<std::byte> read_file(const std::filesystem::path& path) {
+        std::vector<std::byte> bytes(std::size_t(std::filesystem::file_size(path)));
+        std::ifstream in(path, std::ios::binary);
+        in.read(reinterpret_cast<char*>(bytes.data()), std::streamsize(bytes.size()));
+        return bytes;
+    }
+
+    void write_file(const std::filesystem::path& path, const std::vector<std::byte>& bytes) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+    }
+
+    // 書いたフレームの期待する値。read_valuesと同じ変換で求める
+    float expected_value(const FrameFormat& format, const std::byte* frame, std::uint32_t i) {
+        switch (format.type)
+        {
+        case FrameDataType::Float32: {
+            float x;
+            std::memcpy(&x, frame + i * 4, 4);
+            return x;
+        }
+        case FrameDataType::Float16: {
+            std::uint16_t x;
+            std::memcpy(&x, frame + i * 2, 2);
+            return SpectrumQuantizer::half_to_float(x);
+        }
+        case FrameDataType::UInt16: {
+            std::uint16_t x;
+            std::memcpy(&x, frame + i * 2, 2);
+            return SpectrumQuantizer::decode_decibel(x, format.scale_min, format.scale_max, 0xFFFF);
+        }
+        default:
+            return SpectrumQuantizer::decode_decibel(std::uint8_t(frame[i]), format.scale_min, format.scale_max, 0xFF);
+        }
+    }
+
+    void test_round_trip(const std::filesystem::path& dir, FrameFileLayout layout, const Encoding& encoding, FrameCompression compression,
+        std::uint32_t count, std::mt19937& rng) {
+        const FrameFormat format = make_format(encoding, compression);
+        const std::string what = std::string(layout == FrameFileLayout::Raw ? "Raw" : "Framed") + " " + encoding.name
+            + (compression == FrameCompression::None ? " None" : " DeltaRice") + " x" + std::to_string(count);
+        const std::filesystem::path path = dir / "round_trip.maf";
+        const std::uint32_t bytes = format.frame_bytes();
+
+        // 圧縮はFramedの8bit, 16bitの要素のみ
+        if (compression != FrameCompression::None && (layout == FrameFileLayout::Raw || FrameFormat::element_bytes(encoding.type) > 2)) {
+            test::check_throws<std::invalid_argument>([&] { FrameFileWriter writer(path, format, layout, ChunkFrames); }, what + ": writer");
+            return;
+        }
+
+        const std::vector<std::byte> frames = make_frames(format, count, rng);
+        {
+            FrameFileWriter writer(path, format, layout, ChunkFrames);
+            for (std::uint32_t f = 0; f < count; ++f) {
+                writer.write(frames.data() + std::size_t(f) * bytes);
+            }
+            test::check(writer.frame_count() == count, what + ": writer frame_count");
+            writer.close(1.5f, -0.5f);
+        }
+
+        if (layout == FrameFileLayout::Raw) {
+            test::check(read_file(path) == frames, what + ": file contents");
+            return;
+        }
+
+        FrameFileReader reader(path);
+        const FrameFileHeader& h = reader.header();
+        test::check(reader.type() == encoding.type && reader.scale() == encoding.scale && reader.compression() == compression, what + ": format");
+        test::check(reader.frame_count() == count && reader.frame_values() == Channels * FrameSize && h.frame_bytes == bytes, what + ": frame count");
+        test::check(h.frame_rate == format.frame_rate && h.sample_rate == format.sample_rate && h.transform_size == format.transform_size, what + ": rates");
+        test::check(h.max_value == 1.5f && h.min_value == -0.5f && format.name == h.name, what + ": header values");
+        test::check(h.scale_min == format.scale_min && h.scale_max == format.scale_max, what + ": scale");
+        test::check(reader.chunks().size() == (count + ChunkFrames - 1) / ChunkFrames, what + ": chunk count");
+
+        std::vector<std::byte> frame(bytes);
+        std::vector<float> values(reader.frame_values());
+        // チャンクをまたいで戻る順にも読む
+        for (std::uint32_t pass = 0; pass < 2; ++pass) {
+            for (std::uint32_t n = 0; n < count; ++n) {
+                const std::uint32_t f = pass == 0 ? n : (n * 7 + 3) % count;
+                const std::byte* expected = frames.data() + std::size_t(f) * bytes;
+                reader.read_frame(f, frame.data());
+                if (!test::check(std::memcmp(frame.data(), expected, bytes) == 0, what + ": read_frame " + std::to_string(f))) return;
+                if (compression == FrameCompression::None) {
+                    test::check(std::memcmp(reader.frame(f), expected, bytes) == 0, what + ": frame " + std::to_string(f));
+                }
+                reader.read_values(f, values.data());
+                for (std::uint32_t i = 0; i < values.size(); ++i) {
+                    if (!test::check(values[i] == expected_value(format, expected, i), what + ": read_values " + std::to_string(f))) break;
+                }
+            }
+        }
+        test::check_throws<std::out_of_range>([&] { reader.read_frame(count, frame.data()); }, what + ": read past end");
+        if (compression != FrameCompression::None) {
+            test::check_throws<std::logic_error>([&] { reader.frame(0); }, what + ": frame on compressed file");
+        }
+    }
+
+    // 正しいファイルを1か所書き換えたものは開けないこと
+    template<class Patch>
+    void check_broken(const std::filesystem::path& dir, const std::vector<std::byte>& original, const std::string& what, Patch&& patch) {
+        std::vector<std::byte> bytes = original;
+        patch(bytes);
+        const std::filesystem::path path = dir / "broken.maf";
+        write_file(path, bytes);
+        test::check_throws<std::runtime_error>([&] { FrameFileReader reader(path); }, what);
+    }
+
+    template<class T>
+    void patch_header(std::vector<std::byte>& bytes, std::size_t offset, T value) {
+        std::memcpy(bytes.data() + offset, &value, sizeof(T));
+    }
+
+    void test_malformed(const std::filesystem::path& dir, FrameCompression compression, std::mt19937& rng) {
+        const Encoding& encoding = Encodings[2];
+        const FrameFormat format = make_format(encoding, compression);
+        const std::string prefix = compression == FrameCompression::None ? "None: " : "DeltaRice: ";
+        const std::filesystem::path path = dir / "valid.maf";
+        constexpr std::uint32_t Count = 20;
+        const std::vector<std::byte> frames = make_frames(format, Count, rng);
+        {
+            FrameFileWriter writer(path, format, FrameFileLayout::Framed, ChunkFrames);
+            for (std::uint32_t f = 0; f < Count; ++f) {
+                writer.write(frames.data() + std::size_t(f) * format.frame_bytes());
+            }
+        }
+        const std::vector<std::byte> valid = read_file(path);
+        FrameFileHeader head;
+        std::memcpy(&head, valid.data(), sizeof(head));
+        const std::size_t index_offset = std::size_t(head.index_offset);
+        auto entry_field = [&](std::size_t chunk, std::size_t field) { return index_offset + chunk * sizeof(FrameChunkEntry) + field; };
+
+        // 書き換えていなければ開ける
+        {
+            const std::filesystem::path copy = dir / "copy.maf";
+            write_file(copy, valid);
+            try {
+                FrameFileReader reader(copy);
+                test::check(reader.frame_count() == Count, prefix + "valid file");
+            }
+            catch (const std::exception& e) {
+                test::check(false, prefix + "valid file (threw " + e.what() + ")");
+            }
+        }
+
+        // 途中で切れたファイル
+        check_broken(dir, valid, prefix + "empty file", [](auto& b) { b.clear(); });
+        check_broken(dir, valid, prefix + "truncated header", [](auto& b) { b.resize(sizeof(FrameFileHeader) - 1); });
+        check_broken(dir, valid, prefix + "truncated data", [&](auto& b) { b.resize(index_offset); });
+        check_broken(dir, valid, prefix + "truncated index", [](auto& b) { b.resize(b.size() - 1); });
+
+        // ヘッダー
+        check_broken(dir, valid, prefix + "bad magic", [](auto& b) { b[0] = std::byte('X'); });
+        check_broken(dir, valid, prefix + "version 0", [](auto& b) { patch_header(b, offsetof(FrameFileHeader, version), std::uint32_t(0)); });
+        check_broken(dir, valid, prefix + "future version", [](auto& b) { patch_header(b, offsetof(FrameFileHeader, version), FrameFileHeader::CurrentVersion + 1); });
+        check_broken(dir, valid, prefix + "header_size", [](auto& b) { patch_header(b, offsetof(FrameFileHeader, header_size), std::uint32_t(256)); });
+        check_broken(dir, valid, prefix + "unknown type", [](auto& b) { patch_header(b, offsetof(FrameFileHeader, type), std::uint32_t(0)); });
+        check_broken(dir, valid, prefix + "unknown type 6", [](auto& b) { patch_header(b, offsetof(FrameFileHeader, type), std::uint32_t(6)); });
+        check_broken(dir, valid, prefix + "unknown compression", [](auto& b) { patch_header(b, offsetof(FrameFileHeader, compression), std::uint32_t(2)); });
+        check_broken(dir, valid, prefix + "frame_bytes", [&](auto& b) { patch_header(b, offsetof(FrameFileHeader, frame_bytes), head.frame_bytes * 4); });
+        check_broken(dir, valid, prefix + "frame_size", [&](auto& b) { patch_header(b, offsetof(FrameFileHeader, frame_size), head.frame_size * 2); });
+        check_broken(dir, valid, prefix + "zero channels", [](auto& b) {
+            patch_header(b, offsetof(FrameFileHeader, channels), std::uint32_t(0));
+            patch_header(b, offsetof(FrameFileHeader, frame_bytes), std::uint32_t(0));
+            });
+        check_broken(dir, valid, prefix + "type of wrong size", [](auto& b) { patch_header(b, offsetof(FrameFileHeader, type), std::uint32_t(FrameDataType::UInt8)); });
+        check_broken(dir, valid, prefix + "incomplete", [](auto& b) { patch_header(b, offsetof(FrameFileHeader, index_offset), std::uint64_t(0)); });
+        check_broken(dir, valid, prefix + "index_offset in header", [](auto& b) { patch_header(b, offsetof(FrameFileHeader, index_offset), std::uint64_t(256)); });
+        check_broken(dir, valid, prefix + "unaligned index_offset", [&](auto& b) { patch_header(b, offsetof(FrameFileHeader, index_offset), head.index_offset - 4); });
+        check_broken(dir, valid, prefix + "index_offset past end", [&](auto& b) { patch_header(b, offsetof(FrameFileHeader, index_offset), std::uint64_t(b.size())); });
+        check_broken(dir, valid, prefix + "wrapping index_offset", [](auto& b) { patch_header(b, offsetof(FrameFileHeader, index_offset), ~std::uint64_t(7)); });
+        check_broken(dir, valid, prefix + "huge chunk_count", [](auto& b) { patch_header(b, offsetof(FrameFileHeader, chunk_count), ~std::uint32_t(0)); });
+        check_broken(dir, valid, prefix + "zero chunk_frames", [](auto& b) { patch_header(b, offsetof(FrameFileHeader, chunk_frames), std::uint32_t(0)); });
+        check_broken(dir, valid, prefix + "frame_count past index", [&](auto& b) { patch_header(b, offsetof(FrameFileHeader, frame_count), std::uint64_t(head.chunk_count) * head.chunk_frames + 1); });
+        check_broken(dir, valid, prefix + "zero frame_rate", [](auto& b) { patch_header(b, offsetof(FrameFileHeader, frame_rate), 0.0); });
+        check_broken(dir, valid, prefix + "NaN frame_rate", [](auto& b) { patch_header(b, offsetof(FrameFileHeader, frame_rate), std::numeric_limits<double>::quiet_NaN()); });
+
+        // 索引
+        check_broken(dir, valid, prefix + "chunk in header", [&](auto& b) { patch_header(b, entry_field(0, offsetof(FrameChunkEntry, offset)), std::uint64_t(0)); });
+        check_broken(dir, valid, prefix + "chunk over index", [&](auto& b) { patch_header(b, entry_field(1, offsetof(FrameChunkEntry, offset)), std::uint64_t(index_offset)); });
+        check_broken(dir, valid, prefix + "wrapping chunk bytes", [&](auto& b) { patch_header(b, entry_field(0, offsetof(FrameChunkEntry, bytes)), ~std::uint64_t(0)); });
+        check_broken(dir, valid, prefix + "chunk first_frame", [&](auto& b) { patch_header(b, entry_field(1, offsetof(FrameChunkEntry, first_frame)), std::uint64_t(0)); });
+        check_broken(dir, valid, prefix + "chunk frames", [&](auto& b) { patch_header(b, entry_field(0, offsetof(FrameChunkEntry, frames)), ChunkFrames + 1); });
+        check_broken(dir, valid, prefix + "short chunk", [&](auto& b) { patch_header(b, entry_field(0, offsetof(FrameChunkEntry, frames)), ChunkFrames - 1); });
+        if (compression == FrameCompression::None) {
+            check_broken(dir, valid, prefix + "chunk bytes too small", [&](auto& b) { patch_header(b, entry_field(0, offsetof(FrameChunkEntry, bytes)), std::uint64_t(head.frame_bytes)); });
+            check_broken(dir, valid, prefix + "unaligned chunk", [&](auto& b) {
+                FrameChunkEntry e;
+                std::memcpy(&e, b.data() + entry_field(0, 0), sizeof(e));
+                patch_header(b, entry_field(0, offsetof(FrameChunkEntry, offset)), e.offset + 1);
+                patch_header(b, entry_field(0, offsetof(FrameChunkEntry, bytes)), e.bytes - 1);
+                });
+        }
+        else {
+            // 索引は正しいが圧縮したデータが途中で切れているものは、開けても読み出しで失敗する
+            std::vector<std::byte> bytes = valid;
+            patch_header(bytes, entry_field(0, offsetof(FrameChunkEntry, bytes)), std::uint64_t(1));
+            const std::filesystem::path broken = dir / "broken_chunk.maf";
+            write_file(broken, bytes);
+            FrameFileReader reader(broken);
+            std::vector<std::byte> frame(head.frame_bytes);
+            test::check_throws<std::runtime_error>([&] { reader.read_frame(0, frame.data()); }, prefix + "truncated chunk data");
+        }
+    }
+}
+
+int main()
+{
+    TempDir dir;
+    std::mt19937 rng(12345);
+
+    for (FrameFileLayout layout : { FrameFileLayout::Raw, FrameFileLayout::Framed }) {
+        for (const Encoding& encoding : Encodings) {
+            for (FrameCompression compression : { FrameCompression::None, FrameCompression::DeltaRice }) {
+                // 空のファイル、1フレーム、チャンクの倍数、最後のチャンクが端数になる数
+                for (std::uint32_t count : { 0u, 1u, ChunkFrames * 2, ChunkFrames * 6 + 3 }) {
+                    test_round_trip(dir.path, layout, encoding, compression, count, rng);
+                }
+            }
+        }
+    }
+    test_malformed(dir.path, FrameCompression::None, rng);
+    test_malformed(dir.path, FrameCompression::DeltaRice, rng);
+
+    return test::result();
+}
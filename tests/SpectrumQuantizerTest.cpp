@@ -0,0 +1,145 @@
+﻿#include "pch.h"
+#include "SpectrumQuantizer.h"
+#include "TestUtil.h"
+
+// SpectrumQuantizerのSIMD版の変換が、Scalarと同じ振幅から同じバイト列を作ることを確かめる。
+// 0、非正規化数、NaN、無限大、dBの下限と上限の前後、半精度の非正規化数と最大値とあふれる境界の前後を含め、
+// ベクトル幅の倍数でない長さで端数の処理も通す。
+
+namespace {
+    // xと、その前後に隣接するfloatを加える
+    void add_around(std::vector<float>& values, float x, int steps = 2) {
+        float lo = x, hi = x;
+        values.push_back(x);
+        for (int i = 0; i < steps; ++i) {
+            lo = std::nextafter(lo, -INFINITY);
+            hi = std::nextafter(hi, INFINITY);
+            values.push_back(lo);
+            values.push_back(hi);
+        }
+    }
+
+    std::vector<float> make_magnitudes(float floor_db, float ceil_db, std::mt19937& rng) {
+        std::vector<float> values;
+        // 0と特殊な値
+        for (float x : { 0.0f, -0.0f, INFINITY, -INFINITY, std::numeric_limits<float>::quiet_NaN(), -std::numeric_limits<float>::quiet_NaN() }) {
+            values.push_back(x);
+        }
+        // ペイロードを持つNaN
+        for (std::uint32_t bits : { 0x7F800001u, 0x7FC00001u, 0x7FC12345u, 0x7FFFFFFFu, 0xFFC02000u, 0x7FA00000u }) {
+            values.push_back(std::bit_cast<float>(bits));
+        }
+        // 単精度の非正規化数と最小の正規化数
+        add_around(values, std::numeric_limits<float>::denorm_min());
+        add_around(values, std::numeric_limits<float>::min());
+        values.push_back(std::bit_cast<float>(0x00400000u));
+        values.push_back(std::numeric_limits<float>::max());
+        values.push_back(1.0f);
+
+        // dBの下限と上限、その間の符号の境界の前後
+        add_around(values, std::pow(10.0f, floor_db / 20));
+        add_around(values, std::pow(10.0f, ceil_db / 20));
+        for (std::uint32_t max_code : { 0xFFu, 0xFFFFu }) {
+            for (std::uint32_t code : { 1u, 2u, max_code / 2, max_code - 1 }) {
+                const float db = floor_db + (ceil_db - floor_db) * (float(code) - 0.5f) / float(max_code);
+                add_around(values, std::pow(10.0f, db / 20), 1);
+            }
+        }
+
+        // 半精度の非正規化数 (2^-24刻み) と丸めの境界、最小の正規化数 (2^-14)、最大値 (65504)、Infになる境界 (65520)
+        for (float x : { 0x1p-26f, 0x1p-25f, 0x1.8p-25f, 0x1p-24f, 0x1.8p-24f, 0x1.4p-23f, 0x1.8p-23f, 0x1.ffcp-15f, 0x1p-14f, 0x1.002p-14f, 65504.0f, 65519.0f, 65520.0f, 65536.0f }) {
+            add_around(values, x);
+            add_around(values, -x, 1);
+        }
+        // 半精度の正規化数の丸めの中点 (偶数と奇数の仮数)
+        for (float x : { 1.0f + 0x1p-11f, 1.0f + 0x3p-11f, 1024.0f + 0.5f, 1024.0f + 1.5f }) {
+            add_around(values, x, 1);
+        }
+
+        // 下限の下から上限の上までの対数一様な乱数
+        std::uniform_real_distribution<float> db(floor_db - 20, ceil_db + 20);
+        for (int i = 0; i < 1000; ++i) values.push_back(std::pow(10.0f, db(rng) / 20));
+        // 全てのビット列からの乱数 (負の値を除く)
+        std::uniform_int_distribution<std::uint32_t> bits(0, 0x7FFFFFFF);
+        for (int i = 0; i < 1000; ++i) values.push_back(std::bit_cast<float>(bits(rng)));
+
+        // 特殊な値をベクトルの各位置に置くため、ずらして並べたものを加え、どのベクトル幅の倍数にもならない長さにする
+        const std::size_t n = values.size();
+        for (std::size_t shift = 1; shift < 8; ++shift) {
+            for (std::size_t i = 0; i < 64; ++i) values.push_back(values[(i * 7 + shift) % n]);
+        }
+        if (values.size() % 2 == 0) values.push_back(0.5f);
+        return values;
+    }
+
+    void test_encoding(SpectrumEncoding encoding, float floor_db, float ceil_db, SimdLevel level, std::mt19937& rng) {
+        const std::string what = std::string(to_string(encoding)) + " [" + std::to_string(floor_db) + ", " + std::to_string(ceil_db) + "] " + to_string(level);
+        const SpectrumQuantizer scalar(encoding, floor_db, ceil_db, SimdLevel::Scalar);
+        const SpectrumQuantizer simd(encoding, floor_db, ceil_db, level);
+        const std::uint32_t bytes = scalar.bytes_per_value();
+
+        const std::vector<float> magnitudes = make_magnitudes(floor_db, ceil_db, rng);
+        std::vector<std::byte> expected(magnitudes.size() * bytes), actual(magnitudes.size() * bytes);
+        scalar.quantize(magnitudes.data(), magnitudes.size(), expected.data());
+        simd.quantize(magnitudes.data(), magnitudes.size(), actual.data());
+        for (std::size_t i = 0; i < magnitudes.size(); ++i) {
+            if (std::memcmp(expected.data() + i * bytes, actual.data() + i * bytes, bytes) != 0) {
+                std::ostringstream s;
+                s << what << ": value " << i << " (" << std::hexfloat << magnitudes[i] << ", 0x" << std::hex
+                    << std::bit_cast<std::uint32_t>(magnitudes[i]) << ") differs from Scalar";
+                test::check(false, s.str());
+            }
+        }
+
+        // 短い長さと先頭をずらした位置で、端数の処理を確かめる
+        for (std::size_t offset = 0; offset < 3; ++offset) {
+            for (std::size_t n = 0; n <= 70; ++n) {
+                std::fill(expected.begin(), expected.end(), std::byte{ 0xCD });
+                std::fill(actual.begin(), actual.end(), std::byte{ 0xCD });
+                scalar.quantize(magnitudes.data() + offset, n, expected.data());
+                simd.quantize(magnitudes.data() + offset, n, actual.data());
+                // n個を超えて書き込まないことも含めて比べる
+                test::check(std::equal(expected.begin(), expected.begin() + (n + 1) * bytes, actual.begin()),
+                    what + ": length " + std::to_string(n) + " offset " + std::to_string(offset));
+            }
+        }
+    }
+
+    // Scalarの半精度への変換を既知の値と比べる
+    void test_half() {
+        const std::pair<float, std::uint16_t> cases[] = {
+            { 0.0f, 0x0000 }, { -0.0f, 0x8000 }, { 1.0f, 0x3C00 }, { -2.0f, 0xC000 },
+            { 65504.0f, 0x7BFF }, { 65519.0f, 0x7BFF }, { 65520.0f, 0x7C00 }, { INFINITY, 0x7C00 }, { -INFINITY, 0xFC00 },
+            { 0x1p-14f, 0x0400 }, { 0x1p-24f, 0x0001 }, { 0x1p-25f, 0x0000 }, { 0x1.000002p-25f, 0x0001 }, { 0x1.8p-24f, 0x0002 },
+            { 1.0f + 0x1p-11f, 0x3C00 }, { 1.0f + 0x3p-11f, 0x3C02 },
+            { std::numeric_limits<float>::quiet_NaN(), 0x7E00 }, { std::bit_cast<float>(0x7F800001u), 0x7E00 },
+            { std::bit_cast<float>(0x7FC12345u), 0x7E09 }, { std::bit_cast<float>(0xFFFFFFFFu), 0xFFFF },
+        };
+        for (const auto& [value, half] : cases) {
+            std::ostringstream s;
+            s << "float_to_half(" << std::hexfloat << value << ")";
+            test::check(SpectrumQuantizer::float_to_half(value) == half, s.str());
+        }
+    }
+}
+
+int main()
+{
+    test_half();
+
+    std::mt19937 rng(2024);
+    const std::pair<float, float> ranges[] = {
+        { SpectrumQuantizer::DefaultFloorDb, SpectrumQuantizer::DefaultCeilDb },
+        { -120.0f, 0.0f },
+        { -60.0f, 40.0f },
+    };
+    for (SimdLevel level : test::available_levels()) {
+        if (level == SimdLevel::Scalar) continue;
+        for (SpectrumEncoding encoding : { SpectrumEncoding::Float16, SpectrumEncoding::DecibelU16, SpectrumEncoding::DecibelU8 }) {
+            for (const auto& [floor_db, ceil_db] : ranges) {
+                test_encoding(encoding, floor_db, ceil_db, level, rng);
+            }
+        }
+    }
+    return test::result();
+}
@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include "CpuFeatures.h"
+
+// テスト用の最小限の検査。失敗は標準エラーに出力して数え、mainはtest::result()を返す。
+// 同じ検査をSIMD段階ごとに繰り返すため、失敗しても止めずに最後まで実行する。
+
+namespace test {
+    inline int failures = 0;
+
+    /**
+     * @brief okが偽なら失敗として記録する
+     */
+    inline bool check(bool ok, const std::string& what) {
+        if (!ok) {
+            ++failures;
+            std::cerr << "FAILED: " << what << std::endl;
+        }
+        return ok;
+    }
+
+    /**
+     * @brief bodyがExceptionを投げなければ失敗として記録する
+     */
+    template<class Exception, class Body>
+    bool check_throws(Body&& body, const std::string& what) {
+        try {
+            body();
+        }
+        catch (const Exception&) {
+            return true;
+        }
+        catch (const std::exception& e) {
+            return check(false, what + " (threw " + e.what() + ")");
+        }
+        return check(false, what + " (did not throw)");
+    }
+
+    /**
+     * @brief CPUが対応している全てのSIMD段階 (Scalarから順に)
+     */
+    inline std::vector<SimdLevel> available_levels() {
+        std::vector<SimdLevel> levels;
+        for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE4, SimdLevel::AVX2, SimdLevel::AVX512 }) {
+            if (level <= detect_simd_level()) levels.push_back(level);
+        }
+        return levels;
+    }
+
+    inline int result() {
+        if (failures != 0) {
+            std::cerr << failures << " check(s) failed" << std::endl;
+            return 1;
+        }
+        std::cerr << "all checks passed" << std::endl;
+        return 0;
+    }
+}